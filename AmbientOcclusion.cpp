@@ -0,0 +1,768 @@
+#include "AmbientOcclusion.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2
+#endif
+
+using namespace std;
+
+// Cache file identification.
+#define AO_MAGIC   0x48434F41 // "AOCH"
+#define AO_VERSION 1
+
+namespace
+{
+    const float PI = 3.14159265358979f;
+
+    // The most triangles in a leaf of the hierarchy.
+    const unsigned LEAF_TRIANGLES = 4;
+
+    // Bins the centroids are sorted into when choosing where to split a node.
+    const int SPLIT_BINS = 16;
+
+    // Below this depth nodes are split at the median instead, which bounds the
+    // depth, and so the traversal stack, by far more triangles than fit in memory.
+    const int MEDIAN_DEPTH = 32;
+    const int MAX_DEPTH = 64;
+
+    // Vertices a thread takes at a time.
+    const unsigned VERTICES_PER_TASK = 256;
+
+    // Rays start this far off the surface, as a fraction of the bounding radius.
+    const float RAY_OFFSET = 1e-4f;
+
+    // A node of the hierarchy: its bounds, and either two children, the first of
+    // which directly follows it, or a run of triangles.
+    struct Node
+    {
+        float low[3];
+        float high[3];
+
+        // The second child, or the first triangle of a leaf.
+        unsigned offset;
+
+        // Triangles in a leaf, zero otherwise.
+        unsigned count;
+    };
+
+    // A triangle as one corner and the edges leaving it. Plain floats keep the
+    // intersection tests free of calls.
+    struct Triangle
+    {
+        float corner[3];
+        float edge1[3];
+        float edge2[3];
+    };
+
+    inline void cross(const float a[3], const float b[3], float result[3])
+    {
+        result[0] = a[1] * b[2] - a[2] * b[1];
+        result[1] = a[2] * b[0] - a[0] * b[2];
+        result[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    inline float dot(const float a[3], const float b[3])
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // A bounding volume hierarchy answering whether rays hit anything.
+    class Bvh
+    {
+    public:
+
+        void build(const vector<Vector3f> &positions, const vector<vector<unsigned> > &faces)
+        {
+            m_triangles.reserve(faces.size());
+            for (size_t i = 0; i < faces.size(); i++)
+            {
+                const Vector3f &a = positions[faces[i][0]], &b = positions[faces[i][3]], &c = positions[faces[i][6]];
+                Triangle triangle;
+                for (int k = 0; k < 3; k++)
+                {
+                    triangle.corner[k] = a[k];
+                    triangle.edge1[k] = b[k] - a[k];
+                    triangle.edge2[k] = c[k] - a[k];
+                }
+                m_triangles.push_back(triangle);
+            }
+
+            m_order.resize(m_triangles.size());
+            for (unsigned i = 0; i < m_order.size(); i++)
+                m_order[i] = i;
+
+            m_nodes.reserve(2 * m_triangles.size() / LEAF_TRIANGLES + 1);
+            if (!m_triangles.empty())
+                buildNode(0, (unsigned)m_triangles.size(), 0);
+
+            // Store the triangles in leaf order.
+            vector<Triangle> ordered(m_triangles.size());
+            for (size_t i = 0; i < m_order.size(); i++)
+                ordered[i] = m_triangles[m_order[i]];
+            m_triangles.swap(ordered);
+            vector<unsigned>().swap(m_order);
+        }
+
+        bool occluded(const float origin[3], const float direction[3], float distance) const
+        {
+            if (m_nodes.empty())
+                return false;
+
+            float inverse[3];
+            for (int k = 0; k < 3; k++)
+                inverse[k] = 1 / direction[k];
+
+            unsigned stack[MAX_DEPTH];
+            int size = 0;
+            unsigned node = 0;
+            for (;;)
+            {
+                const Node &n = m_nodes[node];
+                if (hitBox(n, origin, inverse, distance))
+                {
+                    if (!n.count)
+                    {
+                        stack[size++] = n.offset;
+                        node++;
+                        continue;
+                    }
+
+                    for (unsigned i = n.offset; i < n.offset + n.count; i++)
+                    {
+                        if (hitTriangle(m_triangles[i], origin, direction, distance))
+                            return true;
+                    }
+                }
+
+                if (!size)
+                    return false;
+                node = stack[--size];
+            }
+        }
+
+#ifdef OCCLUSION_SSE2
+        // Traces four rays from one origin together, down every node any of them
+        // still needs. Returns a mask of the rays that hit something.
+        int occluded4(const float origin[3], const __m128 direction[3], float distance) const
+        {
+            if (m_nodes.empty())
+                return 0;
+
+            const __m128 one = _mm_set1_ps(1), zero = _mm_setzero_ps(), far = _mm_set1_ps(distance);
+            __m128 o[3], inverse[3];
+            for (int k = 0; k < 3; k++)
+            {
+                o[k] = _mm_set1_ps(origin[k]);
+                inverse[k] = _mm_div_ps(one, direction[k]);
+            }
+
+            int hit = 0;
+            unsigned stack[MAX_DEPTH];
+            int size = 0;
+            unsigned node = 0;
+            for (;;)
+            {
+                const Node &n = m_nodes[node];
+
+                // Slabs, for each ray still looking.
+                __m128 nearest = zero, farthest = far;
+                for (int k = 0; k < 3; k++)
+                {
+                    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n.low[k]), o[k]), inverse[k]);
+                    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n.high[k]), o[k]), inverse[k]);
+                    nearest = _mm_max_ps(nearest, _mm_min_ps(t0, t1));
+                    farthest = _mm_min_ps(farthest, _mm_max_ps(t0, t1));
+                }
+
+                if (_mm_movemask_ps(_mm_cmple_ps(nearest, farthest)) & ~hit)
+                {
+                    if (!n.count)
+                    {
+                        stack[size++] = n.offset;
+                        node++;
+                        continue;
+                    }
+
+                    for (unsigned i = n.offset; i < n.offset + n.count; i++)
+                        hit |= hitTriangle4(m_triangles[i], origin, direction, far);
+                    if (hit == 0xf)
+                        return hit;
+                }
+
+                if (!size)
+                    return hit;
+                node = stack[--size];
+            }
+        }
+#endif
+
+    private:
+
+        // Builds the node over triangles [first, last) of the order, split along the
+        // longest axis of their centroids where the surface area heuristic says rays
+        // will cost least. Returns the node's index.
+        unsigned buildNode(unsigned first, unsigned last, int depth)
+        {
+            unsigned index = (unsigned)m_nodes.size();
+            m_nodes.push_back(Node());
+
+            Vector3f low(1e30f), high(-1e30f), centroidLow(1e30f), centroidHigh(-1e30f);
+            for (unsigned i = first; i < last; i++)
+            {
+                const Triangle &t = m_triangles[m_order[i]];
+                for (int k = 0; k < 3; k++)
+                {
+                    float a = t.corner[k], b = a + t.edge1[k], c = a + t.edge2[k];
+                    low[k] = min(low[k], min(a, min(b, c)));
+                    high[k] = max(high[k], max(a, max(b, c)));
+                    centroidLow[k] = min(centroidLow[k], centroid(t, k));
+                    centroidHigh[k] = max(centroidHigh[k], centroid(t, k));
+                }
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                m_nodes[index].low[k] = low[k];
+                m_nodes[index].high[k] = high[k];
+            }
+
+            if (last - first <= LEAF_TRIANGLES)
+            {
+                m_nodes[index].offset = first;
+                m_nodes[index].count = last - first;
+                return index;
+            }
+
+            Vector3f extent = centroidHigh - centroidLow;
+            int axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+            float binScale = extent[axis] > 0 ? SPLIT_BINS / extent[axis] : 0;
+
+            unsigned middle = first;
+            if (depth < MEDIAN_DEPTH && binScale > 0)
+            {
+                // Bound the triangles falling in each bin, then sweep both ways to
+                // cost every split between bins.
+                Vector3f binLow[SPLIT_BINS], binHigh[SPLIT_BINS];
+                unsigned binCount[SPLIT_BINS] = {};
+                for (int b = 0; b < SPLIT_BINS; b++)
+                {
+                    binLow[b] = Vector3f(1e30f);
+                    binHigh[b] = Vector3f(-1e30f);
+                }
+
+                for (unsigned i = first; i < last; i++)
+                {
+                    const Triangle &t = m_triangles[m_order[i]];
+                    int b = binOf(t, axis, centroidLow[axis], binScale);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        float c0 = t.corner[k], c1 = c0 + t.edge1[k], c2 = c0 + t.edge2[k];
+                        binLow[b][k] = min(binLow[b][k], min(c0, min(c1, c2)));
+                        binHigh[b][k] = max(binHigh[b][k], max(c0, max(c1, c2)));
+                    }
+                    binCount[b]++;
+                }
+
+                float leftCost[SPLIT_BINS];
+                Vector3f sweepLow(1e30f), sweepHigh(-1e30f);
+                unsigned count = 0;
+                for (int b = 0; b < SPLIT_BINS - 1; b++)
+                {
+                    grow(sweepLow, sweepHigh, binLow[b], binHigh[b]);
+                    count += binCount[b];
+                    leftCost[b] = count ? area(sweepLow, sweepHigh) * count : 0;
+                }
+
+                float bestCost = area(low, high) * (last - first);
+                int bestBin = -1;
+                sweepLow = Vector3f(1e30f);
+                sweepHigh = Vector3f(-1e30f);
+                count = 0;
+                for (int b = SPLIT_BINS - 1; b > 0; b--)
+                {
+                    grow(sweepLow, sweepHigh, binLow[b], binHigh[b]);
+                    count += binCount[b];
+                    float cost = leftCost[b - 1] + (count ? area(sweepLow, sweepHigh) * count : 0);
+                    if (count && count < last - first && cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestBin = b - 1;
+                    }
+                }
+
+                if (bestBin >= 0)
+                {
+                    const vector<Triangle> &triangles = m_triangles;
+                    float lowest = centroidLow[axis];
+                    middle = (unsigned)(partition(m_order.begin() + first, m_order.begin() + last,
+                        [&triangles, axis, lowest, binScale, bestBin](unsigned i)
+                        {
+                            return binOf(triangles[i], axis, lowest, binScale) <= bestBin;
+                        }) - m_order.begin());
+                }
+            }
+
+            // Split at the median when no split pays off or the tree is already deep.
+            if (middle == first || middle == last)
+            {
+                middle = first + (last - first) / 2;
+                const vector<Triangle> &triangles = m_triangles;
+                nth_element(m_order.begin() + first, m_order.begin() + middle, m_order.begin() + last,
+                    [&triangles, axis](unsigned a, unsigned b)
+                    {
+                        return centroid(triangles[a], axis) < centroid(triangles[b], axis);
+                    });
+            }
+
+            buildNode(first, middle, depth + 1);
+            unsigned second = buildNode(middle, last, depth + 1);
+            m_nodes[index].offset = second;
+            m_nodes[index].count = 0;
+            return index;
+        }
+
+        static float centroid(const Triangle &t, int axis)
+        {
+            return t.corner[axis] + (t.edge1[axis] + t.edge2[axis]) / 3;
+        }
+
+        static int binOf(const Triangle &t, int axis, float lowest, float binScale)
+        {
+            return min((int)((centroid(t, axis) - lowest) * binScale), SPLIT_BINS - 1);
+        }
+
+        static void grow(Vector3f &low, Vector3f &high, const Vector3f &otherLow, const Vector3f &otherHigh)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                low[k] = min(low[k], otherLow[k]);
+                high[k] = max(high[k], otherHigh[k]);
+            }
+        }
+
+        static float area(const Vector3f &low, const Vector3f &high)
+        {
+            Vector3f d = high - low;
+            return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+        }
+
+        static bool hitBox(const Node &n, const float origin[3], const float inverse[3], float distance)
+        {
+            float nearest = 0, farthest = distance;
+            for (int k = 0; k < 3; k++)
+            {
+                float t0 = (n.low[k] - origin[k]) * inverse[k];
+                float t1 = (n.high[k] - origin[k]) * inverse[k];
+                nearest = max(nearest, min(t0, t1));
+                farthest = min(farthest, max(t0, t1));
+            }
+            return nearest <= farthest;
+        }
+
+        // Moller-Trumbore.
+        static bool hitTriangle(const Triangle &t, const float origin[3], const float direction[3], float distance)
+        {
+            float p[3];
+            cross(direction, t.edge2, p);
+            float determinant = dot(t.edge1, p);
+            if (determinant == 0)
+                return false;
+
+            float inverse = 1 / determinant;
+            float s[3] = { origin[0] - t.corner[0], origin[1] - t.corner[1], origin[2] - t.corner[2] };
+            float u = dot(s, p) * inverse;
+            if (u < 0 || u > 1)
+                return false;
+
+            float q[3];
+            cross(s, t.edge1, q);
+            float v = dot(direction, q) * inverse;
+            if (v < 0 || u + v > 1)
+                return false;
+
+            float hit = dot(t.edge2, q) * inverse;
+            return hit > 0 && hit < distance;
+        }
+
+#ifdef OCCLUSION_SSE2
+        // Moller-Trumbore for four rays from one origin, which shares the parts that
+        // depend only on the origin. Degenerate cases give NaNs, which compare false.
+        static int hitTriangle4(const Triangle &t, const float origin[3], const __m128 direction[3], __m128 far)
+        {
+            float s[3] = { origin[0] - t.corner[0], origin[1] - t.corner[1], origin[2] - t.corner[2] };
+            float q[3];
+            cross(s, t.edge1, q);
+
+            // p = direction x edge2
+            __m128 px = _mm_sub_ps(_mm_mul_ps(direction[1], _mm_set1_ps(t.edge2[2])), _mm_mul_ps(direction[2], _mm_set1_ps(t.edge2[1])));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(direction[2], _mm_set1_ps(t.edge2[0])), _mm_mul_ps(direction[0], _mm_set1_ps(t.edge2[2])));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(direction[0], _mm_set1_ps(t.edge2[1])), _mm_mul_ps(direction[1], _mm_set1_ps(t.edge2[0])));
+
+            __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(t.edge1[0])),
+                _mm_mul_ps(py, _mm_set1_ps(t.edge1[1]))), _mm_mul_ps(pz, _mm_set1_ps(t.edge1[2])));
+            __m128 inverse = _mm_div_ps(_mm_set1_ps(1), determinant);
+
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(s[0])),
+                _mm_mul_ps(py, _mm_set1_ps(s[1]))), _mm_mul_ps(pz, _mm_set1_ps(s[2]))), inverse);
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(direction[0], _mm_set1_ps(q[0])),
+                _mm_mul_ps(direction[1], _mm_set1_ps(q[1]))), _mm_mul_ps(direction[2], _mm_set1_ps(q[2]))), inverse);
+            __m128 hit = _mm_mul_ps(_mm_set1_ps(dot(t.edge2, q)), inverse);
+
+            const __m128 zero = _mm_setzero_ps();
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+            inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1)));
+            inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpgt_ps(hit, zero), _mm_cmplt_ps(hit, far)));
+            return _mm_movemask_ps(inside);
+        }
+#endif
+
+        vector<Node> m_nodes;
+        vector<Triangle> m_triangles;
+        vector<unsigned> m_order;
+    };
+
+    // What the baking threads share.
+    struct BakeJob
+    {
+        const Bvh *bvh;
+        const vector<Vector3f> *positions;
+        const vector<Vector3f> *normals;
+
+        // Ray directions around +z, cosine-weighted.
+        vector<Vector3f> directions;
+        float distance;
+        float offset;
+
+        atomic<unsigned> next;
+        vector<float> *values;
+    };
+
+    // Van der Corput's radical inverse in base 2.
+    float radicalInverse(unsigned bits)
+    {
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return bits * 2.3283064365386963e-10f;
+    }
+
+    // A well-spread angle per vertex, which turns its rays so neighbouring vertices
+    // do not share the same directions.
+    float vertexAngle(unsigned vertex)
+    {
+        unsigned h = vertex * 0x9E3779B9u;
+        h ^= h >> 16;
+        h *= 0x85EBCA6Bu;
+        h ^= h >> 13;
+        return (h & 0xffffff) / (float)0x1000000 * 2 * PI;
+    }
+
+    void bakeVertices(BakeJob *job)
+    {
+        const vector<Vector3f> &positions = *job->positions;
+        const vector<Vector3f> &normals = *job->normals;
+        unsigned rays = (unsigned)job->directions.size();
+        unsigned count = (unsigned)positions.size();
+
+        vector<float> local(rays * 3), world(rays * 3);
+        for (unsigned ray = 0; ray < rays; ray++)
+        {
+            for (int k = 0; k < 3; k++)
+                local[ray * 3 + k] = job->directions[ray][k];
+        }
+
+        for (;;)
+        {
+            unsigned first = job->next.fetch_add(VERTICES_PER_TASK);
+            if (first >= count)
+                return;
+
+            for (unsigned i = first; i < min(first + VERTICES_PER_TASK, count); i++)
+            {
+                const Vector3f &normal = normals[i];
+                if (normal == Vector3f::ZERO)
+                {
+                    (*job->values)[i] = 1;
+                    continue;
+                }
+
+                // A frame around the normal, turned by the vertex's own angle.
+                Vector3f tangent = Vector3f::cross(fabs(normal.x()) > 0.5f ? Vector3f::UP : Vector3f::RIGHT, normal).normalized();
+                Vector3f bitangent = Vector3f::cross(normal, tangent);
+                float angle = vertexAngle(i);
+                Vector3f x = tangent * cos(angle) + bitangent * sin(angle);
+                Vector3f y = Vector3f::cross(normal, x);
+
+                float frame[3][3], origin[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    frame[0][k] = x[k];
+                    frame[1][k] = y[k];
+                    frame[2][k] = normal[k];
+                    origin[k] = positions[i][k] + normal[k] * job->offset;
+                }
+
+                // Every ray's direction, one coordinate after another.
+                for (unsigned ray = 0; ray < rays; ray++)
+                {
+                    const float *l = &local[ray * 3];
+                    for (int k = 0; k < 3; k++)
+                        world[k * rays + ray] = frame[0][k] * l[0] + frame[1][k] * l[1] + frame[2][k] * l[2];
+                }
+
+                unsigned blocked = 0, ray = 0;
+#ifdef OCCLUSION_SSE2
+                for (; ray + 4 <= rays; ray += 4)
+                {
+                    __m128 direction[3];
+                    for (int k = 0; k < 3; k++)
+                        direction[k] = _mm_loadu_ps(&world[k * rays + ray]);
+
+                    int hits = job->bvh->occluded4(origin, direction, job->distance);
+                    blocked += (hits & 1) + ((hits >> 1) & 1) + ((hits >> 2) & 1) + ((hits >> 3) & 1);
+                }
+#endif
+                for (; ray < rays; ray++)
+                {
+                    float direction[3] = { world[ray], world[rays + ray], world[2 * rays + ray] };
+                    if (job->bvh->occluded(origin, direction, job->distance))
+                        blocked++;
+                }
+
+                (*job->values)[i] = 1 - (float)blocked / rays;
+            }
+        }
+    }
+
+    void hashBytes(unsigned long long &hash, const void *data, size_t size)
+    {
+        const unsigned char *bytes = (const unsigned char *)data;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+
+    // FNV-1a over the mesh's positions and triangles and the ray count.
+    unsigned long long meshKey(const vector<Vector3f> &positions, const vector<vector<unsigned> > &faces, unsigned rays)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        hashBytes(hash, &rays, sizeof(rays));
+        for (size_t i = 0; i < positions.size(); i++)
+            hashBytes(hash, &positions[i][0], 3 * sizeof(float));
+        for (size_t i = 0; i < faces.size(); i++)
+        {
+            unsigned corners[3] = { faces[i][0], faces[i][3], faces[i][6] };
+            hashBytes(hash, corners, sizeof(corners));
+        }
+
+        return hash;
+    }
+}
+
+AmbientOcclusion::AmbientOcclusion() :
+    m_done(false),
+    m_received(false),
+    m_baked(false),
+    m_key(0),
+    m_rays(0),
+    m_threads(max(1u, thread::hardware_concurrency())),
+    m_bakeMilliseconds(0),
+    m_bakeThreads(0)
+{
+}
+
+AmbientOcclusion::~AmbientOcclusion()
+{
+    wait();
+}
+
+bool AmbientOcclusion::read(const string &path, const vector<Vector3f> &positions,
+    const vector<vector<unsigned> > &faces, unsigned rays)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    unsigned header[4];
+    unsigned long long key = 0;
+    bool ok = fread(header, sizeof(unsigned), 4, file) == 4 && fread(&key, sizeof(key), 1, file) == 1
+        && header[0] == AO_MAGIC && header[1] == AO_VERSION
+        && header[2] == positions.size() && header[3] == rays
+        && key == meshKey(positions, faces, rays);
+
+    vector<float> values(positions.size());
+    ok = ok && fread(values.data(), sizeof(float), values.size(), file) == values.size();
+    fclose(file);
+
+    if (!ok)
+        return false;
+
+    m_key = key;
+    m_rays = rays;
+    m_values.swap(values);
+    m_baked = false;
+    m_received = false;
+    m_done = true;
+    return true;
+}
+
+bool AmbientOcclusion::write(const string &path) const
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    unsigned header[4] = { AO_MAGIC, AO_VERSION, (unsigned)m_values.size(), m_rays };
+    bool ok = fwrite(header, sizeof(unsigned), 4, file) == 4 && fwrite(&m_key, sizeof(m_key), 1, file) == 1
+        && fwrite(m_values.data(), sizeof(float), m_values.size(), file) == m_values.size();
+
+    return fclose(file) == 0 && ok;
+}
+
+void AmbientOcclusion::bake(const vector<Vector3f> &positions, const vector<vector<unsigned> > &faces, unsigned rays)
+{
+    wait();
+
+    // The thread bakes its own copy, so the caller's mesh may change meanwhile.
+    m_positions = positions;
+    m_faces = faces;
+    m_rays = max(rays, 1u);
+    m_done = false;
+    m_received = false;
+    m_baked = true;
+    m_baker = thread(bakeLoop, this);
+}
+
+void AmbientOcclusion::bakeLoop(AmbientOcclusion *occlusion)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    const vector<Vector3f> &positions = occlusion->m_positions;
+    const vector<vector<unsigned> > &faces = occlusion->m_faces;
+
+    occlusion->m_key = meshKey(positions, faces, occlusion->m_rays);
+
+    // Area-weighted vertex normals from the geometry itself.
+    vector<Vector3f> normals(positions.size(), Vector3f::ZERO);
+    for (size_t i = 0; i < faces.size(); i++)
+    {
+        unsigned a = faces[i][0], b = faces[i][3], c = faces[i][6];
+        Vector3f normal = Vector3f::cross(positions[b] - positions[a], positions[c] - positions[a]);
+        normals[a] += normal;
+        normals[b] += normal;
+        normals[c] += normal;
+    }
+    for (size_t i = 0; i < normals.size(); i++)
+    {
+        if (normals[i].absSquared() > 0)
+            normals[i].normalize();
+    }
+
+    Vector3f low(1e30f), high(-1e30f);
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            low[k] = min(low[k], positions[i][k]);
+            high[k] = max(high[k], positions[i][k]);
+        }
+    }
+    float radius = positions.empty() ? 1 : (high - low).abs() / 2;
+
+    Bvh bvh;
+    bvh.build(positions, faces);
+
+    // The same well-spread directions for every vertex: Hammersley points mapped to
+    // the hemisphere so they fall off with the cosine.
+    BakeJob job;
+    job.bvh = &bvh;
+    job.positions = &positions;
+    job.normals = &normals;
+    for (unsigned i = 0; i < occlusion->m_rays; i++)
+    {
+        float u = (i + 0.5f) / occlusion->m_rays, phi = 2 * PI * radicalInverse(i);
+        float r = sqrt(u);
+        job.directions.push_back(Vector3f(r * cos(phi), r * sin(phi), sqrt(1 - u)));
+    }
+    job.distance = AO_DISTANCE * radius;
+    job.offset = RAY_OFFSET * radius;
+    job.next = 0;
+    vector<float> values(positions.size(), 1.0f);
+    job.values = &values;
+
+    unsigned threads = min(occlusion->m_threads, max(1u, (unsigned)(positions.size() / VERTICES_PER_TASK)));
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads; t++)
+        workers.push_back(thread(bakeVertices, &job));
+    bakeVertices(&job);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    occlusion->m_values.swap(values);
+    occlusion->m_bakeThreads = threads;
+    occlusion->m_bakeMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    // Free the copy.
+    vector<Vector3f>().swap(occlusion->m_positions);
+    vector<vector<unsigned> >().swap(occlusion->m_faces);
+
+    occlusion->m_done = true;
+}
+
+bool AmbientOcclusion::receive()
+{
+    if (m_received || !m_done)
+        return false;
+
+    if (m_baker.joinable())
+        m_baker.join();
+
+    m_received = true;
+    return true;
+}
+
+void AmbientOcclusion::wait()
+{
+    if (m_baker.joinable())
+        m_baker.join();
+}
+
+void AmbientOcclusion::setThreadCount(unsigned threads)
+{
+    m_threads = max(1u, threads);
+}
+
+bool AmbientOcclusion::ready() const
+{
+    return m_received;
+}
+
+bool AmbientOcclusion::baked() const
+{
+    return m_baked;
+}
+
+const vector<float> &AmbientOcclusion::values() const
+{
+    return m_values;
+}
+
+unsigned AmbientOcclusion::rayCount() const
+{
+    return m_rays;
+}
+
+double AmbientOcclusion::bakeMilliseconds() const
+{
+    return m_bakeMilliseconds;
+}
+
+unsigned AmbientOcclusion::bakeThreads() const
+{
+    return m_bakeThreads;
+}
@@ -0,0 +1,85 @@
+#ifndef AMBIENT_OCCLUSION_H
+#define AMBIENT_OCCLUSION_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vecmath.h"
+
+// The default number of rays traced from each vertex.
+#define AO_RAYS 64
+
+// How far rays look for occluders, as a fraction of the mesh's bounding radius.
+#define AO_DISTANCE 0.25f
+
+// The ambient occlusion of every vertex of a mesh: the share of a cosine-weighted
+// hemisphere around its normal that is not blocked by geometry nearby. Rays are
+// traced against a bounding volume hierarchy of the triangles, four at a time from
+// the same vertex with SSE2, and the vertices are spread over all cores. The bake
+// runs on a background thread, and the values can be kept in a cache file keyed by
+// the mesh, so each mesh only needs baking once.
+class AmbientOcclusion
+{
+public:
+
+    AmbientOcclusion();
+    ~AmbientOcclusion();
+
+    // Reads the values of an OBJ-style mesh (see loadInput) from a cache file written
+    // for the same mesh and ray count. Returns false if the file has none.
+    bool read(const std::string &path, const std::vector<Vector3f> &positions,
+        const std::vector<std::vector<unsigned> > &faces, unsigned rays);
+
+    // Writes the values to a cache file. Returns false if it cannot be written.
+    bool write(const std::string &path) const;
+
+    // Starts baking an OBJ-style mesh with a number of rays per vertex.
+    void bake(const std::vector<Vector3f> &positions, const std::vector<std::vector<unsigned> > &faces, unsigned rays);
+
+    // Returns true once when values have been baked or read.
+    bool receive();
+
+    // Waits for the bake to finish.
+    void wait();
+
+    // Sets the most threads baking may use.
+    void setThreadCount(unsigned threads);
+
+    bool ready() const;
+
+    // Whether the values were traced rather than read from a cache.
+    bool baked() const;
+
+    // One value per vertex, from 0 (fully occluded) to 1 (open).
+    const std::vector<float> &values() const;
+
+    unsigned rayCount() const;
+
+    // The time the last bake took and the threads it used.
+    double bakeMilliseconds() const;
+    unsigned bakeThreads() const;
+
+private:
+
+    static void bakeLoop(AmbientOcclusion *occlusion);
+
+    // The mesh being baked, which belongs to the thread until it is done.
+    std::vector<Vector3f> m_positions;
+    std::vector<std::vector<unsigned> > m_faces;
+    std::thread m_baker;
+    std::atomic<bool> m_done;
+    bool m_received;
+    bool m_baked;
+
+    // Identifies the mesh and ray count the values belong to.
+    unsigned long long m_key;
+    unsigned m_rays;
+    unsigned m_threads;
+    std::vector<float> m_values;
+
+    double m_bakeMilliseconds;
+    unsigned m_bakeThreads;
+};
+
+#endif // AMBIENT_OCCLUSION_H
@@ -0,0 +1,219 @@
+#include "AntiAliasing.h"
+#include "GLStateCache.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // The samples per pixel of each mode.
+    const int MODE_SAMPLES[ANTIALIAS_MODES] = { 0, 2, 4, 8, 0 };
+
+    const char *MODE_NAMES[ANTIALIAS_MODES] = { "Off", "MSAA 2x", "MSAA 4x", "MSAA 8x", "FXAA" };
+    const char *MODE_ARGUMENTS[ANTIALIAS_MODES] = { "off", "msaa2", "msaa4", "msaa8", "fxaa" };
+
+    // Covers the screen with one triangle.
+    const char *filterVertexShader =
+        "#version 330 compatibility\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;\n"
+        "    gl_Position = vec4(corner, 0.0, 1.0);\n"
+        "}\n";
+
+    // Finds the direction of the edge through each pixel from the luma of its four
+    // diagonal neighbors and blends up to eight pixels along it, keeping the shorter
+    // blend when the longer one overshoots the local luma range. Pixels whose
+    // neighborhood has too little contrast to be an edge are left as they are.
+    const char *filterFragmentShader =
+        "#version 330 compatibility\n"
+        "uniform sampler2D frame;\n"
+        "uniform vec2 texel;\n"
+        "uniform vec2 limit;\n"
+        "out vec4 fragColor;\n"
+        "const float edgeThreshold = 1.0 / 8.0;\n"
+        "const float edgeThresholdMin = 1.0 / 16.0;\n"
+        "const float reduceScale = 1.0 / 8.0;\n"
+        "const float reduceMin = 1.0 / 128.0;\n"
+        "const float spanMax = 8.0;\n"
+        "float luma(vec3 color)\n"
+        "{\n"
+        "    return dot(color, vec3(0.299, 0.587, 0.114));\n"
+        "}\n"
+        // Reads the frame, keeping to the part of the target it was drawn in.
+        "vec3 fetch(vec2 coord)\n"
+        "{\n"
+        "    return texture(frame, min(coord, limit)).rgb;\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 coord = gl_FragCoord.xy * texel;\n"
+        "    vec3 center = texture(frame, coord).rgb;\n"
+        "    float lumaM = luma(center);\n"
+        "    float lumaNW = luma(fetch(coord + vec2(-1.0, 1.0) * texel));\n"
+        "    float lumaNE = luma(fetch(coord + vec2(1.0, 1.0) * texel));\n"
+        "    float lumaSW = luma(fetch(coord + vec2(-1.0, -1.0) * texel));\n"
+        "    float lumaSE = luma(fetch(coord + vec2(1.0, -1.0) * texel));\n"
+        "    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));\n"
+        "    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));\n"
+        "    if (lumaMax - lumaMin < max(edgeThresholdMin, lumaMax * edgeThreshold))\n"
+        "    {\n"
+        "        fragColor = vec4(center, 1.0);\n"
+        "        return;\n"
+        "    }\n"
+        // Blend along the edge, square to the luma gradient.
+        "    vec2 direction = vec2((lumaNW + lumaNE) - (lumaSW + lumaSE), (lumaNW + lumaSW) - (lumaNE + lumaSE));\n"
+        "    float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * reduceScale, reduceMin);\n"
+        "    float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);\n"
+        "    direction = clamp(direction * scale, -spanMax, spanMax) * texel;\n"
+        "    vec3 near = 0.5 * (fetch(coord - direction / 6.0) + fetch(coord + direction / 6.0));\n"
+        "    vec3 far = 0.5 * near + 0.25 * (fetch(coord - direction * 0.5) + fetch(coord + direction * 0.5));\n"
+        "    float lumaFar = luma(far);\n"
+        "    fragColor = vec4(lumaFar < lumaMin || lumaFar > lumaMax ? near : far, 1.0);\n"
+        "}\n";
+}
+
+AntiAliasing::AntiAliasing() :
+    m_valid(false),
+    m_mode(ANTIALIAS_OFF),
+    m_maxSamples(0),
+    m_previous(0),
+    m_width(0),
+    m_height(0),
+    m_active(false)
+{
+}
+
+bool AntiAliasing::create()
+{
+    // Resolving and copying need framebuffer blits.
+    m_valid = glBlitFramebuffer && (glVersionAtLeast(3, 0) || glHasExtension("GL_ARB_framebuffer_object"));
+    if (!m_valid)
+        return false;
+
+    if (glRenderbufferStorageMultisample)
+        glGetIntegerv(GL_MAX_SAMPLES, &m_maxSamples);
+
+    // gl_VertexID and the 3.3 compatibility built-ins need OpenGL 3.3.
+    if (glVersionAtLeast(3, 3) && m_filter.create(filterVertexShader, filterFragmentShader, NULL))
+    {
+        m_filter.use();
+        glUniform1i(m_filter.uniform("frame"), 0);
+        glState.useProgram(0);
+    }
+
+    return true;
+}
+
+bool AntiAliasing::valid() const
+{
+    return m_valid;
+}
+
+bool AntiAliasing::supported(AntiAliasingMode mode) const
+{
+    if (mode == ANTIALIAS_OFF)
+        return true;
+    if (!m_valid)
+        return false;
+    if (mode == ANTIALIAS_FXAA)
+        return m_filter.valid();
+
+    return m_maxSamples >= 2;
+}
+
+void AntiAliasing::setMode(AntiAliasingMode mode)
+{
+    m_mode = supported(mode) ? mode : ANTIALIAS_OFF;
+}
+
+AntiAliasingMode AntiAliasing::mode() const
+{
+    return m_mode;
+}
+
+int AntiAliasing::samples() const
+{
+    return min(MODE_SAMPLES[m_mode], m_maxSamples);
+}
+
+bool AntiAliasing::clamped() const
+{
+    return samples() < MODE_SAMPLES[m_mode];
+}
+
+const char *AntiAliasing::name(AntiAliasingMode mode)
+{
+    return MODE_NAMES[mode];
+}
+
+bool AntiAliasing::parse(const string &text, AntiAliasingMode &mode)
+{
+    for (int i = 0; i < ANTIALIAS_MODES; i++)
+    {
+        if (text == MODE_ARGUMENTS[i])
+        {
+            mode = (AntiAliasingMode)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void AntiAliasing::begin(int width, int height, int maxWidth, int maxHeight)
+{
+    m_active = m_mode != ANTIALIAS_OFF;
+    if (!m_active)
+        return;
+
+    m_width = width;
+    m_height = height;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previous);
+
+    // Remake the target when the mode or the largest frame changes.
+    int samples = this->samples();
+    bool texture = m_mode == ANTIALIAS_FXAA;
+    if (!m_target.valid() || m_target.width() != maxWidth || m_target.height() != maxHeight
+        || m_target.samples() != samples || (m_target.texture() != 0) != texture)
+    {
+        m_target.destroy();
+        m_active = m_target.create(maxWidth, maxHeight, samples, texture);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_previous);
+    }
+
+    if (!m_active)
+        return;
+
+    m_target.bind();
+    glViewport(0, 0, width, height);
+}
+
+void AntiAliasing::end()
+{
+    if (!m_active)
+        return;
+    m_active = false;
+
+    // Multisamples are averaged by blitting them to single-sampled pixels.
+    if (m_target.samples())
+    {
+        m_target.blit(m_width, m_height, (GLuint)m_previous, m_width, m_height);
+        return;
+    }
+
+    // Filter the frame into the previous framebuffer over one full-screen triangle,
+    // reading texel centers up to the last pixel drawn.
+    glBindFramebuffer(GL_FRAMEBUFFER, m_previous);
+    glBindTexture(GL_TEXTURE_2D, m_target.texture());
+    m_filter.use();
+    glUniform2f(m_filter.uniform("texel"), 1.0f / m_target.width(), 1.0f / m_target.height());
+    glUniform2f(m_filter.uniform("limit"), (m_width - 0.5f) / m_target.width(), (m_height - 0.5f) / m_target.height());
+
+    glState.disable(GL_DEPTH_TEST);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState.enable(GL_DEPTH_TEST);
+
+    glState.useProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
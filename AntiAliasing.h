@@ -0,0 +1,87 @@
+#ifndef ANTI_ALIASING_H
+#define ANTI_ALIASING_H
+
+#include <string>
+#include "Shader.h"
+#include "Framebuffer.h"
+
+// How frames are anti-aliased.
+enum AntiAliasingMode
+{
+    // Drawn straight to the target, aliased.
+    ANTIALIAS_OFF,
+
+    // Drawn with 2, 4, or 8 samples per pixel and resolved by blitting.
+    ANTIALIAS_MSAA2,
+    ANTIALIAS_MSAA4,
+    ANTIALIAS_MSAA8,
+
+    // Drawn into a texture and smoothed along its edges in one full-screen pass.
+    ANTIALIAS_FXAA,
+
+    ANTIALIAS_MODES
+};
+
+// Anti-aliases frames by drawing them offscreen and copying them to wherever drawing
+// was directed before. Multisampling (MSAA) shades once per pixel but tests depth
+// and coverage per sample, so it smooths geometric edges at the cost of filling every
+// sample. The FXAA-style filter costs one pass over the pixels whatever the scene,
+// finding edges by their luma contrast and blending along them, which also softens
+// edges inside shading but cannot recover detail smaller than a pixel.
+class AntiAliasing
+{
+public:
+
+    AntiAliasing();
+
+    // Finds how many samples the context allows and compiles the filter. Returns false
+    // if the context has no framebuffer objects, in which case frames stay aliased.
+    bool create();
+
+    bool valid() const;
+
+    // Whether a mode can be used here. MSAA modes over the context's sample limit
+    // draw with the limit.
+    bool supported(AntiAliasingMode mode) const;
+
+    void setMode(AntiAliasingMode mode);
+    AntiAliasingMode mode() const;
+
+    // The samples per pixel the current mode draws with, or 0 without multisampling.
+    int samples() const;
+
+    // Whether the current mode draws with fewer samples than it names, because the
+    // context allows no more.
+    bool clamped() const;
+
+    static const char *name(AntiAliasingMode mode);
+
+    // Reads a mode as given on the command line: off, msaa2, msaa4, msaa8, or fxaa.
+    // Returns false if there is no such mode.
+    static bool parse(const std::string &text, AntiAliasingMode &mode);
+
+    // Directs drawing of a width x height frame to the offscreen target, which is sized
+    // for frames up to maxWidth x maxHeight so that changing the resolution does not
+    // reallocate it. Leaves drawing where it is when off.
+    void begin(int width, int height, int maxWidth, int maxHeight);
+
+    // Resolves or filters the frame into the bottom-left of the framebuffer that was
+    // bound at begin, and directs drawing back there.
+    void end();
+
+private:
+
+    ShaderProgram m_filter;
+    Framebuffer m_target;
+    bool m_valid;
+    AntiAliasingMode m_mode;
+    int m_maxSamples;
+
+    // The framebuffer drawing was directed to before, and the frame being drawn.
+    GLint m_previous;
+    int m_width;
+    int m_height;
+    bool m_active;
+};
+
+#endif // ANTI_ALIASING_H
@@ -0,0 +1,369 @@
+#include "BatchRenderer.h"
+#include "GLStateCache.h"
+#include "Frustum.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+    // Lights each vertex like fixed-function GL_LIGHT0, taking the transform and the
+    // ambient and diffuse color from the object's draw parameters.
+    const char *batchVertexShader =
+        "#version 430 compatibility\n"
+        "#ifdef DRAW_PARAMETERS\n"
+        "#extension GL_ARB_shader_draw_parameters : require\n"
+        "#define DRAW_ID gl_DrawIDARB\n"
+        "#else\n"
+        "layout(location = 2) in int drawId;\n"
+        "#define DRAW_ID drawId\n"
+        "#endif\n"
+        "layout(location = 0) in vec3 position;\n"
+        "layout(location = 1) in vec3 normal;\n"
+        "struct DrawParameters\n"
+        "{\n"
+        "    mat4 model;\n"
+        "    vec4 color;\n"
+        "};\n"
+        "layout(std430, binding = 0) readonly buffer DrawParameterBuffer\n"
+        "{\n"
+        "    DrawParameters parameters[];\n"
+        "};\n"
+        "out vec4 color;\n"
+        "void main()\n"
+        "{\n"
+        "    DrawParameters p = parameters[DRAW_ID];\n"
+        "    vec4 eye = gl_ModelViewMatrix * (p.model * vec4(position, 1.0));\n"
+        "    vec3 n = normalize(gl_NormalMatrix * (mat3(p.model) * normal));\n"
+        "    vec4 light = gl_LightSource[0].position;\n"
+        "    vec3 l = normalize(light.xyz - eye.xyz * light.w);\n"
+        "    vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+        "    float diffuse = max(dot(n, l), 0.0);\n"
+        "    float specular = diffuse > 0.0 ? pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+        "    color = p.color * (gl_LightModel.ambient + gl_LightSource[0].ambient + diffuse * gl_LightSource[0].diffuse)\n"
+        "        + specular * gl_FrontLightProduct[0].specular;\n"
+        "    color.a = p.color.a;\n"
+        "    gl_Position = gl_ProjectionMatrix * eye;\n"
+        "}\n";
+
+    const char *batchFragmentShader =
+        "#version 430 compatibility\n"
+        "in vec4 color;\n"
+        "out vec4 fragColor;\n"
+        "void main()\n"
+        "{\n"
+        "    fragColor = color;\n"
+        "}\n";
+
+    // Replaces a buffer's storage and fills it, so we never wait on the previous frame's draw.
+    void streamBuffer(GLenum target, GLuint buffer, GLsizeiptr size, const void *data)
+    {
+        glState.bindBuffer(target, buffer);
+        glBufferData(target, size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(target, 0, size, data);
+    }
+}
+
+BatchRenderer::BatchRenderer() :
+    m_commandBuffer(0),
+    m_parameterBuffer(0),
+    m_drawIdBuffer(0),
+    m_drawParameters(false),
+    m_occlusionCulling(false),
+    m_drawCalls(0),
+    m_frustumCulled(0),
+    m_occlusionCulled(0),
+    m_submitMilliseconds(0),
+    m_occlusionMilliseconds(0)
+{
+}
+
+unsigned BatchRenderer::addMesh(const IndexedMesh &mesh)
+{
+    MeshRange range;
+    range.firstIndex = (GLuint)m_arena.indices.size();
+    range.indexCount = (GLuint)mesh.indices.size();
+    range.baseVertex = (GLint)m_arena.vertices.size();
+    range.center = mesh.center;
+    range.radius = mesh.radius;
+
+    // Indices stay relative to the mesh; the command's base vertex offsets them.
+    m_arena.vertices.insert(m_arena.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    m_arena.indices.insert(m_arena.indices.end(), mesh.indices.begin(), mesh.indices.end());
+
+    m_meshes.push_back(range);
+    m_culler.addOccluder(mesh);
+    return (unsigned)m_meshes.size() - 1;
+}
+
+void BatchRenderer::addObject(unsigned mesh, const Matrix4f &transform, const Vector4f &color)
+{
+    Object object;
+    object.mesh = mesh;
+
+    Matrix4f m = transform;
+    memcpy(object.parameters.model, (float *)m, sizeof(object.parameters.model));
+    for (int i = 0; i < 4; i++)
+        object.parameters.color[i] = color[i];
+
+    // The sphere grows with the largest axis scale of the transform.
+    const MeshRange &range = m_meshes[mesh];
+    float scale = max(m.getCol(0).xyz().abs(), max(m.getCol(1).xyz().abs(), m.getCol(2).xyz().abs()));
+    Vector4f center = m * Vector4f(range.center, 1);
+    object.bounds = Vector4f(center.xyz(), range.radius * scale);
+
+    m_objects.push_back(object);
+}
+
+bool BatchRenderer::create()
+{
+    // Multi-draw indirect and shader storage buffers need OpenGL 4.3.
+    if (m_arena.empty() || !glVersionAtLeast(4, 3))
+        return false;
+
+    // Read the draw index from the driver if we can, otherwise from a per-instance attribute.
+    m_drawParameters = glHasExtension("GL_ARB_shader_draw_parameters");
+
+    string vertexSource = batchVertexShader;
+    if (m_drawParameters)
+        vertexSource.insert(vertexSource.find('\n') + 1, "#define DRAW_PARAMETERS\n");
+
+    if (!m_program.create(vertexSource.c_str(), batchFragmentShader, NULL))
+        return false;
+
+    m_buffer.create(m_arena);
+
+    glGenBuffers(1, &m_commandBuffer);
+    glGenBuffers(1, &m_parameterBuffer);
+
+    if (!m_drawParameters)
+    {
+        // Command i starts at instance i, so its single instance reads draw index i.
+        vector<GLint> drawIds(m_objects.size());
+        for (size_t i = 0; i < drawIds.size(); i++)
+            drawIds[i] = (GLint)i;
+
+        glGenBuffers(1, &m_drawIdBuffer);
+        glState.bindBuffer(GL_ARRAY_BUFFER, m_drawIdBuffer);
+        glBufferData(GL_ARRAY_BUFFER, max<size_t>(drawIds.size(), 1) * sizeof(GLint), drawIds.empty() ? NULL : &drawIds[0], GL_STATIC_DRAW);
+        glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    return true;
+}
+
+void BatchRenderer::draw()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Matrix4f clip = currentClipMatrix();
+    Frustum frustum(clip);
+
+    vector<unsigned> visible;
+    for (size_t i = 0; i < m_objects.size(); i++)
+    {
+        const Object &object = m_objects[i];
+        if (frustum.intersectsSphere(object.bounds.xyz(), object.bounds[3]))
+            visible.push_back((unsigned)i);
+    }
+    m_frustumCulled = (unsigned)(m_objects.size() - visible.size());
+
+    m_occlusionCulled = 0;
+    m_occlusionMilliseconds = 0;
+    if (m_occlusionCulling && !visible.empty())
+        cullOccluded(clip, visible);
+
+    // Build one command and one parameter block per visible object.
+    m_commands.clear();
+    m_parameters.clear();
+    for (size_t i = 0; i < visible.size(); i++)
+    {
+        const Object &object = m_objects[visible[i]];
+        const MeshRange &range = m_meshes[object.mesh];
+        DrawElementsIndirectCommand command;
+        command.count = range.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = (GLuint)m_commands.size();
+
+        m_commands.push_back(command);
+        m_parameters.push_back(object.parameters);
+    }
+
+    m_drawCalls = 0;
+    if (!m_commands.empty())
+    {
+        if (m_program.valid())
+        {
+            streamBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer, m_commands.size() * sizeof(DrawElementsIndirectCommand), &m_commands[0]);
+            streamBuffer(GL_SHADER_STORAGE_BUFFER, m_parameterBuffer, m_parameters.size() * sizeof(DrawParameters), &m_parameters[0]);
+            glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_parameterBuffer);
+
+            m_program.use();
+            m_buffer.bind();
+
+            if (!m_drawParameters)
+            {
+                glState.bindBuffer(GL_ARRAY_BUFFER, m_drawIdBuffer);
+                glEnableVertexAttribArray(ATTRIB_DRAW_ID);
+                glVertexAttribIPointer(ATTRIB_DRAW_ID, 1, GL_INT, sizeof(GLint), (const GLvoid *)0);
+                glVertexAttribDivisor(ATTRIB_DRAW_ID, 1);
+            }
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid *)0, (GLsizei)m_commands.size(), 0);
+            m_drawCalls++;
+
+            if (!m_drawParameters)
+            {
+                glVertexAttribDivisor(ATTRIB_DRAW_ID, 0);
+                glDisableVertexAttribArray(ATTRIB_DRAW_ID);
+            }
+
+            m_buffer.unbind();
+            glState.useProgram(0);
+            glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+            glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            drawFallback();
+        }
+    }
+
+    m_submitMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void BatchRenderer::cullOccluded(const Matrix4f &clip, vector<unsigned> &visible)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Rank the objects by how large they look: radius over distance, taking the
+    // distance from the clip w row.
+    Vector4f w = clip.getRow(3);
+    vector<pair<float, unsigned> > ranked;
+    for (size_t i = 0; i < visible.size(); i++)
+    {
+        const Vector4f &bounds = m_objects[visible[i]].bounds;
+        float distance = w[0] * bounds[0] + w[1] * bounds[1] + w[2] * bounds[2] + w[3];
+        float size = distance > bounds[3] ? bounds[3] / distance : numeric_limits<float>::max();
+        ranked.push_back(make_pair(-size, visible[i]));
+    }
+
+    size_t occluders = min<size_t>(ranked.size(), CULLER_OCCLUDERS);
+    partial_sort(ranked.begin(), ranked.begin() + occluders, ranked.end());
+
+    m_culler.begin(clip);
+    for (size_t i = 0; i < occluders; i++)
+    {
+        const Object &object = m_objects[ranked[i].second];
+        m_culler.rasterize(object.mesh, object.parameters.model);
+    }
+    m_culler.end();
+
+    // An occluder lies at its own depth, so it never hides itself.
+    size_t kept = 0;
+    for (size_t i = 0; i < visible.size(); i++)
+    {
+        const Vector4f &bounds = m_objects[visible[i]].bounds;
+        if (!m_culler.occluded(bounds.xyz(), bounds[3]))
+            visible[kept++] = visible[i];
+    }
+
+    m_occlusionCulled = (unsigned)(visible.size() - kept);
+    visible.resize(kept);
+
+    m_occlusionMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void BatchRenderer::drawFallback()
+{
+    if (m_arena.empty())
+        return;
+
+    // Save the material color, which each object overrides.
+    glPushAttrib(GL_LIGHTING_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    for (size_t i = 0; i < m_commands.size(); i++)
+    {
+        const DrawElementsIndirectCommand &command = m_commands[i];
+        const DrawParameters &parameters = m_parameters[i];
+        const MeshVertex *vertices = &m_arena.vertices[command.baseVertex];
+
+        glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, parameters.color);
+        glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), &vertices->position);
+        glNormalPointer(GL_FLOAT, sizeof(MeshVertex), &vertices->normal);
+
+        glPushMatrix();
+        glMultMatrixf(parameters.model);
+        glDrawElements(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, &m_arena.indices[command.firstIndex]);
+        glPopMatrix();
+
+        m_drawCalls++;
+    }
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPopAttrib();
+}
+
+unsigned BatchRenderer::meshCount() const
+{
+    return (unsigned)m_meshes.size();
+}
+
+unsigned BatchRenderer::objectCount() const
+{
+    return (unsigned)m_objects.size();
+}
+
+unsigned BatchRenderer::visibleCount() const
+{
+    return (unsigned)m_commands.size();
+}
+
+unsigned BatchRenderer::drawCalls() const
+{
+    return m_drawCalls;
+}
+
+void BatchRenderer::setOcclusionCulling(bool enabled)
+{
+    m_occlusionCulling = enabled;
+}
+
+bool BatchRenderer::occlusionCulling() const
+{
+    return m_occlusionCulling;
+}
+
+unsigned BatchRenderer::frustumCulledCount() const
+{
+    return m_frustumCulled;
+}
+
+unsigned BatchRenderer::occlusionCulledCount() const
+{
+    return m_occlusionCulled;
+}
+
+unsigned BatchRenderer::occluderTriangles() const
+{
+    return m_culler.rasterizedTriangles();
+}
+
+double BatchRenderer::occlusionMilliseconds() const
+{
+    return m_occlusionMilliseconds;
+}
+
+double BatchRenderer::submitMilliseconds() const
+{
+    return m_submitMilliseconds;
+}
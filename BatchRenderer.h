@@ -0,0 +1,132 @@
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+#include <vector>
+#include "MeshBuffer.h"
+#include "Shader.h"
+#include "OcclusionCuller.h"
+
+// Attribute location of the draw index when gl_DrawIDARB is unavailable.
+#define ATTRIB_DRAW_ID 2
+
+// Layout of one glMultiDrawElementsIndirect command.
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Draws many objects, each showing one of several meshes, with a single
+// glMultiDrawElementsIndirect call. Every mesh lives in one shared vertex and
+// index arena; each frame the visible objects become indirect commands, and the
+// shader fetches each object's transform and color by its draw index.
+class BatchRenderer
+{
+public:
+
+    BatchRenderer();
+
+    // Appends a mesh to the shared arena. Returns its index.
+    unsigned addMesh(const IndexedMesh &mesh);
+
+    // Adds an object showing a mesh with the given transform and color.
+    void addObject(unsigned mesh, const Matrix4f &transform, const Vector4f &color);
+
+    // Uploads the arena and compiles the shader. Returns false if multi-draw
+    // indirect is unsupported, in which case objects are drawn one by one.
+    bool create();
+
+    // Culls against the current GL view, and behind the largest objects if occlusion
+    // culling is on, then draws the visible objects with the current light and
+    // specular material.
+    void draw();
+
+    // Off by default: the occluders are simplified copies of their meshes that can
+    // stick out past them, so an object that is just visible can be culled.
+    void setOcclusionCulling(bool enabled);
+    bool occlusionCulling() const;
+
+    unsigned meshCount() const;
+    unsigned objectCount() const;
+    unsigned visibleCount() const;
+    unsigned drawCalls() const;
+
+    // Objects the last frame culled outside the view and behind the occluders.
+    unsigned frustumCulledCount() const;
+    unsigned occlusionCulledCount() const;
+
+    // Occluder triangles rasterized for the last frame.
+    unsigned occluderTriangles() const;
+
+    // CPU time the last frame spent on occlusion culling.
+    double occlusionMilliseconds() const;
+
+    // CPU time spent culling, building and submitting the last frame's draws.
+    double submitMilliseconds() const;
+
+private:
+
+    // Where a mesh lives in the arena.
+    struct MeshRange
+    {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+        Vector3f center;
+        float radius;
+    };
+
+    // Per-draw parameters as laid out in the shader storage buffer (std430).
+    struct DrawParameters
+    {
+        float model[16];
+        float color[4];
+    };
+
+    struct Object
+    {
+        unsigned mesh;
+        DrawParameters parameters;
+
+        // World-space bounding sphere (x, y, z, radius).
+        Vector4f bounds;
+    };
+
+    // Rasterizes the visible objects nearest and largest on screen, then removes
+    // those the others hide.
+    void cullOccluded(const Matrix4f &clip, std::vector<unsigned> &visible);
+
+    void drawFallback();
+
+    IndexedMesh m_arena;
+    std::vector<MeshRange> m_meshes;
+    std::vector<Object> m_objects;
+
+    // This frame's commands and the parameters they index, in draw order.
+    std::vector<DrawElementsIndirectCommand> m_commands;
+    std::vector<DrawParameters> m_parameters;
+
+    MeshBuffer m_buffer;
+    ShaderProgram m_program;
+    GLuint m_commandBuffer;
+    GLuint m_parameterBuffer;
+    GLuint m_drawIdBuffer;
+
+    // Whether the shader reads gl_DrawIDARB rather than a per-instance draw index.
+    bool m_drawParameters;
+
+    // Each mesh's occluder has the mesh's index.
+    OcclusionCuller m_culler;
+    bool m_occlusionCulling;
+
+    unsigned m_drawCalls;
+    unsigned m_frustumCulled;
+    unsigned m_occlusionCulled;
+    double m_submitMilliseconds;
+    double m_occlusionMilliseconds;
+};
+
+#endif // BATCH_RENDERER_H
@@ -0,0 +1,484 @@
+#include "ClusteredLighting.h"
+#include "GLStateCache.h"
+#include "LightingShader.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+    // Follows the occlusion, barycentric, and color attributes' locations, with the
+    // position invariant like the lighting shader's.
+    const char *clusteredVertexShader =
+        "layout(location = ATTRIB_OCCLUSION) in float occlusion;\n"
+        "layout(location = ATTRIB_BARYCENTRIC) in vec3 barycentric;\n"
+        "layout(location = ATTRIB_COLOR) in vec4 color;\n"
+        "out vec3 eyePosition;\n"
+        "out vec3 eyeNormal;\n"
+        "out vec4 clipPosition;\n"
+        "out float vertexOcclusion;\n"
+        "out vec3 vertexBarycentric;\n"
+        "out vec4 vertexColor;\n"
+        "invariant gl_Position;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+        "    eyePosition = eye.xyz;\n"
+        "    eyeNormal = gl_NormalMatrix * gl_Normal;\n"
+        "    vertexOcclusion = occlusion;\n"
+        "    vertexBarycentric = barycentric;\n"
+        "    vertexColor = color;\n"
+        "    clipPosition = gl_ProjectionMatrix * eye;\n"
+        "    gl_Position = clipPosition;\n"
+        "}\n";
+
+    // Follows the cluster constants and the lighting header.
+    const char *clusteredFragmentShader =
+        "uniform samplerBuffer lights;\n"
+        "uniform usamplerBuffer clusters;\n"
+        "uniform usamplerBuffer lightIndices;\n"
+        "uniform float zNear;\n"
+        "uniform float sliceScale;\n"
+        "in vec3 eyePosition;\n"
+        "in vec3 eyeNormal;\n"
+        "in vec4 clipPosition;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 n = normalize(eyeNormal);\n"
+        "    vec3 v = vec3(0.0, 0.0, 1.0);\n"
+        "\n"
+        "    // The main light, as in the plain per-pixel shader.\n"
+        "    vec3 l = normalize(lightPosition.xyz - eyePosition * lightPosition.w);\n"
+        "    float nl = max(dot(n, l), 0.0) * shadowFactor(eyePosition);\n"
+        "    vec3 diffuse = nl * lightDiffuse.rgb;\n"
+        "    vec3 specular = nl > 0.0 ? pow(max(dot(n, normalize(l + v)), 0.0), shininess) * lightSpecular.rgb : vec3(0.0);\n"
+        "\n"
+        "    // Find this pixel's cluster the same way the CPU binned the lights.\n"
+        "    vec2 ndc = clipPosition.xy / clipPosition.w;\n"
+        "    ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y)),\n"
+        "        ivec2(0), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));\n"
+        "    int slice = clamp(int(log(max(-eyePosition.z, zNear) / zNear) * sliceScale), 0, CLUSTER_SLICES - 1);\n"
+        "    uvec2 cluster = texelFetch(clusters, (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x).xy;\n"
+        "\n"
+        "    for (uint i = 0u; i < cluster.y; i++)\n"
+        "    {\n"
+        "        int light = int(texelFetch(lightIndices, int(cluster.x + i)).r);\n"
+        "        vec4 sphere = texelFetch(lights, 2 * light);\n"
+        "        vec3 toLight = sphere.xyz - eyePosition;\n"
+        "        float distance2 = dot(toLight, toLight);\n"
+        "        float radius2 = sphere.w * sphere.w;\n"
+        "        if (distance2 >= radius2)\n"
+        "            continue;\n"
+        "\n"
+        "        float falloff = 1.0 - distance2 / radius2;\n"
+        "        vec3 color = texelFetch(lights, 2 * light + 1).rgb * falloff * falloff;\n"
+        "        vec3 pl = toLight * inversesqrt(distance2);\n"
+        "        float npl = max(dot(n, pl), 0.0);\n"
+        "        diffuse += npl * color;\n"
+        "        if (npl > 0.0)\n"
+        "            specular += pow(max(dot(n, normalize(pl + v)), 0.0), shininess) * color;\n"
+        "    }\n"
+        "\n"
+        "    vec4 diffuseColor = materialDiffuse * vertexColor;\n"
+        "    vec3 color = diffuseColor.rgb * (ambientLight(n) + diffuse) + specular * materialSpecular.rgb;\n"
+        "    writeColor(wireframe(color), diffuseColor.a, eyePosition);\n"
+        "}\n";
+
+    // Floats of light data per light: the eye-space position and radius, then the color.
+    const int LIGHT_FLOATS = 8;
+
+    // The depth slice holding an eye-space depth.
+    int sliceOf(float depth, float zNear, float sliceScale)
+    {
+        int slice = (int)(log(max(depth, zNear) / zNear) * sliceScale);
+        return min(max(slice, 0), CLUSTER_SLICES - 1);
+    }
+
+    // The tile holding a normalized device coordinate.
+    int tileOf(float ndc, int tiles)
+    {
+        int tile = (int)((ndc * 0.5f + 0.5f) * tiles);
+        return min(max(tile, 0), tiles - 1);
+    }
+}
+
+ClusteredLighting::ClusteredLighting() :
+    m_threads(max(1u, thread::hardware_concurrency())),
+    m_scaleX(1),
+    m_scaleY(1),
+    m_near(1),
+    m_far(100),
+    m_clusters(2 * CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES, 0),
+    m_entries(0),
+    m_frame(0),
+    m_shares(1),
+    m_busy(0),
+    m_stopping(false),
+    m_assignTotal(0),
+    m_assignCount(0)
+{
+    for (int i = 0; i < 3; i++)
+        m_buffers[i] = m_textures[i] = 0;
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_start.notify_all();
+    for (size_t i = 0; i < m_workers.size(); i++)
+        m_workers[i].join();
+}
+
+void ClusteredLighting::destroy()
+{
+    if (m_textures[0])
+        glDeleteTextures(3, m_textures);
+    if (m_buffers[0])
+        glState.deleteBuffers(3, m_buffers);
+
+    for (int i = 0; i < 3; i++)
+        m_buffers[i] = m_textures[i] = 0;
+}
+
+bool ClusteredLighting::create()
+{
+    // Texture buffers need OpenGL 3.1; the shaders are written against 3.3.
+    if (!glVersionAtLeast(3, 3) || !glTexBuffer || !glActiveTexture)
+        return false;
+
+    ostringstream vertexSource;
+    vertexSource << "#version 330 compatibility\n"
+        << "#define ATTRIB_OCCLUSION " << ATTRIB_OCCLUSION << "\n"
+        << "#define ATTRIB_BARYCENTRIC " << ATTRIB_BARYCENTRIC << "\n"
+        << "#define ATTRIB_COLOR " << ATTRIB_COLOR << "\n"
+        << clusteredVertexShader;
+
+    ostringstream fragmentSource;
+    fragmentSource << "#version 330 compatibility\n"
+        << "#define CLUSTER_TILES_X " << CLUSTER_TILES_X << "\n"
+        << "#define CLUSTER_TILES_Y " << CLUSTER_TILES_Y << "\n"
+        << "#define CLUSTER_SLICES " << CLUSTER_SLICES << "\n"
+        << LightingShader::fragmentHeader()
+        << clusteredFragmentShader;
+
+    if (!m_program.create(vertexSource.str().c_str(), fragmentSource.str().c_str(), NULL))
+        return false;
+
+    m_program.bindUniformBlock("Lighting", LIGHTING_BLOCK_BINDING);
+
+    m_program.use();
+    glUniform1i(m_program.uniform("lights"), CLUSTER_TEXTURE_UNIT);
+    glUniform1i(m_program.uniform("clusters"), CLUSTER_TEXTURE_UNIT + 1);
+    glUniform1i(m_program.uniform("lightIndices"), CLUSTER_TEXTURE_UNIT + 2);
+    glUniform1i(m_program.uniform("shadowMap"), SHADOW_TEXTURE_UNIT);
+    glState.useProgram(0);
+
+    // Each texture reads its buffer however often the buffer is reallocated.
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    glGenBuffers(3, m_buffers);
+    glGenTextures(3, m_textures);
+    for (int i = 0; i < 3; i++)
+    {
+        glState.bindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    return true;
+}
+
+void ClusteredLighting::setLights(const vector<PointLight> &lights)
+{
+    m_lights = lights;
+}
+
+void ClusteredLighting::setThreadCount(unsigned threads)
+{
+    m_threads = max(1u, threads);
+}
+
+unsigned ClusteredLighting::threadCount() const
+{
+    return m_threads;
+}
+
+bool ClusteredLighting::bound(unsigned light, LightBounds &bounds) const
+{
+    const float *data = &m_lightData[LIGHT_FLOATS * light];
+    float x = data[0], y = data[1], z = data[2], radius = data[3];
+
+    // Depths are distances in front of the eye, which looks down -z.
+    float nearDepth = -z - radius;
+    float farDepth = -z + radius;
+    if (farDepth < m_near || nearDepth > m_far)
+        return false;
+
+    float sliceScale = CLUSTER_SLICES / log(m_far / m_near);
+    bounds.light = light;
+    bounds.z0 = sliceOf(nearDepth, m_near, sliceScale);
+    bounds.z1 = sliceOf(min(farDepth, m_far), m_near, sliceScale);
+
+    // A light around the eye may reach any tile.
+    if (nearDepth <= m_near)
+    {
+        bounds.x0 = bounds.y0 = 0;
+        bounds.x1 = CLUSTER_TILES_X - 1;
+        bounds.y1 = CLUSTER_TILES_Y - 1;
+        return true;
+    }
+
+    // Otherwise its bounding box lies in front of the eye, so the box's corners
+    // bound its projection.
+    float minX = min((x - radius) / nearDepth, (x - radius) / farDepth) * m_scaleX;
+    float maxX = max((x + radius) / nearDepth, (x + radius) / farDepth) * m_scaleX;
+    float minY = min((y - radius) / nearDepth, (y - radius) / farDepth) * m_scaleY;
+    float maxY = max((y + radius) / nearDepth, (y + radius) / farDepth) * m_scaleY;
+    if (maxX < -1 || minX > 1 || maxY < -1 || minY > 1)
+        return false;
+
+    bounds.x0 = tileOf(minX, CLUSTER_TILES_X);
+    bounds.x1 = tileOf(maxX, CLUSTER_TILES_X);
+    bounds.y0 = tileOf(minY, CLUSTER_TILES_Y);
+    bounds.y1 = tileOf(maxY, CLUSTER_TILES_Y);
+    return true;
+}
+
+void ClusteredLighting::assignSlices(int firstSlice, int lastSlice, vector<unsigned> &indices)
+{
+    indices.clear();
+
+    // Keep only the lights reaching these slices.
+    vector<LightBounds> reaching;
+    for (unsigned i = 0; i < m_lights.size(); i++)
+    {
+        LightBounds bounds;
+        if (bound(i, bounds) && bounds.z1 >= firstSlice && bounds.z0 < lastSlice)
+            reaching.push_back(bounds);
+    }
+
+    // Count each slice's lights per tile, lay the tiles out one after another, then fill.
+    const int tiles = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+    vector<unsigned> cursor(tiles);
+    for (int z = firstSlice; z < lastSlice; z++)
+    {
+        unsigned *clusters = &m_clusters[2 * z * tiles];
+        for (int t = 0; t < tiles; t++)
+            clusters[2 * t + 1] = 0;
+
+        for (size_t i = 0; i < reaching.size(); i++)
+        {
+            const LightBounds &b = reaching[i];
+            if (z < b.z0 || z > b.z1)
+                continue;
+
+            for (int y = b.y0; y <= b.y1; y++)
+                for (int x = b.x0; x <= b.x1; x++)
+                    clusters[2 * (y * CLUSTER_TILES_X + x) + 1]++;
+        }
+
+        unsigned offset = (unsigned)indices.size();
+        for (int t = 0; t < tiles; t++)
+        {
+            clusters[2 * t] = cursor[t] = offset;
+            offset += clusters[2 * t + 1];
+        }
+        indices.resize(offset);
+
+        for (size_t i = 0; i < reaching.size(); i++)
+        {
+            const LightBounds &b = reaching[i];
+            if (z < b.z0 || z > b.z1)
+                continue;
+
+            for (int y = b.y0; y <= b.y1; y++)
+                for (int x = b.x0; x <= b.x1; x++)
+                    indices[cursor[y * CLUSTER_TILES_X + x]++] = b.light;
+        }
+    }
+}
+
+void ClusteredLighting::assign(const Matrix4f &modelView, float fieldOfView, float aspect, float zNear, float zFar)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    float focal = 1.0f / tan(fieldOfView * 3.14159265f / 360.0f);
+    m_scaleX = focal / aspect;
+    m_scaleY = focal;
+    m_near = zNear;
+    m_far = zFar;
+
+    // Move the lights into eye coordinates once for every thread.
+    m_lightData.resize(LIGHT_FLOATS * m_lights.size());
+    for (size_t i = 0; i < m_lights.size(); i++)
+    {
+        const PointLight &light = m_lights[i];
+        Vector4f eye = modelView * Vector4f(light.position, 1);
+        float *data = &m_lightData[LIGHT_FLOATS * i];
+
+        data[0] = eye[0];
+        data[1] = eye[1];
+        data[2] = eye[2];
+        data[3] = light.radius;
+        data[4] = light.color[0];
+        data[5] = light.color[1];
+        data[6] = light.color[2];
+        data[7] = 0;
+    }
+
+    // Split the slices between threads, leaving a share for this one.
+    unsigned threads = (unsigned)m_lights.size() / CLUSTER_LIGHTS_PER_THREAD;
+    threads = min(max(threads, 1u), min(m_threads, (unsigned)CLUSTER_SLICES));
+    m_threadIndices.resize(threads);
+
+    if (threads > 1)
+    {
+        for (unsigned t = (unsigned)m_workers.size() + 1; t < threads; t++)
+            m_workers.push_back(thread(workLoop, this, t, m_frame));
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_shares = threads;
+            m_busy = threads - 1;
+            m_frame++;
+        }
+        m_start.notify_all();
+    }
+
+    assignSlices(0, CLUSTER_SLICES / threads, m_threadIndices[0]);
+
+    if (threads > 1)
+    {
+        unique_lock<mutex> lock(m_mutex);
+        while (m_busy)
+            m_finished.wait(lock);
+    }
+
+    // Each thread's offsets start at its own list, which follows the lists before it.
+    const int tiles = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+    m_entries = 0;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        int firstCluster = (int)(t * CLUSTER_SLICES / threads) * tiles;
+        int lastCluster = (int)((t + 1) * CLUSTER_SLICES / threads) * tiles;
+        for (int c = firstCluster; c < lastCluster; c++)
+            m_clusters[2 * c] += m_entries;
+
+        m_entries += (unsigned)m_threadIndices[t].size();
+    }
+
+    // Upload, orphaning last frame's buffers rather than waiting for them.
+    glState.bindBuffer(GL_TEXTURE_BUFFER, m_buffers[0]);
+    glBufferData(GL_TEXTURE_BUFFER, max<size_t>(m_lightData.size(), 4) * sizeof(float),
+        m_lightData.empty() ? NULL : &m_lightData[0], GL_STREAM_DRAW);
+
+    glState.bindBuffer(GL_TEXTURE_BUFFER, m_buffers[1]);
+    glBufferData(GL_TEXTURE_BUFFER, m_clusters.size() * sizeof(unsigned), &m_clusters[0], GL_STREAM_DRAW);
+
+    glState.bindBuffer(GL_TEXTURE_BUFFER, m_buffers[2]);
+    glBufferData(GL_TEXTURE_BUFFER, max(m_entries, 1u) * sizeof(unsigned), NULL, GL_STREAM_DRAW);
+    for (unsigned t = 0, offset = 0; t < threads; offset += (unsigned)m_threadIndices[t++].size())
+    {
+        if (!m_threadIndices[t].empty())
+        {
+            glBufferSubData(GL_TEXTURE_BUFFER, offset * sizeof(unsigned),
+                m_threadIndices[t].size() * sizeof(unsigned), &m_threadIndices[t][0]);
+        }
+    }
+    glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    m_assignTotal += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    m_assignCount++;
+}
+
+void ClusteredLighting::workLoop(ClusteredLighting *lighting, unsigned worker, unsigned frame)
+{
+    unique_lock<mutex> lock(lighting->m_mutex);
+
+    for (;;)
+    {
+        while (lighting->m_frame == frame && !lighting->m_stopping)
+            lighting->m_start.wait(lock);
+
+        if (lighting->m_stopping)
+            return;
+
+        frame = lighting->m_frame;
+        unsigned shares = lighting->m_shares;
+        if (worker >= shares)
+            continue;
+
+        // The light data and index lists are left alone by the caller until all
+        // the shares are done.
+        lock.unlock();
+        lighting->assignSlices((int)(worker * CLUSTER_SLICES / shares), (int)((worker + 1) * CLUSTER_SLICES / shares),
+            lighting->m_threadIndices[worker]);
+        lock.lock();
+
+        if (--lighting->m_busy == 0)
+            lighting->m_finished.notify_one();
+    }
+}
+
+void ClusteredLighting::begin()
+{
+    m_program.use();
+    glUniform1f(m_program.uniform("zNear"), m_near);
+    glUniform1f(m_program.uniform("sliceScale"), CLUSTER_SLICES / log(m_far / m_near));
+
+    for (int i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void ClusteredLighting::end()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glState.useProgram(0);
+}
+
+bool ClusteredLighting::valid() const
+{
+    return m_program.valid();
+}
+
+unsigned ClusteredLighting::lightCount() const
+{
+    return (unsigned)m_lights.size();
+}
+
+unsigned ClusteredLighting::entryCount() const
+{
+    return m_entries;
+}
+
+double ClusteredLighting::assignMilliseconds() const
+{
+    return m_assignCount ? m_assignTotal / m_assignCount : 0;
+}
+
+void ClusteredLighting::resetStatistics()
+{
+    m_assignTotal = 0;
+    m_assignCount = 0;
+}
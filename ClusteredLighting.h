@@ -0,0 +1,141 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "vecmath.h"
+#include "Shader.h"
+
+// The number of clusters across, up, and into the view frustum. Slices get deeper
+// with distance so each cluster covers a similar share of the screen.
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 16
+#define CLUSTER_SLICES 24
+
+// The first of the three texture units the cluster data is bound to.
+#define CLUSTER_TEXTURE_UNIT 1
+
+// The fewest lights worth giving a thread of its own when assigning them.
+#define CLUSTER_LIGHTS_PER_THREAD 32
+
+// A point light whose influence falls smoothly to zero at its radius.
+struct PointLight
+{
+    Vector3f position;
+    float radius;
+    Vector3f color;
+};
+
+// Per-pixel Blinn-Phong lighting from the main light plus any number of point lights.
+// Every frame, the lights are binned on the CPU into a grid of clusters dividing the
+// view frustum, and each pixel loops over only the lights of its own cluster. The
+// main light and material come from the lighting block of LightingShader, which must
+// be bound before drawing. Binning is split across threads by depth slice, so no two
+// threads write the same cluster; the threads are started with the first frame that
+// has lights enough for them and wait for the next frame in between.
+class ClusteredLighting
+{
+public:
+
+    ClusteredLighting();
+
+    // Stops the binning threads.
+    ~ClusteredLighting();
+
+    // Compiles the program and creates the cluster buffers. Returns false if the
+    // context has no texture buffers or is too old for the shaders.
+    bool create();
+
+    // Frees the GL objects, which must happen while the context they were made in
+    // is current.
+    void destroy();
+
+    // Replaces the lights. Positions are in the same space as the light of the scene.
+    void setLights(const std::vector<PointLight> &lights);
+
+    // Sets the most threads binning may use.
+    void setThreadCount(unsigned threads);
+    unsigned threadCount() const;
+
+    // Bins the lights into clusters for a symmetric perspective projection and
+    // uploads them. modelView takes light positions into eye coordinates.
+    void assign(const Matrix4f &modelView, float fieldOfView, float aspect, float zNear, float zFar);
+
+    // Makes the program current and binds the cluster data.
+    void begin();
+
+    // Unbinds the cluster data and restores the fixed-function pipeline.
+    void end();
+
+    bool valid() const;
+    unsigned lightCount() const;
+
+    // Light indices stored over all clusters by the last assignment.
+    unsigned entryCount() const;
+
+    // The average time spent assigning lights since the statistics were reset.
+    double assignMilliseconds() const;
+    void resetStatistics();
+
+private:
+
+    // A light's eye-space position and the clusters it may reach.
+    struct LightBounds
+    {
+        unsigned light;
+        int x0, x1, y0, y1, z0, z1;
+    };
+
+    // Bins the lights reaching slices [firstSlice, lastSlice) into the clusters of
+    // those slices, appending to a thread's own index list.
+    void assignSlices(int firstSlice, int lastSlice, std::vector<unsigned> &indices);
+
+    // Finds the clusters a light may reach. Returns false if it is outside the frustum.
+    bool bound(unsigned light, LightBounds &bounds) const;
+
+    // Bins the worker's share of the slices each time a frame is started after the
+    // one it was created in, while the frame is split into enough shares to have one.
+    static void workLoop(ClusteredLighting *lighting, unsigned worker, unsigned frame);
+
+    ShaderProgram m_program;
+
+    std::vector<PointLight> m_lights;
+    unsigned m_threads;
+
+    // This frame's eye-space light data (position and radius, then color) and
+    // projection, shared read-only with the binning threads.
+    std::vector<float> m_lightData;
+    float m_scaleX;
+    float m_scaleY;
+    float m_near;
+    float m_far;
+
+    // Offset into the index list and light count of every cluster, and one index
+    // list per thread, uploaded one after another.
+    std::vector<unsigned> m_clusters;
+    std::vector<std::vector<unsigned> > m_threadIndices;
+    unsigned m_entries;
+
+    // The binning threads, each binning the share its index gives it, and the frame
+    // they were last started for, how many shares it is split into, and how many
+    // threads are still binning it. Guarded by m_mutex.
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_finished;
+    unsigned m_frame;
+    unsigned m_shares;
+    unsigned m_busy;
+    bool m_stopping;
+
+    // Texture buffers of the light data, clusters, and index list.
+    GLuint m_buffers[3];
+    GLuint m_textures[3];
+
+    double m_assignTotal;
+    unsigned m_assignCount;
+};
+
+#endif // CLUSTERED_LIGHTING_H
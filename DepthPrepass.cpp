@@ -0,0 +1,286 @@
+#include "DepthPrepass.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // How much of each new measurement is blended into the smoothed one.
+    const double SMOOTHING = 0.2;
+
+    const char *MODE_NAMES[DEPTH_PREPASS_MODES] = { "Off", "On", "Auto" };
+    const char *MODE_ARGUMENTS[DEPTH_PREPASS_MODES] = { "off", "on", "auto" };
+
+    // Transforms positions exactly as the lighting shaders do, which the invariant
+    // qualifier on both sides guarantees, so the depths compare equal.
+    const char *depthVertexShader =
+        "#version 330 compatibility\n"
+        "invariant gl_Position;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+        "    gl_Position = gl_ProjectionMatrix * eye;\n"
+        "}\n";
+
+    const char *depthFragmentShader =
+        "#version 330 compatibility\n"
+        "void main()\n"
+        "{\n"
+        "}\n";
+
+    // Blends a measurement into a smoothed one, or starts it.
+    void smooth(double &smoothed, double value)
+    {
+        if (smoothed > 0)
+            smoothed += SMOOTHING * (value - smoothed);
+        else
+            smoothed = value;
+    }
+
+    // A pass's GPU time, or its CPU time without timer queries, or -1 if the frame
+    // has no such pass.
+    double passMilliseconds(const FrameTiming &timing, const char *name)
+    {
+        for (size_t i = 0; i < timing.passes.size(); i++)
+        {
+            const PassTiming &pass = timing.passes[i];
+            if (strcmp(pass.name, name) == 0)
+                return pass.gpuMilliseconds >= 0 ? pass.gpuMilliseconds : pass.cpuMilliseconds;
+        }
+
+        return -1;
+    }
+}
+
+DepthPrepass::DepthPrepass() :
+    m_mode(DEPTH_PREPASS_AUTO),
+    m_active(false),
+    m_framesSinceProbe(0),
+    m_lastFrame(0),
+    m_query(0),
+    m_counting(false),
+    m_fragments(0),
+    m_visibleFragments(0),
+    m_shadingMilliseconds(0),
+    m_prepassShadingMilliseconds(0),
+    m_prepassMilliseconds(0)
+{
+    for (int i = 0; i < FRAME_TIMER_LATENCY; i++)
+    {
+        m_queries[i] = 0;
+        m_pending[i] = false;
+        m_prepassed[i] = false;
+    }
+}
+
+void DepthPrepass::destroy()
+{
+    if (m_queries[0])
+        glDeleteQueries(FRAME_TIMER_LATENCY, m_queries);
+
+    for (int i = 0; i < FRAME_TIMER_LATENCY; i++)
+        m_queries[i] = 0;
+}
+
+bool DepthPrepass::create()
+{
+    if (!glVersionAtLeast(3, 3) || !m_program.create(depthVertexShader, depthFragmentShader, NULL))
+        return false;
+
+    glGenQueries(FRAME_TIMER_LATENCY, m_queries);
+    return true;
+}
+
+bool DepthPrepass::valid() const
+{
+    return m_program.valid();
+}
+
+void DepthPrepass::setMode(DepthPrepassMode mode)
+{
+    m_mode = mode;
+    m_framesSinceProbe = 0;
+}
+
+DepthPrepassMode DepthPrepass::mode() const
+{
+    return m_mode;
+}
+
+const char *DepthPrepass::name(DepthPrepassMode mode)
+{
+    return MODE_NAMES[mode];
+}
+
+bool DepthPrepass::parse(const string &text, DepthPrepassMode &mode)
+{
+    for (int i = 0; i < DEPTH_PREPASS_MODES; i++)
+    {
+        if (text == MODE_ARGUMENTS[i])
+        {
+            mode = (DepthPrepassMode)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DepthPrepass::update(const FrameTiming &timing)
+{
+    // Only look at each completed frame once.
+    if (timing.passes.empty() || timing.frame == m_lastFrame)
+        return;
+    m_lastFrame = timing.frame;
+
+    // A frame that drew the pre-pass has a pass for it.
+    double shading = passMilliseconds(timing, "mesh");
+    double prepass = passMilliseconds(timing, "prepass");
+    if (shading < 0)
+        return;
+
+    if (prepass >= 0)
+    {
+        smooth(m_prepassMilliseconds, prepass);
+        smooth(m_prepassShadingMilliseconds, shading);
+    }
+    else
+        smooth(m_shadingMilliseconds, shading);
+}
+
+bool DepthPrepass::choose()
+{
+    if (!valid())
+        m_active = false;
+    else if (m_mode != DEPTH_PREPASS_AUTO)
+        m_active = m_mode == DEPTH_PREPASS_ON;
+    else
+    {
+        // Measure each way once, then draw the pre-pass while the overdraw it saves
+        // costs more than it does.
+        bool worthwhile;
+        if (m_fragments <= 0 || m_shadingMilliseconds <= 0)
+            worthwhile = false;
+        else if (m_visibleFragments <= 0 || m_prepassMilliseconds <= 0)
+            worthwhile = true;
+        else
+        {
+            double overdrawn = max(0.0, 1 - m_visibleFragments / m_fragments);
+            worthwhile = m_shadingMilliseconds * overdrawn > m_prepassMilliseconds;
+        }
+
+        // Now and then, try the other way for a frame.
+        m_active = worthwhile;
+        if (++m_framesSinceProbe >= DEPTH_PREPASS_PROBE_INTERVAL)
+        {
+            m_active = !worthwhile;
+            m_framesSinceProbe = 0;
+        }
+    }
+
+    return m_active;
+}
+
+bool DepthPrepass::active() const
+{
+    return m_active;
+}
+
+void DepthPrepass::beginDepth()
+{
+    glState.colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    m_program.use();
+}
+
+void DepthPrepass::endDepth()
+{
+    glState.useProgram(0);
+    glState.colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void DepthPrepass::beginShading()
+{
+    // The depth is already there; keep it and shade only what matches it.
+    if (m_active)
+    {
+        glState.depthFunc(GL_EQUAL);
+        glState.depthMask(GL_FALSE);
+    }
+
+    if (!valid())
+        return;
+
+    // Collect this slot's count from a few frames ago, unless it is still not in, in
+    // which case skip counting this frame rather than wait.
+    m_counting = true;
+    if (m_pending[m_query])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(m_queries[m_query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            m_counting = false;
+            return;
+        }
+
+        GLuint fragments = 0;
+        glGetQueryObjectuiv(m_queries[m_query], GL_QUERY_RESULT, &fragments);
+        count(fragments, m_prepassed[m_query]);
+    }
+
+    glBeginQuery(GL_SAMPLES_PASSED, m_queries[m_query]);
+    m_pending[m_query] = true;
+    m_prepassed[m_query] = m_active;
+}
+
+void DepthPrepass::endShading()
+{
+    if (m_counting)
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+        m_query = (m_query + 1) % FRAME_TIMER_LATENCY;
+        m_counting = false;
+    }
+
+    if (m_active)
+    {
+        glState.depthMask(GL_TRUE);
+        glState.depthFunc(GL_LESS);
+    }
+}
+
+void DepthPrepass::count(GLuint fragments, bool prepassed)
+{
+    if (!fragments)
+        return;
+
+    if (prepassed)
+        smooth(m_visibleFragments, fragments);
+    else
+        smooth(m_fragments, fragments);
+}
+
+double DepthPrepass::overdraw() const
+{
+    if (m_fragments <= 0 || m_visibleFragments <= 0)
+        return 0;
+
+    return m_fragments / m_visibleFragments;
+}
+
+double DepthPrepass::shadingMilliseconds() const
+{
+    return m_shadingMilliseconds;
+}
+
+double DepthPrepass::prepassShadingMilliseconds() const
+{
+    return m_prepassShadingMilliseconds;
+}
+
+double DepthPrepass::prepassMilliseconds() const
+{
+    return m_prepassMilliseconds;
+}
@@ -0,0 +1,112 @@
+#ifndef DEPTH_PREPASS_H
+#define DEPTH_PREPASS_H
+
+#include <string>
+#include "Shader.h"
+#include "FrameTimer.h"
+
+// Frames between tries of the choice automatic mode is not making, to keep its
+// measurements current.
+#define DEPTH_PREPASS_PROBE_INTERVAL 120
+
+// Whether the mesh's depth is laid down before it is shaded.
+enum DepthPrepassMode
+{
+    // Shaded in one pass, every fragment that is nearest so far.
+    DEPTH_PREPASS_OFF,
+
+    // Depth drawn first, then only the visible fragments shaded.
+    DEPTH_PREPASS_ON,
+
+    // Whichever the measured costs favor.
+    DEPTH_PREPASS_AUTO,
+
+    DEPTH_PREPASS_MODES
+};
+
+// Draws the depth of the mesh in a pass of its own, with color writes off and a
+// vertex shader that only transforms positions, so the shading pass that follows
+// with GL_EQUAL depth testing shades each pixel once. Without it, a dense mesh
+// shades every fragment that is nearest when drawn, and those later covered are
+// overdraw. Automatic mode counts the fragments each way with occlusion queries and
+// reads the passes' times from the frame timer: the pre-pass is worth drawing while
+// the shading spent on overdraw, the shading time times the share of fragments
+// overdrawn, costs more than the pre-pass.
+class DepthPrepass
+{
+public:
+
+    DepthPrepass();
+
+    // Compiles the depth-only program and creates the queries. Returns false if the
+    // context has no OpenGL 3.3, in which case the mesh is shaded in one pass.
+    bool create();
+
+    // Frees the GL objects, which must happen while the context they were made in
+    // is current.
+    void destroy();
+
+    bool valid() const;
+
+    void setMode(DepthPrepassMode mode);
+    DepthPrepassMode mode() const;
+
+    static const char *name(DepthPrepassMode mode);
+
+    // Reads a mode as given on the command line: off, on, or auto. Returns false if
+    // there is no such mode.
+    static bool parse(const std::string &text, DepthPrepassMode &mode);
+
+    // Feeds automatic mode the latest completed frame's pass times.
+    void update(const FrameTiming &timing);
+
+    // Decides whether this frame draws the pre-pass.
+    bool choose();
+    bool active() const;
+
+    // Directs drawing to depth alone. Whatever is drawn in between must be
+    // transformed exactly as the shading pass transforms it.
+    void beginDepth();
+    void endDepth();
+
+    // Surrounds the shading pass, testing for equal depth after a pre-pass and
+    // counting the fragments shaded.
+    void beginShading();
+    void endShading();
+
+    // Fragments shaded per visible pixel without the pre-pass, or 0 until measured.
+    double overdraw() const;
+
+    // The smoothed shading time without and with the pre-pass, and the pre-pass's own.
+    double shadingMilliseconds() const;
+    double prepassShadingMilliseconds() const;
+    double prepassMilliseconds() const;
+
+private:
+
+    // Takes a finished fragment count.
+    void count(GLuint fragments, bool prepassed);
+
+    ShaderProgram m_program;
+    DepthPrepassMode m_mode;
+    bool m_active;
+    unsigned m_framesSinceProbe;
+    unsigned m_lastFrame;
+
+    // A ring of fragment count queries, read once their results are in.
+    GLuint m_queries[FRAME_TIMER_LATENCY];
+    bool m_pending[FRAME_TIMER_LATENCY];
+    bool m_prepassed[FRAME_TIMER_LATENCY];
+    unsigned m_query;
+    bool m_counting;
+
+    // Smoothed measurements, 0 until taken: fragments shaded without and with the
+    // pre-pass, and the times above.
+    double m_fragments;
+    double m_visibleFragments;
+    double m_shadingMilliseconds;
+    double m_prepassShadingMilliseconds;
+    double m_prepassMilliseconds;
+};
+
+#endif // DEPTH_PREPASS_H
@@ -0,0 +1,177 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // The fraction of each new frame time mixed into the smoothed one.
+    const double SMOOTHING = 0.3;
+
+    // The fractions of the way to the ideal scale moved in one step down and up.
+    const float STEP_DOWN = 0.5f;
+    const float STEP_UP = 0.2f;
+
+    // Scale corrections smaller than this are ignored, so the scale settles.
+    const float DEADBAND = 0.02f;
+
+    float clampScale(float scale)
+    {
+        return min(max(scale, DYNAMIC_RESOLUTION_MIN_SCALE), DYNAMIC_RESOLUTION_MAX_SCALE);
+    }
+}
+
+DynamicResolution::DynamicResolution() :
+    m_valid(false),
+    m_enabled(false),
+    m_fixedScale(0),
+    m_budget(DYNAMIC_RESOLUTION_BUDGET),
+    m_scale(DYNAMIC_RESOLUTION_MAX_SCALE),
+    m_frameMilliseconds(0),
+    m_lastFrame(0),
+    m_settleFrames(0),
+    m_window(0),
+    m_windowWidth(0),
+    m_windowHeight(0),
+    m_width(0),
+    m_height(0),
+    m_scaled(false)
+{
+}
+
+bool DynamicResolution::create()
+{
+    // The target is sized when the first scaled frame begins.
+    m_valid = glBlitFramebuffer && (glVersionAtLeast(3, 0) || glHasExtension("GL_ARB_framebuffer_object"));
+    return m_valid;
+}
+
+bool DynamicResolution::valid() const
+{
+    return m_valid;
+}
+
+void DynamicResolution::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    m_frameMilliseconds = 0;
+    m_settleFrames = FRAME_TIMER_LATENCY;
+}
+
+bool DynamicResolution::enabled() const
+{
+    return m_enabled;
+}
+
+void DynamicResolution::setFixedScale(float scale)
+{
+    m_fixedScale = scale > 0 ? clampScale(scale) : 0;
+}
+
+void DynamicResolution::setBudget(double milliseconds)
+{
+    m_budget = milliseconds;
+}
+
+double DynamicResolution::budget() const
+{
+    return m_budget;
+}
+
+void DynamicResolution::update(const FrameTiming &timing)
+{
+    // Only look at each completed frame once.
+    if (!m_enabled || timing.passes.empty() || timing.frame == m_lastFrame)
+        return;
+    m_lastFrame = timing.frame;
+
+    // Frames drawn before the last change are still arriving.
+    if (m_settleFrames > 0)
+    {
+        m_settleFrames--;
+        return;
+    }
+
+    double milliseconds = timing.gpuMilliseconds >= 0 ? timing.gpuMilliseconds : timing.cpuMilliseconds;
+    if (m_frameMilliseconds > 0)
+        m_frameMilliseconds += SMOOTHING * (milliseconds - m_frameMilliseconds);
+    else
+        m_frameMilliseconds = milliseconds;
+
+    // Cost goes with area, so this scale would just meet the budget.
+    float ideal = clampScale(m_scale * (float)sqrt(m_budget / max(m_frameMilliseconds, 0.01)));
+    float step = ideal - m_scale;
+    if (fabs(step) < DEADBAND)
+        return;
+
+    m_scale = clampScale(m_scale + step * (step < 0 ? STEP_DOWN : STEP_UP));
+    m_frameMilliseconds = 0;
+    m_settleFrames = FRAME_TIMER_LATENCY;
+}
+
+void DynamicResolution::begin(int windowWidth, int windowHeight, bool fullResolution)
+{
+    m_windowWidth = windowWidth;
+    m_windowHeight = windowHeight;
+
+    float scale = DYNAMIC_RESOLUTION_MAX_SCALE;
+    if (!fullResolution && m_fixedScale > 0)
+        scale = m_fixedScale;
+    else if (!fullResolution && m_enabled)
+        scale = m_scale;
+
+    m_width = max(1, (int)(windowWidth * scale + 0.5f));
+    m_height = max(1, (int)(windowHeight * scale + 0.5f));
+    m_scaled = (m_width < windowWidth || m_height < windowHeight) && m_valid;
+    if (m_scaled)
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_window);
+
+    // Size the target to the whole window, so changing the scale never reallocates.
+    if (m_scaled && (m_target.width() != windowWidth || m_target.height() != windowHeight))
+    {
+        m_target.destroy();
+        m_scaled = m_target.create(windowWidth, windowHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_window);
+    }
+
+    if (!m_scaled)
+    {
+        m_width = windowWidth;
+        m_height = windowHeight;
+        glViewport(0, 0, windowWidth, windowHeight);
+        return;
+    }
+
+    m_target.bind();
+    glViewport(0, 0, m_width, m_height);
+}
+
+void DynamicResolution::end()
+{
+    if (m_scaled)
+        m_target.blit(m_width, m_height, (GLuint)m_window, m_windowWidth, m_windowHeight);
+
+    m_scaled = false;
+    glViewport(0, 0, m_windowWidth, m_windowHeight);
+}
+
+float DynamicResolution::scale() const
+{
+    return m_scale;
+}
+
+int DynamicResolution::width() const
+{
+    return m_width;
+}
+
+int DynamicResolution::height() const
+{
+    return m_height;
+}
+
+double DynamicResolution::frameMilliseconds() const
+{
+    return m_frameMilliseconds;
+}
@@ -0,0 +1,84 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include "FrameTimer.h"
+#include "Framebuffer.h"
+
+// The smallest and largest fraction of the window's width and height drawn.
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#define DYNAMIC_RESOLUTION_MAX_SCALE 1.0f
+
+// Milliseconds a frame may take, leaving headroom under 60 frames per second.
+#define DYNAMIC_RESOLUTION_BUDGET 14.0
+
+// Draws frames at a fraction of the window's resolution and stretches them over it,
+// choosing the fraction each frame to keep the measured frame time within a budget.
+// Drawing cost grows with the number of pixels, so the scale that meets the budget
+// is the current one times the square root of budget over time. The controller moves
+// part of the way there each frame, faster down than up, and ignores the frames
+// still in flight after every change so it never reacts to its own last step twice.
+class DynamicResolution
+{
+public:
+
+    DynamicResolution();
+
+    // Creates the scaled render target. Returns false if the context has no
+    // framebuffer objects, in which case every frame is drawn at full resolution.
+    bool create();
+
+    bool valid() const;
+
+    // Turns the controller on or off. Off, frames are drawn at the fixed scale if one
+    // is set and at full resolution otherwise.
+    void setEnabled(bool enabled);
+    bool enabled() const;
+
+    // Pins the scale, or lets the controller choose it again when 0.
+    void setFixedScale(float scale);
+
+    void setBudget(double milliseconds);
+    double budget() const;
+
+    // Feeds the controller the latest completed frame, GPU time when there is one.
+    void update(const FrameTiming &timing);
+
+    // Directs drawing at the current scale of a window of the given size, or at full
+    // resolution straight to it. Frames are stretched over whatever framebuffer is
+    // bound here, so this also works offscreen.
+    void begin(int windowWidth, int windowHeight, bool fullResolution);
+
+    // Stretches a scaled frame over the window and restores the window's viewport.
+    void end();
+
+    // The scale the controller has chosen, and the size of the last frame drawn.
+    float scale() const;
+    int width() const;
+    int height() const;
+
+    // The smoothed frame time the controller is steering by.
+    double frameMilliseconds() const;
+
+private:
+
+    Framebuffer m_target;
+    bool m_valid;
+    bool m_enabled;
+    float m_fixedScale;
+    double m_budget;
+
+    float m_scale;
+    double m_frameMilliseconds;
+    unsigned m_lastFrame;
+    int m_settleFrames;
+
+    // The window and the part of the target being drawn this frame.
+    GLint m_window;
+    int m_windowWidth;
+    int m_windowHeight;
+    int m_width;
+    int m_height;
+    bool m_scaled;
+};
+
+#endif // DYNAMIC_RESOLUTION_H
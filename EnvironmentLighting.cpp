@@ -0,0 +1,436 @@
+#include "EnvironmentLighting.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ENVIRONMENT_SSE2
+#endif
+
+using namespace std;
+
+namespace
+{
+    const float PI = 3.14159265358979f;
+
+    // Normalizing constants of the real spherical harmonics: band 0, band 1, and
+    // band 2's xy/yz/xz, 3z^2 - 1 and x^2 - y^2 terms.
+    const float SH_BAND0 = 0.282095f;
+    const float SH_BAND1 = 0.488603f;
+    const float SH_BAND2 = 1.092548f;
+    const float SH_BAND2_Z = 0.315392f;
+    const float SH_BAND2_XY = 0.546274f;
+
+    // Convolving radiance with the clamped cosine lobe scales each band by this,
+    // already divided by pi.
+    const float IRRADIANCE_BAND[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+
+    // The fewest rows worth giving a thread of their own when projecting.
+    const int ROWS_PER_THREAD = 16;
+
+    // The spherical harmonics of a unit direction.
+    void evaluateBasis(float x, float y, float z, float basis[SH_COEFFICIENTS])
+    {
+        basis[0] = SH_BAND0;
+        basis[1] = SH_BAND1 * y;
+        basis[2] = SH_BAND1 * z;
+        basis[3] = SH_BAND1 * x;
+        basis[4] = SH_BAND2 * x * y;
+        basis[5] = SH_BAND2 * y * z;
+        basis[6] = SH_BAND2_Z * (3 * z * z - 1);
+        basis[7] = SH_BAND2 * x * z;
+        basis[8] = SH_BAND2_XY * (x * x - y * y);
+    }
+
+#ifdef ENVIRONMENT_SSE2
+    // Four pixels of a row per step, summing into four lanes of every color of every
+    // coefficient. Returns the first column left for the scalar loop.
+    int projectRowSse2(const float *red, const float *green, const float *blue, const float *cosPhi,
+        const float *sinPhi, float sinTheta, float cosTheta, int width, float *sums)
+    {
+        __m128 acc[SH_COEFFICIENTS * 3];
+        for (int i = 0; i < SH_COEFFICIENTS * 3; i++)
+            acc[i] = _mm_setzero_ps();
+
+        const __m128 st = _mm_set1_ps(sinTheta), negativeSt = _mm_set1_ps(-sinTheta);
+        const __m128 y = _mm_set1_ps(cosTheta);
+        const __m128 band1 = _mm_set1_ps(SH_BAND1), band2 = _mm_set1_ps(SH_BAND2);
+        const __m128 band2z = _mm_set1_ps(SH_BAND2_Z), band2xy = _mm_set1_ps(SH_BAND2_XY);
+        const __m128 three = _mm_set1_ps(3), one = _mm_set1_ps(1);
+
+        // Band 1 and the parts of band 2 without x or z depend only on the row.
+        const __m128 by = _mm_mul_ps(band1, y);
+        const __m128 yy = _mm_mul_ps(y, y);
+
+        int x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128 dx = _mm_mul_ps(negativeSt, _mm_loadu_ps(sinPhi + x));
+            __m128 dz = _mm_mul_ps(st, _mm_loadu_ps(cosPhi + x));
+
+            __m128 basis[SH_COEFFICIENTS];
+            basis[0] = _mm_set1_ps(SH_BAND0);
+            basis[1] = by;
+            basis[2] = _mm_mul_ps(band1, dz);
+            basis[3] = _mm_mul_ps(band1, dx);
+            basis[4] = _mm_mul_ps(band2, _mm_mul_ps(dx, y));
+            basis[5] = _mm_mul_ps(band2, _mm_mul_ps(y, dz));
+            basis[6] = _mm_mul_ps(band2z, _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(dz, dz)), one));
+            basis[7] = _mm_mul_ps(band2, _mm_mul_ps(dx, dz));
+            basis[8] = _mm_mul_ps(band2xy, _mm_sub_ps(_mm_mul_ps(dx, dx), yy));
+
+            __m128 r = _mm_loadu_ps(red + x), g = _mm_loadu_ps(green + x), b = _mm_loadu_ps(blue + x);
+            for (int i = 0; i < SH_COEFFICIENTS; i++)
+            {
+                acc[i * 3] = _mm_add_ps(acc[i * 3], _mm_mul_ps(basis[i], r));
+                acc[i * 3 + 1] = _mm_add_ps(acc[i * 3 + 1], _mm_mul_ps(basis[i], g));
+                acc[i * 3 + 2] = _mm_add_ps(acc[i * 3 + 2], _mm_mul_ps(basis[i], b));
+            }
+        }
+
+        for (int i = 0; i < SH_COEFFICIENTS * 3; i++)
+        {
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc[i]);
+            sums[i] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+
+        return x;
+    }
+#endif
+
+    // Band 2 of a spherical harmonic function is the quadratic form n^T M n of a
+    // symmetric, traceless matrix on the unit sphere, and turns as M does.
+    Matrix3f band2Matrix(const float c[5])
+    {
+        float xy = SH_BAND2 * c[0] / 2, yz = SH_BAND2 * c[1] / 2, xz = SH_BAND2 * c[3] / 2;
+        float zz = SH_BAND2_Z * c[2], xxMinusYy = SH_BAND2_XY * c[4];
+
+        return Matrix3f(-zz + xxMinusYy, xy, xz,
+            xy, -zz - xxMinusYy, yz,
+            xz, yz, 2 * zz);
+    }
+
+    void band2Coefficients(const Matrix3f &m, float c[5])
+    {
+        c[0] = 2 * m(0, 1) / SH_BAND2;
+        c[1] = 2 * m(1, 2) / SH_BAND2;
+        c[2] = m(2, 2) / (2 * SH_BAND2_Z);
+        c[3] = 2 * m(0, 2) / SH_BAND2;
+        c[4] = (m(0, 0) - m(1, 1)) / (2 * SH_BAND2_XY);
+    }
+
+    // Turns a spherical harmonic function f into f(R^T n), exactly and without
+    // sampling it: band 0 is constant, band 1 a dot product with a vector.
+    void rotateCoefficients(const Vector3f in[SH_COEFFICIENTS], const Matrix3f &rotation, Vector3f out[SH_COEFFICIENTS])
+    {
+        Matrix3f transposed = rotation.transposed();
+
+        out[0] = in[0];
+        for (int k = 0; k < 3; k++)
+        {
+            Vector3f band1 = rotation * Vector3f(in[3][k], in[1][k], in[2][k]);
+            out[1][k] = band1.y();
+            out[2][k] = band1.z();
+            out[3][k] = band1.x();
+
+            float band2[5];
+            for (int i = 0; i < 5; i++)
+                band2[i] = in[4 + i][k];
+            band2Coefficients(rotation * band2Matrix(band2) * transposed, band2);
+            for (int i = 0; i < 5; i++)
+                out[4 + i][k] = band2[i];
+        }
+    }
+
+    // Radiance HDR: a text header, then rows of RGBE pixels, usually run-length
+    // encoded one component at a time.
+    bool readHdr(ifstream &in, int &width, int &height, vector<float> planes[3])
+    {
+        string line;
+        if (!getline(in, line) || line.compare(0, 2, "#?") != 0)
+            return false;
+
+        while (getline(in, line) && !line.empty())
+        {
+            if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe")
+                return false;
+        }
+
+        // Only the usual orientation, top row first.
+        if (!getline(in, line) || sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2
+            || width <= 0 || height <= 0)
+            return false;
+
+        for (int c = 0; c < 3; c++)
+            planes[c].resize((size_t)width * height);
+
+        vector<unsigned char> rgbe((size_t)width * 4);
+        for (int y = 0; y < height; y++)
+        {
+            unsigned char head[4];
+            if (!in.read((char *)head, 4))
+                return false;
+
+            if (width >= 8 && width < 0x8000 && head[0] == 2 && head[1] == 2 && ((head[2] << 8) | head[3]) == width)
+            {
+                // Each component in turn, as runs of one value or spans of literal values.
+                for (int c = 0; c < 4; c++)
+                {
+                    for (int x = 0; x < width;)
+                    {
+                        int count = in.get();
+                        if (count > 128)
+                        {
+                            count -= 128;
+                            int value = in.get();
+                            if (!in || x + count > width)
+                                return false;
+                            for (; count > 0; count--)
+                                rgbe[(x++) * 4 + c] = (unsigned char)value;
+                        }
+                        else
+                        {
+                            if (!in || count == 0 || x + count > width)
+                                return false;
+                            for (; count > 0; count--)
+                                rgbe[(x++) * 4 + c] = (unsigned char)in.get();
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // Flat pixels.
+                copy(head, head + 4, rgbe.begin());
+                in.read((char *)&rgbe[4], (streamsize)(width - 1) * 4);
+            }
+
+            if (!in)
+                return false;
+
+            for (int x = 0; x < width; x++)
+            {
+                int exponent = rgbe[x * 4 + 3];
+                float scale = exponent ? ldexp(1.0f, exponent - (128 + 8)) : 0;
+                for (int c = 0; c < 3; c++)
+                    planes[c][(size_t)y * width + x] = rgbe[x * 4 + c] * scale;
+            }
+        }
+
+        return true;
+    }
+
+    // Portable float map: a text header, then rows of floats bottom row first, in the
+    // byte order the scale's sign gives.
+    bool readPfm(ifstream &in, int &width, int &height, vector<float> planes[3])
+    {
+        string magic;
+        float scale;
+        if (!(in >> magic >> width >> height >> scale) || (magic != "PF" && magic != "Pf") || width <= 0 || height <= 0)
+            return false;
+        in.get();
+
+        int channels = magic == "PF" ? 3 : 1;
+        const unsigned one = 1;
+        bool reversed = (*(const unsigned char *)&one == 1) != (scale < 0);
+
+        for (int c = 0; c < 3; c++)
+            planes[c].resize((size_t)width * height);
+
+        vector<float> row((size_t)width * channels);
+        for (int y = height - 1; y >= 0; y--)
+        {
+            if (!in.read((char *)&row[0], (streamsize)(row.size() * sizeof(float))))
+                return false;
+
+            if (reversed)
+            {
+                for (size_t i = 0; i < row.size(); i++)
+                {
+                    unsigned char *bytes = (unsigned char *)&row[i];
+                    std::swap(bytes[0], bytes[3]);
+                    std::swap(bytes[1], bytes[2]);
+                }
+            }
+
+            for (int x = 0; x < width; x++)
+            {
+                for (int c = 0; c < 3; c++)
+                    planes[c][(size_t)y * width + x] = max(row[(size_t)x * channels + (channels == 3 ? c : 0)], 0.0f);
+            }
+        }
+
+        return true;
+    }
+}
+
+EnvironmentLighting::EnvironmentLighting() :
+    m_width(0),
+    m_height(0),
+    m_rotation(Matrix3f::identity()),
+    m_intensity(1),
+    m_projectMilliseconds(0),
+    m_projectThreads(0)
+{
+}
+
+bool EnvironmentLighting::load(const string &path)
+{
+    ifstream in(path.c_str(), ios::binary);
+    if (!in)
+        return false;
+
+    string extension = path.substr(path.find_last_of('.') + 1);
+    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    bool read = extension == "pfm" ? readPfm(in, m_width, m_height, m_planes)
+        : readHdr(in, m_width, m_height, m_planes);
+    if (!read)
+    {
+        m_width = m_height = 0;
+        for (int c = 0; c < 3; c++)
+            m_planes[c].clear();
+        return false;
+    }
+
+    project();
+
+    // Only the coefficients are needed from here on.
+    for (int c = 0; c < 3; c++)
+        vector<float>().swap(m_planes[c]);
+
+    return true;
+}
+
+void EnvironmentLighting::project()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Split the rows between threads, leaving a share for this one.
+    unsigned threads = (unsigned)(m_height / ROWS_PER_THREAD);
+    threads = min(max(threads, 1u), max(1u, thread::hardware_concurrency()));
+
+    vector<vector<double> > sums(threads, vector<double>(SH_COEFFICIENTS * 3, 0.0));
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads; t++)
+    {
+        workers.push_back(thread(&EnvironmentLighting::projectRows, this,
+            (int)(t * m_height / threads), (int)((t + 1) * m_height / threads), &sums[t][0]));
+    }
+    projectRows(0, (int)(m_height / threads), &sums[0][0]);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    for (int i = 0; i < SH_COEFFICIENTS; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            double sum = 0;
+            for (unsigned t = 0; t < threads; t++)
+                sum += sums[t][i * 3 + c];
+            m_radiance[i][c] = (float)sum;
+        }
+    }
+
+    m_projectThreads = threads;
+    m_projectMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void EnvironmentLighting::projectRows(int firstRow, int lastRow, double *sums) const
+{
+    // Every pixel's longitude, shared by all rows.
+    vector<float> cosPhi(m_width), sinPhi(m_width);
+    for (int x = 0; x < m_width; x++)
+    {
+        float phi = 2 * PI * (x + 0.5f) / m_width;
+        cosPhi[x] = cos(phi);
+        sinPhi[x] = sin(phi);
+    }
+
+    // A pixel's solid angle, before the shrinking toward the poles.
+    const float pixelArea = (2 * PI / m_width) * (PI / m_height);
+
+    for (int y = firstRow; y < lastRow; y++)
+    {
+        float theta = PI * (y + 0.5f) / m_height;
+        float sinTheta = sin(theta), cosTheta = cos(theta);
+
+        size_t row = (size_t)y * m_width;
+        const float *red = &m_planes[0][row], *green = &m_planes[1][row], *blue = &m_planes[2][row];
+
+        float rowSums[SH_COEFFICIENTS * 3] = {};
+        int x = 0;
+#ifdef ENVIRONMENT_SSE2
+        x = projectRowSse2(red, green, blue, &cosPhi[0], &sinPhi[0], sinTheta, cosTheta, m_width, rowSums);
+#endif
+        for (; x < m_width; x++)
+        {
+            float basis[SH_COEFFICIENTS];
+            evaluateBasis(-sinTheta * sinPhi[x], cosTheta, sinTheta * cosPhi[x], basis);
+            for (int i = 0; i < SH_COEFFICIENTS; i++)
+            {
+                rowSums[i * 3] += basis[i] * red[x];
+                rowSums[i * 3 + 1] += basis[i] * green[x];
+                rowSums[i * 3 + 2] += basis[i] * blue[x];
+            }
+        }
+
+        double weight = (double)pixelArea * sinTheta;
+        for (int i = 0; i < SH_COEFFICIENTS * 3; i++)
+            sums[i] += rowSums[i] * weight;
+    }
+}
+
+void EnvironmentLighting::rotate(const Matrix3f &rotation)
+{
+    m_rotation = rotation * m_rotation;
+}
+
+void EnvironmentLighting::setIntensity(float intensity)
+{
+    m_intensity = intensity;
+}
+
+void EnvironmentLighting::irradiance(const Matrix3f &rotation, Vector3f coefficients[SH_COEFFICIENTS]) const
+{
+    // Always turned from the projected radiance, so rotations never accumulate error.
+    rotateCoefficients(m_radiance, rotation * m_rotation, coefficients);
+
+    // Fold in the basis functions' constants too, leaving only the polynomials.
+    const float constants[SH_COEFFICIENTS] = { SH_BAND0, SH_BAND1, SH_BAND1, SH_BAND1,
+        SH_BAND2, SH_BAND2, SH_BAND2_Z, SH_BAND2, SH_BAND2_XY };
+    for (int i = 0; i < SH_COEFFICIENTS; i++)
+        coefficients[i] = coefficients[i] * (IRRADIANCE_BAND[i == 0 ? 0 : (i < 4 ? 1 : 2)] * constants[i] * m_intensity);
+}
+
+bool EnvironmentLighting::valid() const
+{
+    return m_width > 0;
+}
+
+int EnvironmentLighting::width() const
+{
+    return m_width;
+}
+
+int EnvironmentLighting::height() const
+{
+    return m_height;
+}
+
+double EnvironmentLighting::projectMilliseconds() const
+{
+    return m_projectMilliseconds;
+}
+
+unsigned EnvironmentLighting::projectThreads() const
+{
+    return m_projectThreads;
+}
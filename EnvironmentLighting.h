@@ -0,0 +1,70 @@
+#ifndef ENVIRONMENT_LIGHTING_H
+#define ENVIRONMENT_LIGHTING_H
+
+#include <string>
+#include <vector>
+#include "vecmath.h"
+
+// The number of L2 spherical harmonic coefficients: one in band 0, three in band 1,
+// five in band 2.
+#define SH_COEFFICIENTS 9
+
+// Ambient light from a whole HDR environment, reduced to the nine spherical harmonic
+// coefficients of the irradiance it casts. The environment is projected once on the
+// CPU when loaded, so lighting from it costs a few multiply-adds per pixel. Turning
+// it rotates the coefficients directly rather than projecting it again.
+class EnvironmentLighting
+{
+public:
+
+    EnvironmentLighting();
+
+    // Loads an equirectangular Radiance HDR (.hdr) or portable float map (.pfm) with
+    // +y up the middle of the image and -z at its center, and projects it. Returns
+    // false if the file cannot be read.
+    bool load(const std::string &path);
+
+    // Turns the environment by a rotation, on top of any before.
+    void rotate(const Matrix3f &rotation);
+
+    // Scales the light from the environment.
+    void setIntensity(float intensity);
+
+    // Fills the irradiance coefficients in the coordinates a rotation takes the
+    // environment's into, divided by pi so they give diffuse light directly. The basis
+    // constants are folded in, so the light reaching a surface facing (x, y, z) is
+    // c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz + c8 (x^2 - y^2).
+    void irradiance(const Matrix3f &rotation, Vector3f coefficients[SH_COEFFICIENTS]) const;
+
+    bool valid() const;
+    int width() const;
+    int height() const;
+
+    // The time spent projecting the environment and the threads it was split over.
+    double projectMilliseconds() const;
+    unsigned projectThreads() const;
+
+private:
+
+    // Projects the pixels into m_radiance.
+    void project();
+
+    // Sums the solid-angle-weighted basis functions times the radiance over rows
+    // [firstRow, lastRow), three colors per coefficient.
+    void projectRows(int firstRow, int lastRow, double *sums) const;
+
+    // Pixels split into red, green and blue planes, top row first.
+    int m_width;
+    int m_height;
+    std::vector<float> m_planes[3];
+
+    // The environment's radiance in spherical harmonics, and how it has been turned.
+    Vector3f m_radiance[SH_COEFFICIENTS];
+    Matrix3f m_rotation;
+    float m_intensity;
+
+    double m_projectMilliseconds;
+    unsigned m_projectThreads;
+};
+
+#endif // ENVIRONMENT_LIGHTING_H
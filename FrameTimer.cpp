@@ -0,0 +1,209 @@
+#include "FrameTimer.h"
+#include <cstring>
+
+using namespace std;
+
+FrameTimer::FrameTimer() :
+    m_current(NULL),
+    m_inPass(false),
+    m_frame(0),
+    m_gpuTimed(false),
+    m_csv(NULL)
+{
+    memset(m_slots, 0, sizeof(m_slots));
+    m_latest.frame = 0;
+    m_latest.cpuMilliseconds = 0;
+    m_latest.gpuMilliseconds = -1;
+}
+
+FrameTimer::~FrameTimer()
+{
+    if (m_csv)
+        fclose(m_csv);
+}
+
+bool FrameTimer::create()
+{
+    // Timestamp queries need OpenGL 3.3 or ARB_timer_query.
+    if (!glVersionAtLeast(3, 3) && !glHasExtension("GL_ARB_timer_query"))
+        return false;
+
+    for (int i = 0; i < FRAME_TIMER_LATENCY; i++)
+        glGenQueries(2 + 2 * FRAME_TIMER_MAX_PASSES, m_slots[i].queries);
+
+    m_gpuTimed = true;
+    return true;
+}
+
+bool FrameTimer::openCsv(const char *path)
+{
+    m_csv = fopen(path, "w");
+    if (!m_csv)
+        return false;
+
+    fprintf(m_csv, "frame,pass,cpu_ms,gpu_ms\n");
+    return true;
+}
+
+void FrameTimer::beginFrame()
+{
+    Slot &slot = m_slots[m_frame % FRAME_TIMER_LATENCY];
+
+    // This slot was last used FRAME_TIMER_LATENCY frames ago, so its queries are
+    // almost certainly done by now.
+    if (slot.pending)
+        collect(slot, false);
+
+    slot.pending = true;
+    slot.frame = m_frame++;
+    slot.passCount = 0;
+    m_current = &slot;
+    m_inPass = false;
+
+    m_frameStart = chrono::steady_clock::now();
+    if (m_gpuTimed)
+        glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+}
+
+void FrameTimer::endFrame()
+{
+    if (!m_current)
+        return;
+
+    if (m_inPass)
+        endPass();
+
+    if (m_gpuTimed)
+        glQueryCounter(m_current->queries[1], GL_TIMESTAMP);
+
+    m_current->cpuFrame = cpuElapsed();
+    m_current = NULL;
+}
+
+void FrameTimer::beginPass(const char *name)
+{
+    if (!m_current || m_current->passCount == FRAME_TIMER_MAX_PASSES)
+        return;
+
+    if (m_inPass)
+        endPass();
+
+    unsigned pass = m_current->passCount;
+    m_current->names[pass] = name;
+    m_current->cpuStart[pass] = cpuElapsed();
+    if (m_gpuTimed)
+        glQueryCounter(m_current->queries[2 + 2 * pass], GL_TIMESTAMP);
+
+    m_inPass = true;
+}
+
+void FrameTimer::endPass()
+{
+    if (!m_current || !m_inPass)
+        return;
+
+    unsigned pass = m_current->passCount++;
+    m_current->cpuEnd[pass] = cpuElapsed();
+    if (m_gpuTimed)
+        glQueryCounter(m_current->queries[3 + 2 * pass], GL_TIMESTAMP);
+
+    m_inPass = false;
+}
+
+void FrameTimer::flush()
+{
+    // Collect in the order the frames were drawn, leaving one still being drawn.
+    unsigned first = m_frame > FRAME_TIMER_LATENCY ? m_frame - FRAME_TIMER_LATENCY : 0;
+    for (unsigned frame = first; frame < m_frame; frame++)
+    {
+        Slot &slot = m_slots[frame % FRAME_TIMER_LATENCY];
+        if (slot.pending && &slot != m_current)
+            collect(slot, true);
+    }
+
+    if (m_csv)
+        fflush(m_csv);
+}
+
+void FrameTimer::destroy()
+{
+    flush();
+
+    if (m_gpuTimed)
+    {
+        for (int i = 0; i < FRAME_TIMER_LATENCY; i++)
+            glDeleteQueries(2 + 2 * FRAME_TIMER_MAX_PASSES, m_slots[i].queries);
+    }
+
+    m_gpuTimed = false;
+}
+
+const FrameTiming &FrameTimer::latest() const
+{
+    return m_latest;
+}
+
+bool FrameTimer::gpuTimed() const
+{
+    return m_gpuTimed;
+}
+
+double FrameTimer::cpuElapsed() const
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - m_frameStart).count();
+}
+
+void FrameTimer::collect(Slot &slot, bool wait)
+{
+    slot.pending = false;
+
+    // Queries finish in order, so the frame's last timestamp tells us about all of them.
+    // If even that is still outstanding, give up on this frame's GPU times rather than
+    // wait, unless asked to; reading the results then waits for them.
+    bool gpuReady = m_gpuTimed && wait;
+    if (m_gpuTimed && !wait)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        gpuReady = available != 0;
+    }
+
+    m_latest.frame = slot.frame;
+    m_latest.cpuMilliseconds = slot.cpuFrame;
+    m_latest.gpuMilliseconds = gpuReady ? gpuElapsed(slot.queries[0], slot.queries[1]) : -1;
+    m_latest.passes.resize(slot.passCount);
+
+    for (unsigned i = 0; i < slot.passCount; i++)
+    {
+        PassTiming &pass = m_latest.passes[i];
+        pass.name = slot.names[i];
+        pass.cpuMilliseconds = slot.cpuEnd[i] - slot.cpuStart[i];
+        pass.gpuMilliseconds = gpuReady ? gpuElapsed(slot.queries[2 + 2 * i], slot.queries[3 + 2 * i]) : -1;
+    }
+
+    if (!m_csv)
+        return;
+
+    // Leave GPU times we do not have empty.
+    for (unsigned i = 0; i <= slot.passCount; i++)
+    {
+        bool whole = i == slot.passCount;
+        const char *name = whole ? "frame" : m_latest.passes[i].name;
+        double cpu = whole ? m_latest.cpuMilliseconds : m_latest.passes[i].cpuMilliseconds;
+        double gpu = whole ? m_latest.gpuMilliseconds : m_latest.passes[i].gpuMilliseconds;
+
+        fprintf(m_csv, "%u,%s,%.4f,", slot.frame, name, cpu);
+        if (gpu >= 0)
+            fprintf(m_csv, "%.4f", gpu);
+        fprintf(m_csv, "\n");
+    }
+}
+
+double FrameTimer::gpuElapsed(GLuint start, GLuint end) const
+{
+    GLuint64 startTime = 0, endTime = 0;
+    glGetQueryObjectui64v(start, GL_QUERY_RESULT, &startTime);
+    glGetQueryObjectui64v(end, GL_QUERY_RESULT, &endTime);
+
+    return (double)(endTime - startTime) / 1e6;
+}
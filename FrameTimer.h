@@ -0,0 +1,109 @@
+#ifndef FRAME_TIMER_H
+#define FRAME_TIMER_H
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "GLExtensions.h"
+
+// Number of frames GPU timestamps are read back late, so reading them never stalls.
+#define FRAME_TIMER_LATENCY 4
+
+// The most passes timed in one frame.
+#define FRAME_TIMER_MAX_PASSES 16
+
+// Time spent in one render pass. GPU times are negative when unavailable.
+struct PassTiming
+{
+    const char *name;
+    double cpuMilliseconds;
+    double gpuMilliseconds;
+};
+
+// Time spent on one whole frame and each of its passes.
+struct FrameTiming
+{
+    unsigned frame;
+    double cpuMilliseconds;
+    double gpuMilliseconds;
+    std::vector<PassTiming> passes;
+};
+
+// Times each render pass of a frame on the CPU with a steady clock and on the GPU
+// with timestamp queries. Queries go into a ring of FRAME_TIMER_LATENCY frames and
+// are read when their slot comes round again, so a frame's record completes a few
+// frames after it was drawn.
+class FrameTimer
+{
+public:
+
+    FrameTimer();
+    ~FrameTimer();
+
+    // Creates the timestamp queries. Returns false if the context has no timer
+    // queries, in which case only CPU times are recorded.
+    bool create();
+
+    // Writes every completed frame to a CSV file, one row per pass plus one for the
+    // whole frame. Returns false if the file cannot be opened.
+    bool openCsv(const char *path);
+
+    void beginFrame();
+    void endFrame();
+
+    // Passes may not nest. The name must outlive the timer.
+    void beginPass(const char *name);
+    void endPass();
+
+    // Waits for every frame still being timed and records them, so none are lost
+    // when drawing stops.
+    void flush();
+
+    // Flushes, then deletes the timestamp queries, which must happen while the
+    // context they were made in is current. Only CPU times are recorded after.
+    void destroy();
+
+    // The most recent completed frame, which has no passes until one completes.
+    const FrameTiming &latest() const;
+
+    bool gpuTimed() const;
+
+private:
+
+    // The timings of one frame of the ring until they are read back.
+    struct Slot
+    {
+        bool pending;
+        unsigned frame;
+        unsigned passCount;
+        const char *names[FRAME_TIMER_MAX_PASSES];
+        double cpuStart[FRAME_TIMER_MAX_PASSES];
+        double cpuEnd[FRAME_TIMER_MAX_PASSES];
+        double cpuFrame;
+
+        // Frame start and end, then the start and end of each pass.
+        GLuint queries[2 + 2 * FRAME_TIMER_MAX_PASSES];
+    };
+
+    // Milliseconds since the current frame began.
+    double cpuElapsed() const;
+
+    // Reads a slot's queries into the latest record and the CSV file, waiting for
+    // them if asked to.
+    void collect(Slot &slot, bool wait);
+
+    // Milliseconds between two timestamp queries.
+    double gpuElapsed(GLuint start, GLuint end) const;
+
+    Slot m_slots[FRAME_TIMER_LATENCY];
+    Slot *m_current;
+    bool m_inPass;
+    unsigned m_frame;
+    bool m_gpuTimed;
+
+    std::chrono::steady_clock::time_point m_frameStart;
+    FrameTiming m_latest;
+    FILE *m_csv;
+};
+
+#endif // FRAME_TIMER_H
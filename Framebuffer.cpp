@@ -0,0 +1,131 @@
+#include "Framebuffer.h"
+
+Framebuffer::Framebuffer() :
+    m_framebuffer(0),
+    m_color(0),
+    m_texture(0),
+    m_depth(0),
+    m_samples(0),
+    m_width(0),
+    m_height(0)
+{
+}
+
+bool Framebuffer::create(int width, int height, int samples, bool texture)
+{
+    // Framebuffer objects need OpenGL 3.0 or ARB_framebuffer_object.
+    if (!glVersionAtLeast(3, 0) && !glHasExtension("GL_ARB_framebuffer_object"))
+        return false;
+    if (samples > 1 && !glRenderbufferStorageMultisample)
+        return false;
+
+    m_width = width;
+    m_height = height;
+    m_samples = samples > 1 ? samples : 0;
+
+    if (texture)
+    {
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    else
+    {
+        glGenRenderbuffers(1, &m_color);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+        if (m_samples)
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_RGBA8, width, height);
+        else
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    }
+
+    glGenRenderbuffers(1, &m_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+    if (m_samples)
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_DEPTH_COMPONENT24, width, height);
+    else
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    if (m_texture)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    else
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!complete)
+    {
+        destroy();
+        return false;
+    }
+
+    return true;
+}
+
+void Framebuffer::destroy()
+{
+    if (m_framebuffer)
+        glDeleteFramebuffers(1, &m_framebuffer);
+    if (m_color)
+        glDeleteRenderbuffers(1, &m_color);
+    if (m_texture)
+        glDeleteTextures(1, &m_texture);
+    if (m_depth)
+        glDeleteRenderbuffers(1, &m_depth);
+
+    m_framebuffer = m_color = m_texture = m_depth = 0;
+    m_width = m_height = m_samples = 0;
+}
+
+void Framebuffer::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+}
+
+void Framebuffer::unbind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Framebuffer::blit(int width, int height, GLuint target, int targetWidth, int targetHeight) const
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+GLuint Framebuffer::texture() const
+{
+    return m_texture;
+}
+
+int Framebuffer::width() const
+{
+    return m_width;
+}
+
+int Framebuffer::height() const
+{
+    return m_height;
+}
+
+int Framebuffer::samples() const
+{
+    return m_samples;
+}
+
+bool Framebuffer::valid() const
+{
+    return m_framebuffer != 0;
+}
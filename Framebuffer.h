@@ -0,0 +1,52 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "GLExtensions.h"
+
+// An offscreen framebuffer object with a color and a depth renderbuffer. The color
+// can instead be a texture, for reading back in a shader, or both buffers can be
+// multisampled, to be resolved by blitting.
+class Framebuffer
+{
+public:
+
+    Framebuffer();
+
+    // Creates the framebuffer, multisampled with samples above 1 or with a color
+    // texture if asked for (not both). Returns false if the context has no
+    // framebuffer objects or cannot render to this one.
+    bool create(int width, int height, int samples = 0, bool texture = false);
+
+    void destroy();
+
+    // Directs drawing and reading to this framebuffer.
+    void bind() const;
+
+    // Directs drawing and reading back to the window.
+    static void unbind();
+
+    // Stretches the bottom-left width x height of this framebuffer over a target
+    // framebuffer (0 for the window) of the given size with bilinear filtering, then
+    // directs drawing and reading to the target.
+    void blit(int width, int height, GLuint target, int targetWidth, int targetHeight) const;
+
+    // The color texture, or 0 if the color is a renderbuffer.
+    GLuint texture() const;
+
+    int width() const;
+    int height() const;
+    int samples() const;
+    bool valid() const;
+
+private:
+
+    GLuint m_framebuffer;
+    GLuint m_color;
+    GLuint m_texture;
+    GLuint m_depth;
+    int m_samples;
+    int m_width;
+    int m_height;
+};
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,76 @@
+#include "Frustum.h"
+#include "GL/freeglut.h"
+
+Frustum::Frustum()
+{
+    // An empty frustum lets everything through.
+    for (int i = 0; i < 6; i++)
+        m_planes[i] = Vector4f(0, 0, 0, 1);
+}
+
+Frustum::Frustum(const Matrix4f &clip)
+{
+    Vector4f x = clip.getRow(0);
+    Vector4f y = clip.getRow(1);
+    Vector4f z = clip.getRow(2);
+    Vector4f w = clip.getRow(3);
+
+    // Gribb and Hartmann: each plane is the w row plus or minus one of the others.
+    m_planes[0] = w + x;
+    m_planes[1] = w - x;
+    m_planes[2] = w + y;
+    m_planes[3] = w - y;
+    m_planes[4] = w + z;
+    m_planes[5] = w - z;
+
+    for (int i = 0; i < 6; i++)
+    {
+        float length = m_planes[i].xyz().abs();
+        if (length > 0)
+            m_planes[i] = m_planes[i] / length;
+    }
+}
+
+bool Frustum::intersectsSphere(const Vector3f &center, float radius) const
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const Vector4f &p = m_planes[i];
+        if (p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] < -radius)
+            return false;
+    }
+
+    return true;
+}
+
+bool Frustum::intersectsBox(const Vector3f &min, const Vector3f &max) const
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const Vector4f &p = m_planes[i];
+
+        // Test the corner furthest along the plane normal.
+        float x = p[0] > 0 ? max[0] : min[0];
+        float y = p[1] > 0 ? max[1] : min[1];
+        float z = p[2] > 0 ? max[2] : min[2];
+
+        if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0)
+            return false;
+    }
+
+    return true;
+}
+
+const Vector4f &Frustum::plane(int i) const
+{
+    return m_planes[i];
+}
+
+Matrix4f currentClipMatrix()
+{
+    Matrix4f modelview, projection;
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+
+    return projection * modelview;
+}
@@ -0,0 +1,34 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "vecmath.h"
+
+// The six clipping planes of a view, used to cull objects on the CPU.
+class Frustum
+{
+public:
+
+    Frustum();
+
+    // Extracts the planes from a combined projection * modelview matrix.
+    // Objects tested afterwards are in that modelview's object space.
+    explicit Frustum(const Matrix4f &clip);
+
+    // Determines whether a sphere is at least partly inside the frustum.
+    bool intersectsSphere(const Vector3f &center, float radius) const;
+
+    // Determines whether an axis-aligned box is at least partly inside the frustum.
+    bool intersectsBox(const Vector3f &min, const Vector3f &max) const;
+
+    // Gets plane i as (a, b, c, d), with a unit-length normal pointing inwards.
+    const Vector4f &plane(int i) const;
+
+private:
+
+    Vector4f m_planes[6];
+};
+
+// Gets the current OpenGL projection * modelview matrix.
+Matrix4f currentClipMatrix();
+
+#endif // FRUSTUM_H
@@ -0,0 +1,41 @@
+#include "GLExtensions.h"
+#include <cstdio>
+#include <cstring>
+
+// Define the loaded pointers.
+#define DEFINE_GL_EXTENSION(type, name) type ext_##name = NULL;
+GL_EXTENSION_FUNCTIONS(DEFINE_GL_EXTENSION)
+#undef DEFINE_GL_EXTENSION
+
+void loadGLExtensions(GLProcLoader loader)
+{
+#define LOAD_GL_EXTENSION(type, name) ext_##name = (type)loader(#name);
+    GL_EXTENSION_FUNCTIONS(LOAD_GL_EXTENSION)
+#undef LOAD_GL_EXTENSION
+}
+
+bool glVersionAtLeast(int major, int minor)
+{
+    const char *version = (const char *)glGetString(GL_VERSION);
+    int contextMajor = 0, contextMinor = 0;
+
+    if (!version || sscanf(version, "%d.%d", &contextMajor, &contextMinor) != 2)
+        return false;
+
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+bool glHasExtension(const char *name)
+{
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    size_t length = strlen(name);
+
+    // Match whole space-separated names only.
+    for (const char *s = extensions; s && (s = strstr(s, name)) != NULL; s += length)
+    {
+        if ((s == extensions || s[-1] == ' ') && (s[length] == ' ' || s[length] == '\0'))
+            return true;
+    }
+
+    return false;
+}
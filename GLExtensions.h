@@ -0,0 +1,175 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include "GL/freeglut.h"
+#include "GL/glext.h"
+
+// Every OpenGL entry point newer than 1.1 that the viewer uses.
+// Each is loaded at runtime into a pointer named ext_<function>.
+#define GL_EXTENSION_FUNCTIONS(X) \
+    X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+    X(PFNGLBUFFERDATAPROC, glBufferData) \
+    X(PFNGLBUFFERSUBDATAPROC, glBufferSubData) \
+    X(PFNGLCREATESHADERPROC, glCreateShader) \
+    X(PFNGLDELETESHADERPROC, glDeleteShader) \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+    X(PFNGLDELETEPROGRAMPROC, glDeleteProgram) \
+    X(PFNGLATTACHSHADERPROC, glAttachShader) \
+    X(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation) \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+    X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+    X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
+    X(PFNGLDISABLEVERTEXATTRIBARRAYPROC, glDisableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor) \
+    X(PFNGLDRAWELEMENTSINSTANCEDPROC, glDrawElementsInstanced) \
+    X(PFNGLBINDBUFFERBASEPROC, glBindBufferBase) \
+    X(PFNGLVERTEXATTRIBIPOINTERPROC, glVertexAttribIPointer) \
+    X(PFNGLMULTIDRAWELEMENTSINDIRECTPROC, glMultiDrawElementsIndirect) \
+    X(PFNGLGETUNIFORMBLOCKINDEXPROC, glGetUniformBlockIndex) \
+    X(PFNGLUNIFORMBLOCKBINDINGPROC, glUniformBlockBinding) \
+    X(PFNGLUNIFORM1IPROC, glUniform1i) \
+    X(PFNGLUNIFORM1FPROC, glUniform1f) \
+    X(PFNGLUNIFORM2FPROC, glUniform2f) \
+    X(PFNGLUNIFORM3FPROC, glUniform3f) \
+    X(PFNGLUNIFORM4FPROC, glUniform4f) \
+    X(PFNGLUNIFORM4FVPROC, glUniform4fv) \
+    X(PFNGLUNIFORMMATRIX4FVPROC, glUniformMatrix4fv) \
+    X(PFNGLGENQUERIESPROC, glGenQueries) \
+    X(PFNGLDELETEQUERIESPROC, glDeleteQueries) \
+    X(PFNGLQUERYCOUNTERPROC, glQueryCounter) \
+    X(PFNGLGETQUERYOBJECTIVPROC, glGetQueryObjectiv) \
+    X(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v) \
+    X(PFNGLMAPBUFFERPROC, glMapBuffer) \
+    X(PFNGLUNMAPBUFFERPROC, glUnmapBuffer) \
+    X(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers) \
+    X(PFNGLDELETEFRAMEBUFFERSPROC, glDeleteFramebuffers) \
+    X(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer) \
+    X(PFNGLFRAMEBUFFERRENDERBUFFERPROC, glFramebufferRenderbuffer) \
+    X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus) \
+    X(PFNGLGENRENDERBUFFERSPROC, glGenRenderbuffers) \
+    X(PFNGLDELETERENDERBUFFERSPROC, glDeleteRenderbuffers) \
+    X(PFNGLBINDRENDERBUFFERPROC, glBindRenderbuffer) \
+    X(PFNGLRENDERBUFFERSTORAGEPROC, glRenderbufferStorage) \
+    X(PFNGLBLITFRAMEBUFFERPROC, glBlitFramebuffer) \
+    X(PFNGLACTIVETEXTUREPROC, glActiveTexture) \
+    X(PFNGLTEXBUFFERPROC, glTexBuffer) \
+    X(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D) \
+    X(PFNGLVERTEXATTRIB1FPROC, glVertexAttrib1f) \
+    X(PFNGLVERTEXATTRIB3FPROC, glVertexAttrib3f) \
+    X(PFNGLRENDERBUFFERSTORAGEMULTISAMPLEPROC, glRenderbufferStorageMultisample) \
+    X(PFNGLBUFFERSTORAGEPROC, glBufferStorage) \
+    X(PFNGLMAPBUFFERRANGEPROC, glMapBufferRange) \
+    X(PFNGLFENCESYNCPROC, glFenceSync) \
+    X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync) \
+    X(PFNGLDELETESYNCPROC, glDeleteSync) \
+    X(PFNGLBEGINQUERYPROC, glBeginQuery) \
+    X(PFNGLENDQUERYPROC, glEndQuery) \
+    X(PFNGLGETQUERYOBJECTUIVPROC, glGetQueryObjectuiv) \
+    X(PFNGLBLENDFUNCSEPARATEPROC, glBlendFuncSeparate) \
+    X(PFNGLDRAWBUFFERSPROC, glDrawBuffers) \
+    X(PFNGLCLEARBUFFERFVPROC, glClearBufferfv) \
+    X(PFNGLVERTEXATTRIB4FPROC, glVertexAttrib4f)
+
+// Declare the loaded pointers.
+#define DECLARE_GL_EXTENSION(type, name) extern type ext_##name;
+GL_EXTENSION_FUNCTIONS(DECLARE_GL_EXTENSION)
+#undef DECLARE_GL_EXTENSION
+
+// Call the loaded pointers by their usual names.
+#define glGenBuffers ext_glGenBuffers
+#define glDeleteBuffers ext_glDeleteBuffers
+#define glBindBuffer ext_glBindBuffer
+#define glBufferData ext_glBufferData
+#define glBufferSubData ext_glBufferSubData
+#define glCreateShader ext_glCreateShader
+#define glDeleteShader ext_glDeleteShader
+#define glShaderSource ext_glShaderSource
+#define glCompileShader ext_glCompileShader
+#define glGetShaderiv ext_glGetShaderiv
+#define glGetShaderInfoLog ext_glGetShaderInfoLog
+#define glCreateProgram ext_glCreateProgram
+#define glDeleteProgram ext_glDeleteProgram
+#define glAttachShader ext_glAttachShader
+#define glBindAttribLocation ext_glBindAttribLocation
+#define glLinkProgram ext_glLinkProgram
+#define glGetProgramiv ext_glGetProgramiv
+#define glGetProgramInfoLog ext_glGetProgramInfoLog
+#define glUseProgram ext_glUseProgram
+#define glGetUniformLocation ext_glGetUniformLocation
+#define glEnableVertexAttribArray ext_glEnableVertexAttribArray
+#define glDisableVertexAttribArray ext_glDisableVertexAttribArray
+#define glVertexAttribPointer ext_glVertexAttribPointer
+#define glVertexAttribDivisor ext_glVertexAttribDivisor
+#define glDrawElementsInstanced ext_glDrawElementsInstanced
+#define glBindBufferBase ext_glBindBufferBase
+#define glVertexAttribIPointer ext_glVertexAttribIPointer
+#define glMultiDrawElementsIndirect ext_glMultiDrawElementsIndirect
+#define glGetUniformBlockIndex ext_glGetUniformBlockIndex
+#define glUniformBlockBinding ext_glUniformBlockBinding
+#define glUniform1i ext_glUniform1i
+#define glUniform1f ext_glUniform1f
+#define glUniform2f ext_glUniform2f
+#define glUniform3f ext_glUniform3f
+#define glUniform4f ext_glUniform4f
+#define glUniform4fv ext_glUniform4fv
+#define glUniformMatrix4fv ext_glUniformMatrix4fv
+#define glGenQueries ext_glGenQueries
+#define glDeleteQueries ext_glDeleteQueries
+#define glQueryCounter ext_glQueryCounter
+#define glGetQueryObjectiv ext_glGetQueryObjectiv
+#define glGetQueryObjectui64v ext_glGetQueryObjectui64v
+#define glMapBuffer ext_glMapBuffer
+#define glUnmapBuffer ext_glUnmapBuffer
+#define glGenFramebuffers ext_glGenFramebuffers
+#define glDeleteFramebuffers ext_glDeleteFramebuffers
+#define glBindFramebuffer ext_glBindFramebuffer
+#define glFramebufferRenderbuffer ext_glFramebufferRenderbuffer
+#define glCheckFramebufferStatus ext_glCheckFramebufferStatus
+#define glGenRenderbuffers ext_glGenRenderbuffers
+#define glDeleteRenderbuffers ext_glDeleteRenderbuffers
+#define glBindRenderbuffer ext_glBindRenderbuffer
+#define glRenderbufferStorage ext_glRenderbufferStorage
+#define glBlitFramebuffer ext_glBlitFramebuffer
+#define glActiveTexture ext_glActiveTexture
+#define glTexBuffer ext_glTexBuffer
+#define glFramebufferTexture2D ext_glFramebufferTexture2D
+#define glVertexAttrib1f ext_glVertexAttrib1f
+#define glVertexAttrib3f ext_glVertexAttrib3f
+#define glRenderbufferStorageMultisample ext_glRenderbufferStorageMultisample
+#define glBufferStorage ext_glBufferStorage
+#define glMapBufferRange ext_glMapBufferRange
+#define glFenceSync ext_glFenceSync
+#define glClientWaitSync ext_glClientWaitSync
+#define glDeleteSync ext_glDeleteSync
+#define glBeginQuery ext_glBeginQuery
+#define glEndQuery ext_glEndQuery
+#define glGetQueryObjectuiv ext_glGetQueryObjectuiv
+#define glBlendFuncSeparate ext_glBlendFuncSeparate
+#define glDrawBuffers ext_glDrawBuffers
+#define glClearBufferfv ext_glClearBufferfv
+#define glVertexAttrib4f ext_glVertexAttrib4f
+
+// Looks up an OpenGL entry point by name.
+typedef void (*GLProc)();
+typedef GLProc (*GLProcLoader)(const char *name);
+
+// Loads every entry point above from the current context.
+void loadGLExtensions(GLProcLoader loader);
+
+// Determines whether the current context is at least the given OpenGL version.
+bool glVersionAtLeast(int major, int minor);
+
+// Determines whether the current context advertises an extension.
+bool glHasExtension(const char *name);
+
+#endif // GL_EXTENSIONS_H
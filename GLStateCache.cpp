@@ -0,0 +1,301 @@
+#include "GLStateCache.h"
+#include <cstring>
+
+using namespace std;
+
+GLStateCache glState;
+
+namespace
+{
+    // Number of values a material or light parameter takes.
+    int parameterSize(GLenum name)
+    {
+        switch (name)
+        {
+        case GL_AMBIENT:
+        case GL_DIFFUSE:
+        case GL_SPECULAR:
+        case GL_EMISSION:
+        case GL_POSITION:
+            return 4;
+
+        case GL_SPOT_DIRECTION:
+            return 3;
+
+        default:
+            return 1;
+        }
+    }
+}
+
+GLStateCache::GLStateCache() :
+    m_issued(0),
+    m_saved(0),
+    m_lastIssued(0),
+    m_lastSaved(0)
+{
+    reset();
+}
+
+void GLStateCache::reset()
+{
+    m_capabilities.clear();
+    m_materials.clear();
+    m_lights.clear();
+    m_buffers.clear();
+    m_indexedBuffers.clear();
+
+    m_colorKnown = false;
+    m_lineWidth = -1;
+    m_depthMaskKnown = false;
+    m_depthFuncKnown = false;
+    m_colorMaskKnown = false;
+    m_blendFuncKnown = false;
+    m_programKnown = false;
+    m_program = 0;
+}
+
+void GLStateCache::beginFrame()
+{
+    m_lastIssued = m_issued;
+    m_lastSaved = m_saved;
+    m_issued = 0;
+    m_saved = 0;
+}
+
+bool GLStateCache::count(bool changed)
+{
+    if (changed)
+        m_issued++;
+    else
+        m_saved++;
+
+    return changed;
+}
+
+bool GLStateCache::update(map<pair<GLenum, GLenum>, Values> &cache, GLenum key, GLenum name, const GLfloat *values, int count)
+{
+    pair<GLenum, GLenum> slot(key, name);
+    map<pair<GLenum, GLenum>, Values>::iterator it = cache.find(slot);
+
+    if (it != cache.end() && memcmp(it->second.v, values, count * sizeof(GLfloat)) == 0)
+        return false;
+
+    Values &cached = cache[slot];
+    memcpy(cached.v, values, count * sizeof(GLfloat));
+    return true;
+}
+
+void GLStateCache::enable(GLenum capability)
+{
+    map<GLenum, bool>::iterator it = m_capabilities.find(capability);
+    if (count(it == m_capabilities.end() || !it->second))
+    {
+        m_capabilities[capability] = true;
+        glEnable(capability);
+    }
+}
+
+void GLStateCache::disable(GLenum capability)
+{
+    map<GLenum, bool>::iterator it = m_capabilities.find(capability);
+    if (count(it == m_capabilities.end() || it->second))
+    {
+        m_capabilities[capability] = false;
+        glDisable(capability);
+    }
+}
+
+void GLStateCache::material(GLenum face, GLenum name, const GLfloat *values)
+{
+    int size = parameterSize(name);
+    bool changed = false;
+
+    // Track front and back faces, and ambient and diffuse colors, separately.
+    GLenum faces[2] = { GL_FRONT, GL_BACK };
+    GLenum names[2] = { GL_AMBIENT, GL_DIFFUSE };
+
+    for (int f = 0; f < 2; f++)
+    {
+        if (face != faces[f] && face != GL_FRONT_AND_BACK)
+            continue;
+
+        for (int n = 0; n < 2; n++)
+        {
+            if (name == GL_AMBIENT_AND_DIFFUSE)
+                changed |= update(m_materials, faces[f], names[n], values, 4);
+            else if (n == 0)
+                changed |= update(m_materials, faces[f], name, values, size);
+        }
+    }
+
+    if (count(changed))
+        glMaterialfv(face, name, values);
+}
+
+void GLStateCache::light(GLenum light, GLenum name, const GLfloat *values)
+{
+    // Positions and directions depend on the modelview, so they are never cached here.
+    bool transformed = name == GL_POSITION || name == GL_SPOT_DIRECTION;
+
+    if (count(transformed || update(m_lights, light, name, values, parameterSize(name))))
+        glLightfv(light, name, values);
+}
+
+void GLStateCache::lightPosition(GLenum light, const GLfloat *position, const Vector4f &eyePosition)
+{
+    GLfloat eye[4] = { eyePosition[0], eyePosition[1], eyePosition[2], eyePosition[3] };
+
+    if (count(update(m_lights, light, GL_POSITION, eye, 4)))
+        glLightfv(light, GL_POSITION, position);
+}
+
+void GLStateCache::color(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    GLfloat color[4] = { red, green, blue, alpha };
+
+    if (count(!m_colorKnown || memcmp(color, m_color, sizeof(color)) != 0))
+    {
+        memcpy(m_color, color, sizeof(color));
+        m_colorKnown = true;
+        glColor4fv(color);
+    }
+}
+
+void GLStateCache::lineWidth(GLfloat width)
+{
+    if (count(width != m_lineWidth))
+    {
+        m_lineWidth = width;
+        glLineWidth(width);
+    }
+}
+
+void GLStateCache::depthMask(GLboolean mask)
+{
+    if (count(!m_depthMaskKnown || mask != m_depthMask))
+    {
+        m_depthMaskKnown = true;
+        m_depthMask = mask;
+        glDepthMask(mask);
+    }
+}
+
+void GLStateCache::depthFunc(GLenum function)
+{
+    if (count(!m_depthFuncKnown || function != m_depthFunc))
+    {
+        m_depthFuncKnown = true;
+        m_depthFunc = function;
+        glDepthFunc(function);
+    }
+}
+
+void GLStateCache::colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    if (count(!m_colorMaskKnown || red != m_colorMask[0] || green != m_colorMask[1]
+        || blue != m_colorMask[2] || alpha != m_colorMask[3]))
+    {
+        m_colorMaskKnown = true;
+        m_colorMask[0] = red;
+        m_colorMask[1] = green;
+        m_colorMask[2] = blue;
+        m_colorMask[3] = alpha;
+        glColorMask(red, green, blue, alpha);
+    }
+}
+
+void GLStateCache::blendFunc(GLenum source, GLenum destination)
+{
+    if (count(!m_blendFuncKnown || source != m_blendSource || destination != m_blendDestination
+        || source != m_blendAlphaSource || destination != m_blendAlphaDestination))
+    {
+        m_blendFuncKnown = true;
+        m_blendSource = m_blendAlphaSource = source;
+        m_blendDestination = m_blendAlphaDestination = destination;
+        glBlendFunc(source, destination);
+    }
+}
+
+void GLStateCache::blendFuncSeparate(GLenum source, GLenum destination, GLenum alphaSource, GLenum alphaDestination)
+{
+    if (count(!m_blendFuncKnown || source != m_blendSource || destination != m_blendDestination
+        || alphaSource != m_blendAlphaSource || alphaDestination != m_blendAlphaDestination))
+    {
+        m_blendFuncKnown = true;
+        m_blendSource = source;
+        m_blendDestination = destination;
+        m_blendAlphaSource = alphaSource;
+        m_blendAlphaDestination = alphaDestination;
+        glBlendFuncSeparate(source, destination, alphaSource, alphaDestination);
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    map<GLenum, GLuint>::iterator it = m_buffers.find(target);
+    if (count(it == m_buffers.end() || it->second != buffer))
+    {
+        m_buffers[target] = buffer;
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    pair<GLenum, GLuint> slot(target, index);
+    map<pair<GLenum, GLuint>, GLuint>::iterator it = m_indexedBuffers.find(slot);
+
+    // Binding an indexed target also binds its generic target.
+    map<GLenum, GLuint>::iterator generic = m_buffers.find(target);
+    bool changed = it == m_indexedBuffers.end() || it->second != buffer
+        || generic == m_buffers.end() || generic->second != buffer;
+
+    if (count(changed))
+    {
+        m_indexedBuffers[slot] = buffer;
+        m_buffers[target] = buffer;
+        glBindBufferBase(target, index, buffer);
+    }
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint *buffers)
+{
+    // Deleting a bound buffer unbinds it.
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (map<GLenum, GLuint>::iterator it = m_buffers.begin(); it != m_buffers.end(); ++it)
+        {
+            if (it->second == buffers[i])
+                it->second = 0;
+        }
+
+        for (map<pair<GLenum, GLuint>, GLuint>::iterator it = m_indexedBuffers.begin(); it != m_indexedBuffers.end(); ++it)
+        {
+            if (it->second == buffers[i])
+                it->second = 0;
+        }
+    }
+
+    glDeleteBuffers(count, buffers);
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (count(!m_programKnown || program != m_program))
+    {
+        m_programKnown = true;
+        m_program = program;
+        glUseProgram(program);
+    }
+}
+
+unsigned GLStateCache::issuedCalls() const
+{
+    return m_lastIssued;
+}
+
+unsigned GLStateCache::savedCalls() const
+{
+    return m_lastSaved;
+}
@@ -0,0 +1,99 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <map>
+#include <utility>
+#include "GLExtensions.h"
+#include "vecmath.h"
+
+// Tracks the OpenGL state the viewer sets and drops calls that would not change it.
+// Every change to the tracked state must go through the cache, or the cache must be
+// reset afterwards; otherwise it may skip a call that was actually needed.
+class GLStateCache
+{
+public:
+
+    GLStateCache();
+
+    // Forgets all tracked state, so the next call of each kind is always issued.
+    void reset();
+
+    // Starts counting the calls of a new frame.
+    void beginFrame();
+
+    void enable(GLenum capability);
+    void disable(GLenum capability);
+
+    void material(GLenum face, GLenum name, const GLfloat *values);
+    void light(GLenum light, GLenum name, const GLfloat *values);
+
+    // Sets a light's position, which GL transforms by the current modelview.
+    // The call is skipped only when the resulting eye-space position is unchanged.
+    void lightPosition(GLenum light, const GLfloat *position, const Vector4f &eyePosition);
+
+    void color(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    void lineWidth(GLfloat width);
+    void depthMask(GLboolean mask);
+    void depthFunc(GLenum function);
+    void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+    void blendFunc(GLenum source, GLenum destination);
+
+    // Blends the color and alpha channels with factors of their own.
+    void blendFuncSeparate(GLenum source, GLenum destination, GLenum alphaSource, GLenum alphaDestination);
+
+    void bindBuffer(GLenum target, GLuint buffer);
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void deleteBuffers(GLsizei count, const GLuint *buffers);
+    void useProgram(GLuint program);
+
+    // Calls passed on to GL and calls dropped as redundant during the last full frame.
+    unsigned issuedCalls() const;
+    unsigned savedCalls() const;
+
+private:
+
+    // Up to four values of a material or light parameter.
+    struct Values
+    {
+        GLfloat v[4];
+    };
+
+    // Records a parameter and returns true if it changed.
+    bool update(std::map<std::pair<GLenum, GLenum>, Values> &cache, GLenum key, GLenum name, const GLfloat *values, int count);
+
+    // Counts a call as issued or saved and returns whether to issue it.
+    bool count(bool changed);
+
+    std::map<GLenum, bool> m_capabilities;
+    std::map<std::pair<GLenum, GLenum>, Values> m_materials;
+    std::map<std::pair<GLenum, GLenum>, Values> m_lights;
+    std::map<GLenum, GLuint> m_buffers;
+    std::map<std::pair<GLenum, GLuint>, GLuint> m_indexedBuffers;
+
+    bool m_colorKnown;
+    GLfloat m_color[4];
+    GLfloat m_lineWidth;
+    bool m_depthMaskKnown;
+    GLboolean m_depthMask;
+    bool m_depthFuncKnown;
+    GLenum m_depthFunc;
+    bool m_colorMaskKnown;
+    GLboolean m_colorMask[4];
+    bool m_blendFuncKnown;
+    GLenum m_blendSource;
+    GLenum m_blendDestination;
+    GLenum m_blendAlphaSource;
+    GLenum m_blendAlphaDestination;
+    bool m_programKnown;
+    GLuint m_program;
+
+    unsigned m_issued;
+    unsigned m_saved;
+    unsigned m_lastIssued;
+    unsigned m_lastSaved;
+};
+
+// The state cache of the current context.
+extern GLStateCache glState;
+
+#endif // GL_STATE_CACHE_H
@@ -0,0 +1,128 @@
+#include "GridShader.h"
+#include "GLStateCache.h"
+
+namespace
+{
+    // Covers the screen with one triangle and unprojects each corner onto the near and
+    // far planes. The points stay homogeneous so they interpolate linearly on screen.
+    const char *gridVertexShader =
+        "#version 330 compatibility\n"
+        "out vec4 nearPoint;\n"
+        "out vec4 farPoint;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;\n"
+        "    nearPoint = gl_ModelViewProjectionMatrixInverse * vec4(corner, -1.0, 1.0);\n"
+        "    farPoint = gl_ModelViewProjectionMatrixInverse * vec4(corner, 1.0, 1.0);\n"
+        "    gl_FrontColor = gl_Color;\n"
+        "    gl_Position = vec4(corner, 0.0, 1.0);\n"
+        "}\n";
+
+    const char *gridFragmentShader =
+        "#version 330 compatibility\n"
+        "in vec4 nearPoint;\n"
+        "in vec4 farPoint;\n"
+        "out vec4 fragColor;\n"
+        // Coverage at or below which a pixel is left alone.
+        "uniform float minAlpha;\n"
+        // The fewest pixels a cell spans before its lines have faded out.
+        "const float minCellPixels = 2.0;\n"
+        // Coverage of the nearest line of a grid, one pixel wide and anti-aliased.
+        "float lines(vec2 coord, vec2 pixel, float spacing)\n"
+        "{\n"
+        "    vec2 distance = abs(fract(coord / spacing + 0.5) - 0.5) * spacing / pixel;\n"
+        "    return 1.0 - min(min(distance.x, distance.y), 1.0);\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 n = nearPoint.xyz / nearPoint.w;\n"
+        "    vec3 f = farPoint.xyz / farPoint.w;\n"
+        "    float t = n.y / (n.y - f.y);\n"
+        "    vec3 p = mix(n, f, t);\n"
+        // Keep only hits between the near and far planes; this also drops rays
+        // parallel to the plane, whose t is not a number.
+        "    bool hit = t > 0.0 && t < 1.0;\n"
+        // World units per pixel on the plane, which grows with distance. Derivatives
+        // are taken outside the branch, where they are defined.
+        "    vec2 pixel = fwidth(p.xz);\n"
+        "    float nearPixel = fwidth(n.y);\n"
+        "    float alpha = 0.0;\n"
+        "    if (hit)\n"
+        "    {\n"
+        // Use the finest power-of-ten spacing whose cells span at least ten times the
+        // limit, and fade its lines out as they shrink towards it.
+        "        float lod = max(log(max(pixel.x, pixel.y) * minCellPixels * 10.0) / log(10.0), 0.0);\n"
+        "        float spacing = pow(10.0, floor(lod));\n"
+        "        float fade = 1.0 - fract(lod);\n"
+        "        alpha = max(lines(p.xz, pixel, spacing) * fade, lines(p.xz, pixel, spacing * 10.0));\n"
+        // Fade out towards the far plane rather than stopping at it.
+        "        alpha *= 1.0 - smoothstep(0.5, 1.0, t);\n"
+        "    }\n"
+        // Seen edge-on, the plane covers no area and the lines vanish, so draw the
+        // line the plane meets the near plane along one pixel wide. It is only on
+        // screen when the eye is about as close to the plane as the near plane is.
+        "    float edge = 1.0 - min(abs(n.y) / max(nearPixel, 1e-20), 1.0);\n"
+        "    alpha = max(alpha, edge);\n"
+        "    if (!(alpha > minAlpha))\n"
+        "        discard;\n"
+        // The edge has no single depth off the plane; put it behind everything there,
+        // just short of the far plane so that it still passes the depth test.
+        "    vec4 clip = gl_ModelViewProjectionMatrix * vec4(p, 1.0);\n"
+        "    float depth = hit ? clip.z / clip.w : 1.0 - 1e-5;\n"
+        "    gl_FragDepth = 0.5 * (gl_DepthRange.diff * depth + gl_DepthRange.near + gl_DepthRange.far);\n"
+        "    fragColor = vec4(gl_Color.rgb, gl_Color.a * alpha);\n"
+        "}\n";
+}
+
+GridShader::GridShader() :
+    m_minAlpha(-1)
+{
+}
+
+bool GridShader::create()
+{
+    // gl_VertexID and the 3.3 compatibility built-ins need OpenGL 3.3.
+    if (!glVersionAtLeast(3, 3))
+        return false;
+
+    if (!m_program.create(gridVertexShader, gridFragmentShader, NULL))
+        return false;
+
+    m_minAlpha = m_program.uniform("minAlpha");
+    return true;
+}
+
+void GridShader::draw()
+{
+    glState.enable(GL_BLEND);
+    glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.depthMask(GL_FALSE);
+    m_program.use();
+    glUniform1f(m_minAlpha, 0.0f);
+
+    // The corners come from gl_VertexID, so no arrays are needed.
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glState.useProgram(0);
+    glState.depthMask(GL_TRUE);
+    glState.disable(GL_BLEND);
+}
+
+void GridShader::drawDepth()
+{
+    glState.colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    m_program.use();
+
+    // Only the solid middle of each line hides what is behind it, so the faint
+    // edges and faded lines do not punch holes in it.
+    glUniform1f(m_minAlpha, 0.5f);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glState.useProgram(0);
+    glState.colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+bool GridShader::valid() const
+{
+    return m_program.valid();
+}
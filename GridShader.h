@@ -0,0 +1,38 @@
+#ifndef GRID_SHADER_H
+#define GRID_SHADER_H
+
+#include "Shader.h"
+
+// An endless reference grid on the y = 0 plane of the current modelview, computed
+// per pixel. One full-screen triangle with no vertex data is drawn; each pixel casts
+// a ray onto the plane and finds its distance to the nearest lines, so the lines are
+// anti-aliased analytically and reach the far plane without extra geometry. Lines
+// one unit apart fade into lines ten units apart (and so on) as they shrink on
+// screen, which thins the grid with camera distance.
+class GridShader
+{
+public:
+
+    GridShader();
+
+    // Compiles the program. Returns false if the context is too old, in which case
+    // the grid must be drawn with lines.
+    bool create();
+
+    // Blends the grid in the current color over what has been drawn so far, testing
+    // against but not writing depth. Draw it after the opaque geometry.
+    void draw();
+
+    // Writes the depth of the grid's lines and no color, so that what is drawn
+    // after it behind a line fails the depth test there.
+    void drawDepth();
+
+    bool valid() const;
+
+private:
+
+    ShaderProgram m_program;
+    GLint m_minAlpha;
+};
+
+#endif // GRID_SHADER_H
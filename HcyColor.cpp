@@ -0,0 +1,161 @@
+#include "HcyColor.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HCY_SSE2
+#endif
+
+using namespace std;
+
+namespace
+{
+    // Each color has a different defined weight in the luma color space.
+    const GLfloat REDWEIGHT = 0.299f;
+    const GLfloat GREENWEIGHT = 0.587f;
+    const GLfloat BLUEWEIGHT = 0.114f;
+
+    // Clamps to [0, 1].
+    inline GLfloat saturate(GLfloat x)
+    {
+        return min(max(x, 0.0f), 1.0f);
+    }
+}
+
+void hcy2rgb(const struct HCY &hcy, union RGB &rgb)
+{
+    GLfloat chroma = hcy.chroma;
+
+    // Bound hue to [0, 6) since we have different cases depending on which integers the hue will be between.
+    GLfloat hue = hcy.hue * 6;
+
+    // Initialize color to empty.
+    GLfloat r = 0.f;
+    GLfloat g = 0.f;
+    GLfloat b = 0.f;
+
+    // Alpha channel is a simple copy.
+    rgb.alpha = hcy.alpha;
+
+    // Only care about color if there is a present chroma.
+    if (chroma > 0)
+    {
+        // If hue's bounds are [0, 1), we have a predominately red-to-yellow color.
+        if (hue >= 0 && hue < 1)
+        {
+            r = chroma;
+            g = chroma * hue;
+        }
+
+        // [1, 2) is a yellow-to-green.
+        else if (hue >= 1 && hue < 2)
+        {
+            r = chroma * (2 - hue);
+            g = chroma;
+        }
+
+        // Green-to-cyan.
+        else if (hue >= 2 && hue < 3)
+        {
+            g = chroma;
+            b = chroma * (hue - 2);
+        }
+
+        // Cyan-to-blue.
+        else if (hue >= 3 && hue < 4)
+        {
+            g = chroma * (4 - hue);
+            b = chroma;
+        }
+
+        // Blue-to-magenta.
+        else if (hue >= 4 && hue < 5)
+        {
+            r = chroma * (hue - 4);
+            b = chroma;
+        }
+
+        // This lost possible result is [5, 6) and is a magenta-to-red color.
+        else //if (hue >= 5 && hue < 6)
+        {
+            r = chroma;
+            b = chroma * (6 - hue);
+        }
+    }
+
+    // The match value defines the "colorful intensity" of the color.
+    GLfloat match = hcy.luma - (REDWEIGHT * r + GREENWEIGHT * g + BLUEWEIGHT * b);
+
+    // The final color result.
+    rgb.red = r + match;
+    rgb.green = g + match;
+    rgb.blue = b + match;
+}
+
+void hcy2rgb(const struct HCY *hcy, union RGB *rgb, size_t count)
+{
+    // Each channel's share of the chroma is a tent over the hue in [0, 6), full
+    // within one of its peak, none beyond two, and a ramp in between. Green and
+    // blue peak at 2 and 4, and red at 0 and 6, where it is the tent at 3 upside down.
+    size_t i = 0;
+
+#ifdef HCY_SSE2
+    const __m128 six = _mm_set1_ps(6);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 two = _mm_set1_ps(2);
+    const __m128 three = _mm_set1_ps(3);
+    const __m128 four = _mm_set1_ps(4);
+    const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 redWeight = _mm_set1_ps(REDWEIGHT);
+    const __m128 greenWeight = _mm_set1_ps(GREENWEIGHT);
+    const __m128 blueWeight = _mm_set1_ps(BLUEWEIGHT);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        // Four colors of alpha, hue, chroma, and luma become one register per channel.
+        __m128 alpha = _mm_loadu_ps(&hcy[i].alpha);
+        __m128 hue = _mm_loadu_ps(&hcy[i + 1].alpha);
+        __m128 chroma = _mm_loadu_ps(&hcy[i + 2].alpha);
+        __m128 luma = _mm_loadu_ps(&hcy[i + 3].alpha);
+        _MM_TRANSPOSE4_PS(alpha, hue, chroma, luma);
+
+        hue = _mm_mul_ps(hue, six);
+        __m128 r = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(hue, three), magnitude), one);
+        __m128 g = _mm_sub_ps(two, _mm_and_ps(_mm_sub_ps(hue, two), magnitude));
+        __m128 b = _mm_sub_ps(two, _mm_and_ps(_mm_sub_ps(hue, four), magnitude));
+        r = _mm_mul_ps(chroma, _mm_min_ps(_mm_max_ps(r, zero), one));
+        g = _mm_mul_ps(chroma, _mm_min_ps(_mm_max_ps(g, zero), one));
+        b = _mm_mul_ps(chroma, _mm_min_ps(_mm_max_ps(b, zero), one));
+
+        __m128 match = _mm_sub_ps(luma, _mm_add_ps(_mm_add_ps(_mm_mul_ps(redWeight, r),
+            _mm_mul_ps(greenWeight, g)), _mm_mul_ps(blueWeight, b)));
+        r = _mm_add_ps(r, match);
+        g = _mm_add_ps(g, match);
+        b = _mm_add_ps(b, match);
+
+        // And back to one register per color.
+        _MM_TRANSPOSE4_PS(r, g, b, alpha);
+        _mm_storeu_ps(rgb[i].values, r);
+        _mm_storeu_ps(rgb[i + 1].values, g);
+        _mm_storeu_ps(rgb[i + 2].values, b);
+        _mm_storeu_ps(rgb[i + 3].values, alpha);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        GLfloat hue = hcy[i].hue * 6;
+        GLfloat chroma = hcy[i].chroma;
+        GLfloat r = chroma * saturate(fabs(hue - 3) - 1);
+        GLfloat g = chroma * saturate(2 - fabs(hue - 2));
+        GLfloat b = chroma * saturate(2 - fabs(hue - 4));
+        GLfloat match = hcy[i].luma - (REDWEIGHT * r + GREENWEIGHT * g + BLUEWEIGHT * b);
+
+        rgb[i].red = r + match;
+        rgb[i].green = g + match;
+        rgb[i].blue = b + match;
+        rgb[i].alpha = hcy[i].alpha;
+    }
+}
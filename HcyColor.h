@@ -0,0 +1,63 @@
+#ifndef HCY_COLOR_H
+#define HCY_COLOR_H
+
+#include <cstddef>
+#include "GLExtensions.h"
+
+// Represents a color by its hue, chroma, and luma.
+struct HCY
+{
+    GLfloat alpha;
+    GLfloat hue;
+    GLfloat chroma;
+    GLfloat luma;
+
+    HCY(const GLfloat a, const GLfloat h, const GLfloat c, const GLfloat y)
+    {
+#define CLAMP(x) x < 0 ? 0 : (x > 1 ? 1 : x)
+
+        alpha = CLAMP(a);
+        hue = CLAMP(h);
+        chroma = CLAMP(c);
+        luma = CLAMP(y);
+
+#undef CLAMP
+    }
+
+    // Rotate color's hue by given degrees.
+    void rotateHue(const GLfloat degrees)
+    {
+        float delta = degrees / 360.0f;
+
+        // Add change to current hue.
+        hue += delta;
+
+        // Modulus clamp the value to be between 0 and 1.
+        while (hue > 1)
+            hue -= 1;
+        while (hue < 0)
+            hue += 1;
+    }
+};
+
+// Represents an OpenGL-styled color of floats
+union RGB
+{
+    GLfloat values[4];
+    struct
+    {
+        // Channels must be in this exact order to match OpenGL's system.
+        GLfloat red, green, blue, alpha;
+    };
+};
+
+// Get an RGB color from an HCY color
+void hcy2rgb(const struct HCY &hcy, union RGB &rgb);
+
+// Gets the RGB colors of a whole array of HCY colors. Instead of picking a case by
+// which sixth of the hue circle each color is in, every channel is a clamped tent
+// function of the hue, so four colors at a time go through the same instructions
+// with SSE2. Gives what converting each color alone gives, to rounding.
+void hcy2rgb(const struct HCY *hcy, union RGB *rgb, size_t count);
+
+#endif // HCY_COLOR_H
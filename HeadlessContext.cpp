@@ -0,0 +1,163 @@
+#include "HeadlessContext.h"
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+namespace
+{
+    // Determines whether a space-separated EGL extension string names an extension.
+    bool hasEglExtension(const char *extensions, const char *name)
+    {
+        size_t length = strlen(name);
+
+        for (const char *s = extensions; s && (s = strstr(s, name)) != NULL; s += length)
+        {
+            if ((s == extensions || s[-1] == ' ') && (s[length] == ' ' || s[length] == '\0'))
+                return true;
+        }
+
+        return false;
+    }
+
+    // Opens the surfaceless platform if EGL offers it, otherwise the default display.
+    EGLDisplay openDisplay()
+    {
+        const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+        if (hasEglExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+            if (getPlatformDisplay)
+            {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+                if (display != EGL_NO_DISPLAY)
+                    return display;
+            }
+        }
+
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+}
+#endif
+
+HeadlessContext::HeadlessContext() :
+    m_display(NULL),
+    m_surface(NULL),
+    m_context(NULL)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    destroy();
+}
+
+bool HeadlessContext::create(int width, int height)
+{
+#ifndef _WIN32
+    EGLDisplay display = openDisplay();
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+    {
+        cerr << "Could not open an EGL display." << endl;
+        return false;
+    }
+    m_display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        cerr << "EGL has no desktop OpenGL." << endl;
+        destroy();
+        return false;
+    }
+
+    // We draw into our own framebuffer, so the config only needs to suit a tiny pbuffer.
+    EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = NULL;
+    EGLint configs = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configs);
+
+    // Ask for the newest compatibility context, since we mix shaders with fixed-function
+    // calls, then for whatever the driver gives by default.
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, configs ? config : (EGLConfig)NULL, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT)
+        context = eglCreateContext(display, configs ? config : (EGLConfig)NULL, EGL_NO_CONTEXT, NULL);
+
+    if (context == EGL_NO_CONTEXT)
+    {
+        cerr << "Could not create an EGL OpenGL context." << endl;
+        destroy();
+        return false;
+    }
+    m_context = context;
+
+    // Without surfaceless contexts, make current with a 1 x 1 pbuffer we never draw to.
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!hasEglExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context") && configs)
+    {
+        EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+        m_surface = surface;
+    }
+
+    if (!eglMakeCurrent(display, surface, surface, context))
+    {
+        cerr << "Could not make the EGL context current." << endl;
+        destroy();
+        return false;
+    }
+
+    loadGLExtensions((GLProcLoader)eglGetProcAddress);
+
+    if (!m_framebuffer.create(width, height))
+    {
+        cerr << "Could not create a " << width << " x " << height << " framebuffer." << endl;
+        destroy();
+        return false;
+    }
+
+    m_framebuffer.bind();
+    return true;
+#else
+    cerr << "Headless rendering is not supported on this platform." << endl;
+    return false;
+#endif
+}
+
+void HeadlessContext::destroy()
+{
+#ifndef _WIN32
+    if (m_context)
+        m_framebuffer.destroy();
+
+    if (m_display)
+    {
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_surface)
+            eglDestroySurface(m_display, m_surface);
+        if (m_context)
+            eglDestroyContext(m_display, m_context);
+        eglTerminate(m_display);
+    }
+#endif
+
+    m_display = m_surface = m_context = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include "Framebuffer.h"
+
+// An OpenGL context that needs no window system, drawing into a framebuffer object.
+// The context comes from EGL, on Mesa's surfaceless platform when it is available so
+// that no display server is needed at all; Mesa's llvmpipe then renders on the CPU.
+class HeadlessContext
+{
+public:
+
+    HeadlessContext();
+    ~HeadlessContext();
+
+    // Creates and makes current a compatibility context, loads the OpenGL entry
+    // points, and binds a framebuffer of the given size for all drawing and reading.
+    // Prints why and returns false on failure.
+    bool create(int width, int height);
+
+    void destroy();
+
+private:
+
+    void *m_display;
+    void *m_surface;
+    void *m_context;
+    Framebuffer m_framebuffer;
+};
+
+#endif // HEADLESS_CONTEXT_H
@@ -0,0 +1,195 @@
+#include "ImageWriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    // The largest stored deflate block.
+    const size_t MAX_STORED_BLOCK = 65535;
+
+    // CRC-32 of every byte value, as PNG chunks use.
+    struct CrcTable
+    {
+        unsigned values[256];
+
+        CrcTable()
+        {
+            for (unsigned n = 0; n < 256; n++)
+            {
+                unsigned c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                values[n] = c;
+            }
+        }
+    } crcTable;
+
+    unsigned crc32(unsigned crc, const unsigned char *data, size_t length)
+    {
+        crc ^= 0xffffffffu;
+        for (size_t i = 0; i < length; i++)
+            crc = crcTable.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffffu;
+    }
+
+    void appendBigEndian(vector<unsigned char> &out, unsigned value)
+    {
+        out.push_back((unsigned char)(value >> 24));
+        out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8));
+        out.push_back((unsigned char)value);
+    }
+
+    // Appends a chunk with its length and checksum.
+    void appendChunk(vector<unsigned char> &out, const char *type, const vector<unsigned char> &data)
+    {
+        appendBigEndian(out, (unsigned)data.size());
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        appendBigEndian(out, crc32(0, &out[start], out.size() - start));
+    }
+
+    // Wraps data in a zlib stream of stored (uncompressed) deflate blocks, which keeps
+    // us free of a compression library at the cost of files as large as the pixels.
+    vector<unsigned char> zlibStored(const vector<unsigned char> &data)
+    {
+        vector<unsigned char> out;
+        out.reserve(data.size() + data.size() / MAX_STORED_BLOCK * 5 + 16);
+
+        // Deflate with a 32K window and no preset dictionary.
+        out.push_back(0x78);
+        out.push_back(0x01);
+
+        size_t offset = 0;
+        do
+        {
+            size_t length = min(data.size() - offset, MAX_STORED_BLOCK);
+            bool last = offset + length == data.size();
+
+            out.push_back(last ? 1 : 0);
+            out.push_back((unsigned char)length);
+            out.push_back((unsigned char)(length >> 8));
+            out.push_back((unsigned char)~length);
+            out.push_back((unsigned char)(~length >> 8));
+            out.insert(out.end(), data.begin() + offset, data.begin() + offset + length);
+
+            offset += length;
+        } while (offset < data.size());
+
+        // Adler-32 of the uncompressed data.
+        unsigned a = 1, b = 0;
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        appendBigEndian(out, (b << 16) | a);
+
+        return out;
+    }
+}
+
+bool writePng(const string &path, const Image &image)
+{
+    // Each row starts with its filter type (none) and runs top to bottom.
+    vector<unsigned char> raw;
+    raw.reserve((size_t)image.height * (image.width * 3 + 1));
+    for (int y = image.height - 1; y >= 0; y--)
+    {
+        raw.push_back(0);
+        const unsigned char *row = &image.pixels[(size_t)y * image.width * 4];
+        for (int x = 0; x < image.width; x++)
+            raw.insert(raw.end(), row + x * 4, row + x * 4 + 3);
+    }
+
+    vector<unsigned char> header;
+    appendBigEndian(header, image.width);
+    appendBigEndian(header, image.height);
+    header.push_back(8); // Bits per channel.
+    header.push_back(2); // RGB.
+    header.push_back(0); // Deflate.
+    header.push_back(0); // Adaptive filtering.
+    header.push_back(0); // Not interlaced.
+
+    const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    vector<unsigned char> png(signature, signature + sizeof(signature));
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", zlibStored(raw));
+    appendChunk(png, "IEND", vector<unsigned char>());
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool written = fwrite(&png[0], 1, png.size(), file) == png.size();
+    return fclose(file) == 0 && written;
+}
+
+ImageWriter::ImageWriter() :
+    m_stopping(false)
+{
+}
+
+ImageWriter::~ImageWriter()
+{
+    if (!m_thread.joinable())
+        return;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void ImageWriter::write(const string &path, Image &image)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_jobs.push_back(Job());
+        m_jobs.back().path = path;
+        m_jobs.back().image.width = image.width;
+        m_jobs.back().image.height = image.height;
+        m_jobs.back().image.pixels.swap(image.pixels);
+    }
+
+    // Start the thread with the first image.
+    if (!m_thread.joinable())
+        m_thread = thread(writeLoop, this);
+
+    m_wake.notify_one();
+}
+
+void ImageWriter::writeLoop(ImageWriter *writer)
+{
+    unique_lock<mutex> lock(writer->m_mutex);
+
+    for (;;)
+    {
+        while (writer->m_jobs.empty() && !writer->m_stopping)
+            writer->m_wake.wait(lock);
+
+        // Only stop once everything queued has been written.
+        if (writer->m_jobs.empty())
+            return;
+
+        Job job;
+        job.path.swap(writer->m_jobs.front().path);
+        job.image.width = writer->m_jobs.front().image.width;
+        job.image.height = writer->m_jobs.front().image.height;
+        job.image.pixels.swap(writer->m_jobs.front().image.pixels);
+        writer->m_jobs.pop_front();
+
+        // Encode without holding up the frames queueing more images.
+        lock.unlock();
+        if (!writePng(job.path, job.image))
+            cerr << "Could not write image " << job.path << "." << endl;
+        lock.lock();
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "PixelReadback.h"
+
+// Writes an image as an RGB PNG file, dropping alpha and flipping it top row first.
+// Returns false if the file cannot be written.
+bool writePng(const std::string &path, const Image &image);
+
+// Encodes and writes PNG files on a worker thread, so saving never holds up a frame.
+class ImageWriter
+{
+public:
+
+    ImageWriter();
+
+    // Finishes writing every queued image.
+    ~ImageWriter();
+
+    // Queues an image to be written, taking its pixels.
+    void write(const std::string &path, Image &image);
+
+private:
+
+    struct Job
+    {
+        std::string path;
+        Image image;
+    };
+
+    static void writeLoop(ImageWriter *writer);
+
+    std::thread m_thread;
+
+    // Guards everything below, which is shared with the writing thread.
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Job> m_jobs;
+    bool m_stopping;
+};
+
+#endif // IMAGE_WRITER_H
@@ -0,0 +1,169 @@
+#include "InstancedMesh.h"
+#include "GLStateCache.h"
+#include "Frustum.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // Lights each vertex the way fixed-function GL_LIGHT0 does, after applying the
+    // instance transform, so instanced copies match the single mesh.
+    const char *instanceVertexShader =
+        "#version 120\n"
+        "attribute vec3 position;\n"
+        "attribute vec3 normal;\n"
+        "attribute mat4 instance;\n"
+        "varying vec4 color;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 eye = gl_ModelViewMatrix * (instance * vec4(position, 1.0));\n"
+        "    vec3 n = normalize(gl_NormalMatrix * (mat3(instance) * normal));\n"
+        "    vec4 light = gl_LightSource[0].position;\n"
+        "    vec3 l = normalize(light.xyz - eye.xyz * light.w);\n"
+        "    vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+        "    float diffuse = max(dot(n, l), 0.0);\n"
+        "    float specular = diffuse > 0.0 ? pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+        "    color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient\n"
+        "        + diffuse * gl_FrontLightProduct[0].diffuse + specular * gl_FrontLightProduct[0].specular;\n"
+        "    color.a = gl_FrontMaterial.diffuse.a;\n"
+        "    gl_Position = gl_ProjectionMatrix * eye;\n"
+        "}\n";
+
+    const char *instanceFragmentShader =
+        "#version 120\n"
+        "varying vec4 color;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor = color;\n"
+        "}\n";
+
+    // Attribute names in location order.
+    const char *instanceAttributes[] = { "position", "normal", "instance", NULL };
+}
+
+InstancedMesh::InstancedMesh() :
+    m_instanceBuffer(0),
+    m_instanceCapacity(0),
+    m_fallbackList(0),
+    m_center(Vector3f::ZERO),
+    m_radius(0),
+    m_drawCalls(0)
+{
+}
+
+void InstancedMesh::create(const IndexedMesh &mesh, GLuint fallbackList, const Vector3f &fallbackCenter, float fallbackRadius)
+{
+    m_fallbackList = fallbackList;
+    m_center = fallbackCenter;
+    m_radius = fallbackRadius;
+
+    // Instanced arrays need OpenGL 3.3.
+    if (mesh.empty() || !glVersionAtLeast(3, 3))
+        return;
+
+    if (!m_program.create(instanceVertexShader, instanceFragmentShader, instanceAttributes))
+        return;
+
+    m_mesh.create(mesh);
+    m_center = mesh.center;
+    m_radius = mesh.radius;
+
+    glGenBuffers(1, &m_instanceBuffer);
+}
+
+void InstancedMesh::setInstances(const vector<Matrix4f> &transforms)
+{
+    m_transforms.resize(transforms.size() * 16);
+    m_bounds.resize(transforms.size());
+
+    for (size_t i = 0; i < transforms.size(); i++)
+    {
+        Matrix4f m = transforms[i];
+        memcpy(&m_transforms[i * 16], (float *)m, 16 * sizeof(float));
+
+        // The sphere grows with the largest axis scale of the transform.
+        float scale = max(m.getCol(0).xyz().abs(), max(m.getCol(1).xyz().abs(), m.getCol(2).xyz().abs()));
+        Vector4f center = m * Vector4f(m_center, 1);
+        m_bounds[i] = Vector4f(center.xyz(), m_radius * scale);
+    }
+}
+
+void InstancedMesh::draw()
+{
+    Frustum frustum(currentClipMatrix());
+
+    // Pack the transforms of every instance the camera can see.
+    m_visible.clear();
+    for (size_t i = 0; i < m_bounds.size(); i++)
+    {
+        if (frustum.intersectsSphere(m_bounds[i].xyz(), m_bounds[i][3]))
+            m_visible.insert(m_visible.end(), &m_transforms[i * 16], &m_transforms[i * 16] + 16);
+    }
+
+    m_drawCalls = 0;
+    if (m_visible.empty())
+        return;
+
+    // Without instancing support, draw each visible copy on its own.
+    if (m_mesh.empty())
+    {
+        for (size_t i = 0; i < m_visible.size(); i += 16)
+        {
+            glPushMatrix();
+            glMultMatrixf(&m_visible[i]);
+            glCallList(m_fallbackList);
+            glPopMatrix();
+            m_drawCalls++;
+        }
+        return;
+    }
+
+    // Orphan the instance buffer so we never wait on the previous frame's draw.
+    GLsizeiptr size = m_visible.size() * sizeof(float);
+    m_instanceCapacity = max(m_instanceCapacity, size);
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, &m_visible[0]);
+
+    m_program.use();
+    m_mesh.bind();
+
+    // One attribute per transform column, advancing once per instance.
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    for (int c = 0; c < 4; c++)
+    {
+        glEnableVertexAttribArray(ATTRIB_INSTANCE + c);
+        glVertexAttribPointer(ATTRIB_INSTANCE + c, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (const GLvoid *)(c * 4 * sizeof(float)));
+        glVertexAttribDivisor(ATTRIB_INSTANCE + c, 1);
+    }
+
+    glDrawElementsInstanced(GL_TRIANGLES, m_mesh.indexCount(), GL_UNSIGNED_INT, (const GLvoid *)0, (GLsizei)(m_visible.size() / 16));
+    m_drawCalls++;
+
+    for (int c = 0; c < 4; c++)
+    {
+        glVertexAttribDivisor(ATTRIB_INSTANCE + c, 0);
+        glDisableVertexAttribArray(ATTRIB_INSTANCE + c);
+    }
+
+    m_mesh.unbind();
+    glState.useProgram(0);
+}
+
+unsigned InstancedMesh::instanceCount() const
+{
+    return (unsigned)m_bounds.size();
+}
+
+unsigned InstancedMesh::visibleCount() const
+{
+    return (unsigned)(m_visible.size() / 16);
+}
+
+unsigned InstancedMesh::drawCalls() const
+{
+    return m_drawCalls;
+}
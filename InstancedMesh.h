@@ -0,0 +1,59 @@
+#ifndef INSTANCED_MESH_H
+#define INSTANCED_MESH_H
+
+#include <vector>
+#include "MeshBuffer.h"
+#include "Shader.h"
+
+// First of the four attribute locations holding an instance's transform columns.
+#define ATTRIB_INSTANCE 2
+
+// Draws many copies of one mesh with a single instanced draw call. Instances
+// outside the view frustum are culled on the CPU before their transforms are
+// packed into the instance buffer.
+class InstancedMesh
+{
+public:
+
+    InstancedMesh();
+
+    // Uploads the mesh and compiles the instancing shader. If the mesh is empty or
+    // instancing is unsupported, instances are drawn one by one with the fallback list,
+    // whose geometry must fit in the given bounding sphere.
+    void create(const IndexedMesh &mesh, GLuint fallbackList, const Vector3f &fallbackCenter, float fallbackRadius);
+
+    // Replaces every instance transform.
+    void setInstances(const std::vector<Matrix4f> &transforms);
+
+    // Culls against the current GL view and draws the visible instances with the
+    // current material and lights.
+    void draw();
+
+    unsigned instanceCount() const;
+    unsigned visibleCount() const;
+    unsigned drawCalls() const;
+
+private:
+
+    MeshBuffer m_mesh;
+    ShaderProgram m_program;
+    GLuint m_instanceBuffer;
+    GLsizeiptr m_instanceCapacity;
+
+    GLuint m_fallbackList;
+    Vector3f m_center;
+    float m_radius;
+
+    // Column-major transforms, sixteen floats per instance.
+    std::vector<float> m_transforms;
+
+    // World-space bounding sphere (x, y, z, radius) of each instance.
+    std::vector<Vector4f> m_bounds;
+
+    // Transforms of the instances that survived culling this frame.
+    std::vector<float> m_visible;
+
+    unsigned m_drawCalls;
+};
+
+#endif // INSTANCED_MESH_H
@@ -0,0 +1,112 @@
+#include "InteractionLod.h"
+
+using namespace std;
+
+InteractionLod::InteractionLod() :
+    m_built(false),
+    m_list(0),
+    m_enabled(true),
+    m_moving(false),
+    m_idleMilliseconds(INTERACTION_IDLE_MILLISECONDS)
+{
+}
+
+InteractionLod::~InteractionLod()
+{
+    if (m_builder.joinable())
+        m_builder.join();
+}
+
+void InteractionLod::build(const vector<Vector3f> &positions, const vector<Vector3f> &normals,
+    const vector<vector<unsigned> > &faces)
+{
+    if (faces.size() < 2 * INTERACTION_PROXY_FACES)
+        return;
+
+    // The thread simplifies its own copy, so the caller's mesh may change meanwhile.
+    m_positions = positions;
+    m_normals = normals;
+    m_faces = faces;
+    m_builder = thread(buildLoop, this);
+}
+
+void InteractionLod::buildLoop(InteractionLod *lod)
+{
+    lod->m_proxy.build(lod->m_positions, lod->m_normals, lod->m_faces, INTERACTION_PROXY_FACES);
+    lod->m_proxy.setLevel(0);
+
+    // Free the copy.
+    vector<Vector3f>().swap(lod->m_positions);
+    vector<Vector3f>().swap(lod->m_normals);
+    vector<vector<unsigned> >().swap(lod->m_faces);
+
+    lod->m_built = true;
+}
+
+bool InteractionLod::receive(bool barycentric)
+{
+    if (m_list || !m_built)
+        return false;
+
+    m_builder.join();
+
+    m_list = glGenLists(1);
+    glNewList(m_list, GL_COMPILE);
+    m_proxy.render(barycentric);
+    glEndList();
+
+    return true;
+}
+
+void InteractionLod::interact()
+{
+    m_moving = true;
+    m_lastInteraction = chrono::steady_clock::now();
+}
+
+bool InteractionLod::settle()
+{
+    if (!m_moving || active())
+        return false;
+
+    m_moving = false;
+    return m_list != 0;
+}
+
+bool InteractionLod::active() const
+{
+    if (!m_enabled || !m_list || !m_moving)
+        return false;
+
+    return chrono::steady_clock::now() - m_lastInteraction < chrono::milliseconds(m_idleMilliseconds);
+}
+
+void InteractionLod::draw() const
+{
+    glCallList(m_list);
+}
+
+void InteractionLod::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool InteractionLod::enabled() const
+{
+    return m_enabled;
+}
+
+void InteractionLod::setIdleMilliseconds(int milliseconds)
+{
+    m_idleMilliseconds = milliseconds;
+}
+
+bool InteractionLod::ready() const
+{
+    return m_list != 0;
+}
+
+unsigned InteractionLod::faceCount() const
+{
+    return m_list ? m_proxy.faceCount() : 0;
+}
@@ -0,0 +1,78 @@
+#ifndef INTERACTION_LOD_H
+#define INTERACTION_LOD_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "vecmath.h"
+#include "GLExtensions.h"
+#include "ProgressiveMesh.h"
+
+// Triangles kept in the coarse proxy drawn while the view moves.
+#define INTERACTION_PROXY_FACES 4000
+
+// Milliseconds without input or spinning before the full mesh is drawn again.
+#define INTERACTION_IDLE_MILLISECONDS 250
+
+// Draws a coarse proxy of the mesh while the view is being dragged, zoomed, or spun,
+// so each of those frames costs the same whatever the mesh's size, and the full mesh
+// once the view has been still for a while. The proxy is simplified on a background
+// thread, since that takes seconds on large meshes, and compiled into a display list
+// when it is done.
+class InteractionLod
+{
+public:
+
+    InteractionLod();
+    ~InteractionLod();
+
+    // Starts simplifying an OBJ-style mesh (see loadInput) into the proxy. Meshes too
+    // small to gain from a proxy are left alone.
+    void build(const std::vector<Vector3f> &positions, const std::vector<Vector3f> &normals,
+        const std::vector<std::vector<unsigned> > &faces);
+
+    // Compiles the proxy once it has been simplified, with each corner's barycentric
+    // coordinate for the wireframe if asked. Returns true when it does.
+    bool receive(bool barycentric);
+
+    // Notes input or animation that moves the view.
+    void interact();
+
+    // Returns true once when the view has just come to rest after moving, which is
+    // when the full mesh needs drawing again.
+    bool settle();
+
+    // Determines whether the proxy should be drawn instead of the full mesh now.
+    bool active() const;
+
+    void draw() const;
+
+    void setEnabled(bool enabled);
+    bool enabled() const;
+
+    void setIdleMilliseconds(int milliseconds);
+
+    bool ready() const;
+    unsigned faceCount() const;
+
+private:
+
+    static void buildLoop(InteractionLod *lod);
+
+    // The mesh being simplified, and the proxy, which belong to the thread until built.
+    std::vector<Vector3f> m_positions;
+    std::vector<Vector3f> m_normals;
+    std::vector<std::vector<unsigned> > m_faces;
+    ProgressiveMesh m_proxy;
+    std::thread m_builder;
+    std::atomic<bool> m_built;
+
+    GLuint m_list;
+    bool m_enabled;
+    bool m_moving;
+    int m_idleMilliseconds;
+    std::chrono::steady_clock::time_point m_lastInteraction;
+};
+
+#endif // INTERACTION_LOD_H
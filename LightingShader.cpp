@@ -0,0 +1,347 @@
+#include "LightingShader.h"
+#include "GLStateCache.h"
+#include <cstring>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+    // Follows the occlusion, barycentric, and color attributes' locations. The
+    // position is invariant so that it lands on the depth pre-pass's exactly.
+    const char *lightingVertexShader =
+        "layout(location = ATTRIB_OCCLUSION) in float occlusion;\n"
+        "layout(location = ATTRIB_BARYCENTRIC) in vec3 barycentric;\n"
+        "layout(location = ATTRIB_COLOR) in vec4 color;\n"
+        "out vec3 eyePosition;\n"
+        "out vec3 eyeNormal;\n"
+        "out float vertexOcclusion;\n"
+        "out vec3 vertexBarycentric;\n"
+        "out vec4 vertexColor;\n"
+        "invariant gl_Position;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+        "    eyePosition = eye.xyz;\n"
+        "    eyeNormal = gl_NormalMatrix * gl_Normal;\n"
+        "    vertexOcclusion = occlusion;\n"
+        "    vertexBarycentric = barycentric;\n"
+        "    vertexColor = color;\n"
+        "    gl_Position = gl_ProjectionMatrix * eye;\n"
+        "}\n";
+
+    const char *lightingFragmentHeader =
+        "layout(std140) uniform Lighting\n"
+        "{\n"
+        "    vec4 lightPosition;\n"
+        "    vec4 lightDiffuse;\n"
+        "    vec4 lightSpecular;\n"
+        "    vec4 sceneAmbient;\n"
+        "    vec4 materialDiffuse;\n"
+        "    vec4 materialSpecular;\n"
+        "    float shininess;\n"
+        "    mat4 shadowMatrix;\n"
+        "    float shadowEnabled;\n"
+        "    float shadowTexelSize;\n"
+        "    float environmentEnabled;\n"
+        "    float occlusionStrength;\n"
+        "    vec4 environment[9];\n"
+        "    vec4 wireframeColor;\n"
+        "    float wireframeWidth;\n"
+        "    float blendDepthUnit;\n"
+        "};\n"
+        "uniform sampler2DShadow shadowMap;\n"
+        "in float vertexOcclusion;\n"
+        "in vec3 vertexBarycentric;\n"
+        "in vec4 vertexColor;\n"
+        "layout(location = 0) out vec4 fragColor;\n"
+        "layout(location = 1) out vec4 fragWeight;\n"
+        "\n"
+        "// Percentage-closer filtering: 3 x 3 taps a texel apart, each of which the\n"
+        "// hardware filters between the four nearest depth comparisons.\n"
+        "float shadowFactor(vec3 eyePosition)\n"
+        "{\n"
+        "    if (shadowEnabled == 0.0)\n"
+        "        return 1.0;\n"
+        "\n"
+        "    vec4 coord = shadowMatrix * vec4(eyePosition, 1.0);\n"
+        "    if (coord.w <= 0.0)\n"
+        "        return 1.0;\n"
+        "    coord.xyz /= coord.w;\n"
+        "    if (coord.z >= 1.0)\n"
+        "        return 1.0;\n"
+        "\n"
+        "    float lit = 0.0;\n"
+        "    for (int y = -1; y <= 1; y++)\n"
+        "        for (int x = -1; x <= 1; x++)\n"
+        "            lit += texture(shadowMap, vec3(coord.xy + vec2(x, y) * shadowTexelSize, coord.z));\n"
+        "    return lit / 9.0;\n"
+        "}\n"
+        "\n"
+        "// The environment's irradiance in spherical harmonics, or the constant ambient,\n"
+        "// less what the geometry around the vertex blocks.\n"
+        "vec3 ambientLight(vec3 n)\n"
+        "{\n"
+        "    float open = mix(1.0, vertexOcclusion, occlusionStrength);\n"
+        "    if (environmentEnabled == 0.0)\n"
+        "        return sceneAmbient.rgb * open;\n"
+        "\n"
+        "    vec3 light = environment[0].rgb\n"
+        "        + environment[1].rgb * n.y + environment[2].rgb * n.z + environment[3].rgb * n.x\n"
+        "        + environment[4].rgb * (n.x * n.y) + environment[5].rgb * (n.y * n.z)\n"
+        "        + environment[6].rgb * (3.0 * n.z * n.z - 1.0) + environment[7].rgb * (n.x * n.z)\n"
+        "        + environment[8].rgb * (n.x * n.x - n.y * n.y);\n"
+        "    return max(light, vec3(0.0)) * open;\n"
+        "}\n"
+        "\n"
+        "// Blends the nearest triangle edge over a color. Dividing each barycentric\n"
+        "// coordinate by how fast it changes per pixel gives the distance to that edge\n"
+        "// in pixels; one pixel of falloff antialiases it.\n"
+        "vec3 wireframe(vec3 color)\n"
+        "{\n"
+        "    if (wireframeWidth == 0.0)\n"
+        "        return color;\n"
+        "\n"
+        "    vec3 pixels = vertexBarycentric / fwidth(vertexBarycentric);\n"
+        "    float edge = min(pixels.x, min(pixels.y, pixels.z));\n"
+        "    float coverage = 1.0 - smoothstep(wireframeWidth * 0.5 - 0.5, wireframeWidth * 0.5 + 0.5, edge);\n"
+        "    return mix(color, wireframeColor.rgb, coverage * wireframeColor.a);\n"
+        "}\n"
+        "\n"
+        "// Writes a shaded color, or its share of a weighted blended transparency pass:\n"
+        "// the color premultiplied by its coverage and a weight that falls off with\n"
+        "// depth, the coverage in alpha, and the weighted coverage to the second target.\n"
+        "void writeColor(vec3 color, float alpha, vec3 eyePosition)\n"
+        "{\n"
+        "    if (blendDepthUnit == 0.0)\n"
+        "    {\n"
+        "        fragColor = vec4(color, alpha);\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    float depth = max(-eyePosition.z, 0.0) / blendDepthUnit;\n"
+        "    float far = depth / 200.0;\n"
+        "    float weight = alpha * clamp(10.0 / (1e-5 + depth * depth / 25.0 + far * far * far * far * far * far), 1e-2, 3e3);\n"
+        "    fragColor = vec4(color * weight, alpha);\n"
+        "    fragWeight = vec4(weight);\n"
+        "}\n";
+
+    const char *lightingFragmentShader =
+        "in vec3 eyePosition;\n"
+        "in vec3 eyeNormal;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 n = normalize(eyeNormal);\n"
+        "    vec3 l = normalize(lightPosition.xyz - eyePosition * lightPosition.w);\n"
+        "    // Fixed-function lighting has no local viewer: the eye looks down -z from afar.\n"
+        "    vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+        "    float shadow = shadowFactor(eyePosition);\n"
+        "    float diffuse = max(dot(n, l), 0.0) * shadow;\n"
+        "    float specular = diffuse > 0.0 ? pow(max(dot(n, h), 0.0), shininess) * shadow : 0.0;\n"
+        "    vec4 diffuseColor = materialDiffuse * vertexColor;\n"
+        "    vec3 color = diffuseColor.rgb * (ambientLight(n) + diffuse * lightDiffuse.rgb)\n"
+        "        + specular * materialSpecular.rgb * lightSpecular.rgb;\n"
+        "    writeColor(wireframe(color), diffuseColor.a, eyePosition);\n"
+        "}\n";
+
+    void copyVector(float *destination, const Vector4f &v)
+    {
+        for (int i = 0; i < 4; i++)
+            destination[i] = v[i];
+    }
+}
+
+LightingShader::LightingShader() :
+    m_uniformBuffer(0),
+    m_dirty(true)
+{
+    memset(&m_block, 0, sizeof(m_block));
+
+    // Match the fixed-function defaults until told otherwise.
+    setAmbient(Vector4f(0.2f, 0.2f, 0.2f, 1));
+}
+
+bool LightingShader::create()
+{
+    // Uniform blocks need OpenGL 3.1; the shaders are written against 3.3.
+    if (!glVersionAtLeast(3, 3))
+        return false;
+
+    ostringstream vertexSource;
+    vertexSource << "#version 330 compatibility\n"
+        << "#define ATTRIB_OCCLUSION " << ATTRIB_OCCLUSION << "\n"
+        << "#define ATTRIB_BARYCENTRIC " << ATTRIB_BARYCENTRIC << "\n"
+        << "#define ATTRIB_COLOR " << ATTRIB_COLOR << "\n"
+        << lightingVertexShader;
+
+    string fragmentSource = string("#version 330 compatibility\n") + lightingFragmentHeader + lightingFragmentShader;
+    if (!m_program.create(vertexSource.str().c_str(), fragmentSource.c_str(), NULL))
+        return false;
+
+    m_program.bindUniformBlock("Lighting", LIGHTING_BLOCK_BINDING);
+
+    m_program.use();
+    glUniform1i(m_program.uniform("shadowMap"), SHADOW_TEXTURE_UNIT);
+    glState.useProgram(0);
+
+    // Vertices given no occlusion are open, those given no barycentric
+    // coordinates are as far from every edge as they can be, and those given no
+    // color are white.
+    glVertexAttrib1f(ATTRIB_OCCLUSION, 1);
+    glVertexAttrib3f(ATTRIB_BARYCENTRIC, 1, 1, 1);
+    glVertexAttrib4f(ATTRIB_COLOR, 1, 1, 1, 1);
+
+    glGenBuffers(1, &m_uniformBuffer);
+    glState.bindBuffer(GL_UNIFORM_BUFFER, m_uniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(m_block), &m_block, GL_DYNAMIC_DRAW);
+    glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    m_dirty = false;
+    return true;
+}
+
+void LightingShader::setLight(const Vector4f &eyePosition, const Vector4f &diffuse, const Vector4f &specular)
+{
+    LightingBlock block = m_block;
+    copyVector(block.lightPosition, eyePosition);
+    copyVector(block.lightDiffuse, diffuse);
+    copyVector(block.lightSpecular, specular);
+
+    setBlock(block);
+}
+
+void LightingShader::setAmbient(const Vector4f &ambient)
+{
+    LightingBlock block = m_block;
+    copyVector(block.sceneAmbient, ambient);
+
+    setBlock(block);
+}
+
+void LightingShader::setMaterial(const Vector4f &diffuse, const Vector4f &specular, float shininess)
+{
+    LightingBlock block = m_block;
+    copyVector(block.materialDiffuse, diffuse);
+    copyVector(block.materialSpecular, specular);
+    block.shininess = shininess;
+
+    setBlock(block);
+}
+
+void LightingShader::setShadow(const Matrix4f &eyeToShadow, float texelSize)
+{
+    // The matrix converts to column-major floats, which std140 expects too.
+    Matrix4f matrix = eyeToShadow;
+    LightingBlock block = m_block;
+    memcpy(block.shadowMatrix, (float *)matrix, sizeof(block.shadowMatrix));
+    block.shadowEnabled = 1;
+    block.shadowTexelSize = texelSize;
+
+    setBlock(block);
+}
+
+void LightingShader::clearShadow()
+{
+    LightingBlock block = m_block;
+    block.shadowEnabled = 0;
+
+    setBlock(block);
+}
+
+void LightingShader::setEnvironment(const Vector3f coefficients[SH_COEFFICIENTS])
+{
+    LightingBlock block = m_block;
+    for (int i = 0; i < SH_COEFFICIENTS; i++)
+    {
+        for (int k = 0; k < 3; k++)
+            block.environment[i][k] = coefficients[i][k];
+    }
+    block.environmentEnabled = 1;
+
+    setBlock(block);
+}
+
+void LightingShader::clearEnvironment()
+{
+    LightingBlock block = m_block;
+    block.environmentEnabled = 0;
+
+    setBlock(block);
+}
+
+void LightingShader::setOcclusionStrength(float strength)
+{
+    LightingBlock block = m_block;
+    block.occlusionStrength = strength;
+
+    setBlock(block);
+}
+
+void LightingShader::setWeightedBlending(float depthUnit)
+{
+    LightingBlock block = m_block;
+    block.blendDepthUnit = depthUnit;
+
+    setBlock(block);
+}
+
+void LightingShader::clearWeightedBlending()
+{
+    LightingBlock block = m_block;
+    block.blendDepthUnit = 0;
+
+    setBlock(block);
+}
+
+void LightingShader::setWireframe(float width, const Vector4f &color)
+{
+    LightingBlock block = m_block;
+    block.wireframeWidth = width;
+    copyVector(block.wireframeColor, color);
+
+    setBlock(block);
+}
+
+const char *LightingShader::fragmentHeader()
+{
+    return lightingFragmentHeader;
+}
+
+void LightingShader::setBlock(const LightingBlock &block)
+{
+    if (memcmp(&block, &m_block, sizeof(block)) != 0)
+    {
+        m_block = block;
+        m_dirty = true;
+    }
+}
+
+void LightingShader::bindBlock()
+{
+    if (m_dirty)
+    {
+        glState.bindBuffer(GL_UNIFORM_BUFFER, m_uniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(m_block), &m_block);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        m_dirty = false;
+    }
+
+    glState.bindBufferBase(GL_UNIFORM_BUFFER, LIGHTING_BLOCK_BINDING, m_uniformBuffer);
+}
+
+void LightingShader::begin()
+{
+    bindBlock();
+    m_program.use();
+}
+
+void LightingShader::end()
+{
+    glState.useProgram(0);
+}
+
+bool LightingShader::valid() const
+{
+    return m_program.valid();
+}
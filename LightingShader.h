@@ -0,0 +1,142 @@
+#ifndef LIGHTING_SHADER_H
+#define LIGHTING_SHADER_H
+
+#include "Shader.h"
+#include "vecmath.h"
+#include "EnvironmentLighting.h"
+
+// Uniform buffer binding point of the lighting block.
+#define LIGHTING_BLOCK_BINDING 0
+
+// Texture unit the main light's shadow map is read from.
+#define SHADOW_TEXTURE_UNIT 4
+
+// Generic vertex attribute the lighting shaders read each vertex's ambient occlusion
+// from. Geometry without it is left open.
+#define ATTRIB_OCCLUSION 6
+
+// Generic vertex attribute giving each corner of a triangle its own barycentric
+// coordinate, for drawing the triangle's edges. Geometry without it has no edges.
+#define ATTRIB_BARYCENTRIC 7
+
+// Generic vertex attribute the lighting shaders tint the material's diffuse color
+// by, for coloring each vertex. Geometry without it is white.
+#define ATTRIB_COLOR 8
+
+// The default width of wireframe edges in pixels.
+#define WIREFRAME_WIDTH 1.5f
+
+// Per-pixel Blinn-Phong lighting of the mesh, replacing fixed-function GL_LIGHT0.
+// Geometry still comes from the usual glVertex/glNormal or client array calls, so
+// the same display lists and vertex arrays can be drawn either way. Light and
+// material values live in a uniform block that is uploaded once per change.
+class LightingShader
+{
+public:
+
+    LightingShader();
+
+    // Compiles the program and creates the uniform buffer. Returns false if the
+    // context is too old, in which case fixed-function lighting must be used.
+    bool create();
+
+    // Sets the light position in eye coordinates and its diffuse and specular colors.
+    void setLight(const Vector4f &eyePosition, const Vector4f &diffuse, const Vector4f &specular);
+
+    // Sets the global ambient light.
+    void setAmbient(const Vector4f &ambient);
+
+    // Sets the material, whose ambient color is its diffuse color.
+    void setMaterial(const Vector4f &diffuse, const Vector4f &specular, float shininess);
+
+    // Shadows the main light with the depth map bound to SHADOW_TEXTURE_UNIT, given
+    // the matrix taking eye coordinates to map coordinates and the map's texel size.
+    void setShadow(const Matrix4f &eyeToShadow, float texelSize);
+
+    // Stops shadowing the main light.
+    void clearShadow();
+
+    // Replaces the ambient light with irradiance from an environment, given its
+    // coefficients in eye coordinates (see EnvironmentLighting::irradiance).
+    void setEnvironment(const Vector3f coefficients[SH_COEFFICIENTS]);
+
+    // Goes back to the constant ambient light.
+    void clearEnvironment();
+
+    // Sets how much the ambient occlusion of each vertex darkens its ambient light,
+    // from 0 (not at all) to 1.
+    void setOcclusionStrength(float strength);
+
+    // Writes each fragment's share of a weighted blended transparency pass instead of
+    // its color (see Transparency), weighting nearer fragments more. Eye distances
+    // are measured in depth units, which should be about the size of what is drawn.
+    void setWeightedBlending(float depthUnit);
+
+    // Goes back to writing colors.
+    void clearWeightedBlending();
+
+    // Draws triangle edges over the shading, antialiased and a constant width in
+    // pixels, or none for a width of 0.
+    void setWireframe(float width, const Vector4f &color);
+
+    // GLSL declaring the lighting block, the shadow map, a shadowFactor(eyePosition)
+    // function giving how much of the main light reaches a point, and an
+    // ambientLight(normal) function giving the ambient light reaching a surface, for
+    // fragment shaders lighting with the same values, a wireframe(color) function
+    // drawing triangle edges over a shaded color, and a writeColor(color, alpha,
+    // eyePosition) function writing the result to the fragColor and fragWeight
+    // outputs it declares. Goes after the #version line, and needs vertexOcclusion,
+    // vertexBarycentric, and vertexColor inputs passing on the ATTRIB_OCCLUSION,
+    // ATTRIB_BARYCENTRIC, and ATTRIB_COLOR attributes. The diffuse color to light
+    // with is materialDiffuse times vertexColor.
+    static const char *fragmentHeader();
+
+    // Uploads any changed values and binds the lighting block, for other programs
+    // that light with the same values.
+    void bindBlock();
+
+    // Binds the lighting block and makes the program current.
+    void begin();
+
+    // Restores the fixed-function pipeline.
+    void end();
+
+    bool valid() const;
+
+private:
+
+    // The lighting block, laid out by std140 rules.
+    struct LightingBlock
+    {
+        float lightPosition[4];
+        float lightDiffuse[4];
+        float lightSpecular[4];
+        float sceneAmbient[4];
+        float materialDiffuse[4];
+        float materialSpecular[4];
+        float shininess;
+        float padding[3];
+        float shadowMatrix[16];
+        float shadowEnabled;
+        float shadowTexelSize;
+        float environmentEnabled;
+        float occlusionStrength;
+        float environment[SH_COEFFICIENTS][4];
+        float wireframeColor[4];
+        float wireframeWidth;
+        float blendDepthUnit;
+        float wireframePadding[2];
+    };
+
+    // Replaces the block, marking it for upload if anything changed.
+    void setBlock(const LightingBlock &block);
+
+    ShaderProgram m_program;
+    GLuint m_uniformBuffer;
+    LightingBlock m_block;
+
+    // Whether the block changed since it was last uploaded.
+    bool m_dirty;
+};
+
+#endif // LIGHTING_SHADER_H
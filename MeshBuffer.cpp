@@ -0,0 +1,172 @@
+#include "MeshBuffer.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+using namespace std;
+
+IndexedMesh::IndexedMesh() :
+    center(Vector3f::ZERO),
+    radius(0)
+{
+}
+
+void IndexedMesh::build(const vector<Vector3f> &positions, const vector<Vector3f> &normals,
+    const vector<vector<unsigned> > &faces)
+{
+    vertices.clear();
+    indices.clear();
+    origins.clear();
+    indices.reserve(faces.size() * 3);
+
+    // Maps a (vertex, normal) index pair to its merged vertex.
+    unordered_map<unsigned long long, unsigned> merged;
+
+    for (size_t f = 0; f < faces.size(); f++)
+    {
+        const vector<unsigned> &face = faces[f];
+
+        // Used when the OBJ has no normal for a corner. A face with no area has no
+        // direction, so it gets one that lights it rather than a NaN.
+        Vector3f faceNormal = Vector3f::cross(
+            positions[face[3]] - positions[face[0]],
+            positions[face[6]] - positions[face[0]]);
+        if (faceNormal.abs() > 0)
+            faceNormal.normalize();
+        else
+            faceNormal = Vector3f(0, 0, 1);
+
+        for (int k = 0; k < 9; k += 3)
+        {
+            unsigned v = face[k + 0];
+            unsigned n = face[k + 2];
+            unsigned long long key = ((unsigned long long)v << 32) | n;
+
+            unordered_map<unsigned long long, unsigned>::iterator it = merged.find(key);
+            if (it == merged.end())
+            {
+                MeshVertex vertex;
+                vertex.position = positions[v];
+                vertex.normal = n < normals.size() ? normals[n] : faceNormal;
+
+                it = merged.insert(make_pair(key, (unsigned)vertices.size())).first;
+                vertices.push_back(vertex);
+                origins.push_back(v);
+            }
+
+            indices.push_back(it->second);
+        }
+    }
+
+    computeBounds();
+}
+
+void IndexedMesh::computeBounds()
+{
+    if (vertices.empty())
+    {
+        center = Vector3f::ZERO;
+        radius = 0;
+        return;
+    }
+
+    // Center the sphere on the bounding box, then grow it to fit every vertex.
+    Vector3f lo = vertices[0].position, hi = lo;
+    for (size_t i = 1; i < vertices.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = min(lo[k], vertices[i].position[k]);
+            hi[k] = max(hi[k], vertices[i].position[k]);
+        }
+    }
+
+    center = (lo + hi) * 0.5f;
+
+    float radiusSquared = 0;
+    for (size_t i = 0; i < vertices.size(); i++)
+        radiusSquared = max(radiusSquared, (vertices[i].position - center).absSquared());
+
+    radius = sqrt(radiusSquared);
+}
+
+bool IndexedMesh::empty() const
+{
+    return indices.empty();
+}
+
+MeshBuffer::MeshBuffer() :
+    m_vertexBuffer(0),
+    m_indexBuffer(0),
+    m_indexCount(0)
+{
+}
+
+void MeshBuffer::create(const IndexedMesh &mesh)
+{
+    destroy();
+
+    if (mesh.empty())
+        return;
+
+    glGenBuffers(1, &m_vertexBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(MeshVertex), &mesh.vertices[0], GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &m_indexBuffer);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned), &mesh.indices[0], GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    m_indexCount = (GLsizei)mesh.indices.size();
+}
+
+void MeshBuffer::destroy()
+{
+    if (m_vertexBuffer)
+        glState.deleteBuffers(1, &m_vertexBuffer);
+    if (m_indexBuffer)
+        glState.deleteBuffers(1, &m_indexBuffer);
+
+    m_vertexBuffer = 0;
+    m_indexBuffer = 0;
+    m_indexCount = 0;
+}
+
+void MeshBuffer::bind() const
+{
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const GLvoid *)0);
+
+    glEnableVertexAttribArray(ATTRIB_NORMAL);
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const GLvoid *)sizeof(Vector3f));
+}
+
+void MeshBuffer::unbind() const
+{
+    glDisableVertexAttribArray(ATTRIB_NORMAL);
+    glDisableVertexAttribArray(ATTRIB_POSITION);
+
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffer::draw() const
+{
+    glDrawElements(GL_TRIANGLES, m_indexCount, GL_UNSIGNED_INT, (const GLvoid *)0);
+}
+
+GLsizei MeshBuffer::indexCount() const
+{
+    return m_indexCount;
+}
+
+bool MeshBuffer::empty() const
+{
+    return m_indexCount == 0;
+}
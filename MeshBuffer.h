@@ -0,0 +1,74 @@
+#ifndef MESH_BUFFER_H
+#define MESH_BUFFER_H
+
+#include <vector>
+#include "GLExtensions.h"
+#include "vecmath.h"
+
+// Vertex attribute locations shared by every mesh shader.
+#define ATTRIB_POSITION 0
+#define ATTRIB_NORMAL   1
+
+// Interleaved vertex layout of every buffered mesh.
+struct MeshVertex
+{
+    Vector3f position;
+    Vector3f normal;
+};
+
+// An indexed triangle mesh on the CPU.
+struct IndexedMesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<unsigned> indices;
+
+    // The OBJ vertex each vertex was built from, for values given per OBJ vertex.
+    std::vector<unsigned> origins;
+
+    // Bounding sphere of the vertices.
+    Vector3f center;
+    float radius;
+
+    IndexedMesh();
+
+    // Builds from OBJ-style lists (see loadInput), merging corners that share
+    // both a vertex and a normal.
+    void build(const std::vector<Vector3f> &positions, const std::vector<Vector3f> &normals,
+        const std::vector<std::vector<unsigned> > &faces);
+
+    // Recomputes the bounding sphere from the vertices.
+    void computeBounds();
+
+    bool empty() const;
+};
+
+// An indexed mesh uploaded to a vertex and an index buffer.
+class MeshBuffer
+{
+public:
+
+    MeshBuffer();
+
+    void create(const IndexedMesh &mesh);
+    void destroy();
+
+    // Binds the buffers and points the position and normal attributes at them.
+    void bind() const;
+
+    // Unbinds the buffers and disables the attributes.
+    void unbind() const;
+
+    // Draws every triangle. The buffers must be bound.
+    void draw() const;
+
+    GLsizei indexCount() const;
+    bool empty() const;
+
+private:
+
+    GLuint m_vertexBuffer;
+    GLuint m_indexBuffer;
+    GLsizei m_indexCount;
+};
+
+#endif // MESH_BUFFER_H
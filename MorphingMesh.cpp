@@ -0,0 +1,117 @@
+#include "MorphingMesh.h"
+#include "GLStateCache.h"
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    const float PI = 3.14159265358979f;
+}
+
+MorphingMesh::MorphingMesh() :
+    m_indexBuffer(0),
+    m_updateMilliseconds(0)
+{
+}
+
+void MorphingMesh::destroy()
+{
+    if (m_indexBuffer)
+        glState.deleteBuffers(1, &m_indexBuffer);
+
+    m_indexBuffer = 0;
+    m_stream.destroy();
+}
+
+bool MorphingMesh::create(const vector<Vector3f> &positions, const vector<Vector3f> &normals,
+    const vector<vector<unsigned> > &faces)
+{
+    m_mesh.build(positions, normals, faces);
+    if (m_mesh.empty() || !m_stream.create(m_mesh.vertices.size() * sizeof(MeshVertex)))
+        return false;
+
+    glGenBuffers(1, &m_indexBuffer);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_mesh.indices.size() * sizeof(unsigned), &m_mesh.indices[0], GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return true;
+}
+
+void MorphingMesh::update(float phase)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Rings of crests travel up the mesh. The vertices are read as the plain floats GL
+    // sees. The mapped memory may be write-combined, so each float is written once,
+    // in order, and never read back.
+    float *target = (float *)m_stream.map();
+    const float *source = (const float *)&m_mesh.vertices[0];
+    float amplitude = MORPH_AMPLITUDE * m_mesh.radius;
+    float frequency = 2 * PI * MORPH_WAVES / m_mesh.radius;
+    float centerY = m_mesh.center.y();
+
+    size_t count = m_mesh.vertices.size();
+    for (size_t i = 0; i < count; i++, source += 6, target += 6)
+    {
+        float offset = amplitude * sin((source[1] - centerY) * frequency - phase);
+        target[0] = source[0] + source[3] * offset;
+        target[1] = source[1] + source[4] * offset;
+        target[2] = source[2] + source[5] * offset;
+        target[3] = source[3];
+        target[4] = source[4];
+        target[5] = source[5];
+    }
+
+    m_updateMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void MorphingMesh::draw()
+{
+    // Point the fixed-function arrays into this frame's region, which the lighting
+    // shaders read too.
+    const char *region = (const char *)m_stream.offset();
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_stream.id());
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), region);
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), region + sizeof(Vector3f));
+
+    glDrawElements(GL_TRIANGLES, (GLsizei)m_mesh.indices.size(), GL_UNSIGNED_INT, (const GLvoid *)0);
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The region may be written again once this draw is done with it.
+    m_stream.fence();
+}
+
+bool MorphingMesh::valid() const
+{
+    return m_stream.valid();
+}
+
+unsigned MorphingMesh::vertexCount() const
+{
+    return (unsigned)m_mesh.vertices.size();
+}
+
+const StreamBuffer &MorphingMesh::stream() const
+{
+    return m_stream;
+}
+
+void MorphingMesh::resetStatistics()
+{
+    m_stream.resetStatistics();
+}
+
+double MorphingMesh::updateMilliseconds() const
+{
+    return m_updateMilliseconds;
+}
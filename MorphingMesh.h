@@ -0,0 +1,59 @@
+#ifndef MORPHING_MESH_H
+#define MORPHING_MESH_H
+
+#include <vector>
+#include "MeshBuffer.h"
+#include "StreamBuffer.h"
+
+// How far the ripple moves vertices, as a fraction of the mesh's bounding radius.
+#define MORPH_AMPLITUDE 0.03f
+
+// Ripple crests spanning the mesh's bounding radius.
+#define MORPH_WAVES 3.0f
+
+// A mesh whose vertices change every frame, rippling along their normals, as a
+// stand-in for any geometry animated on the CPU. The indices stay in a static
+// buffer; the vertices are written straight into a persistently mapped stream
+// buffer each frame, so nothing is recompiled or copied and the CPU never waits on
+// the draw reading the frame before. Normals are left as they were, which is close
+// enough for small ripples.
+class MorphingMesh
+{
+public:
+
+    MorphingMesh();
+
+    // Indexes an OBJ-style mesh (see loadInput) and creates its buffers. Returns false
+    // if the context cannot stream vertices, in which case the mesh cannot morph.
+    bool create(const std::vector<Vector3f> &positions, const std::vector<Vector3f> &normals,
+        const std::vector<std::vector<unsigned> > &faces);
+
+    // Frees the GL objects, which must happen while the context they were made in
+    // is current.
+    void destroy();
+
+    // Writes the vertices rippled to a phase in radians into the next region.
+    void update(float phase);
+
+    // Draws the vertices last written, with the current lighting, and fences them.
+    void draw();
+
+    bool valid() const;
+    unsigned vertexCount() const;
+
+    // The stream buffer, for its size and how often it stalled.
+    const StreamBuffer &stream() const;
+    void resetStatistics();
+
+    // The CPU time the last update took to write the vertices.
+    double updateMilliseconds() const;
+
+private:
+
+    IndexedMesh m_mesh;
+    StreamBuffer m_stream;
+    GLuint m_indexBuffer;
+    double m_updateMilliseconds;
+};
+
+#endif // MORPHING_MESH_H
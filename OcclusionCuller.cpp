@@ -0,0 +1,423 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLER_SSE2
+#endif
+
+using namespace std;
+
+namespace
+{
+    // The depth the buffer is cleared to: the far plane.
+    const float FAR_DEPTH = 1.0f;
+
+    // A polygon clipped by the near plane has at most one corner more than it had.
+    const int MAX_CLIPPED = 4;
+
+    // Clips a polygon of clip-space (x, y, z, w) corners to the near plane z >= -w.
+    // Returns the corners left.
+    int clipNear(const float *in, int count, float *out)
+    {
+        int kept = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const float *a = in + 4 * i;
+            const float *b = in + 4 * ((i + 1) % count);
+            float da = a[2] + a[3];
+            float db = b[2] + b[3];
+
+            if (da >= 0)
+            {
+                for (int k = 0; k < 4; k++)
+                    out[4 * kept + k] = a[k];
+                kept++;
+            }
+
+            // Add the crossing where the edge passes through the plane.
+            if ((da >= 0) != (db >= 0))
+            {
+                float t = da / (da - db);
+                for (int k = 0; k < 4; k++)
+                    out[4 * kept + k] = a[k] + (b[k] - a[k]) * t;
+                kept++;
+            }
+        }
+
+        return kept;
+    }
+}
+
+OcclusionCuller::OcclusionCuller() :
+    m_triangles(0)
+{
+    for (int i = 0; i < 16; i++)
+        m_clip[i] = 0;
+
+    // Halve the buffer down to a single texel.
+    int width = CULLER_WIDTH, height = CULLER_HEIGHT;
+    while (true)
+    {
+        m_widths.push_back(width);
+        m_heights.push_back(height);
+        m_nearest.push_back(vector<float>((size_t)width * height, FAR_DEPTH));
+        m_farthest.push_back(vector<float>((size_t)width * height, FAR_DEPTH));
+
+        if (width == 1 && height == 1)
+            break;
+        width = max(1, (width + 1) / 2);
+        height = max(1, (height + 1) / 2);
+    }
+}
+
+unsigned OcclusionCuller::addOccluder(const IndexedMesh &mesh)
+{
+    m_occluders.push_back(Occluder());
+    Occluder &occluder = m_occluders.back();
+    if (mesh.empty())
+        return (unsigned)m_occluders.size() - 1;
+
+    // Size the cells by the longest side of the bounding box.
+    Vector3f lo = mesh.vertices[0].position, hi = lo;
+    for (size_t i = 1; i < mesh.vertices.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = min(lo[k], mesh.vertices[i].position[k]);
+            hi[k] = max(hi[k], mesh.vertices[i].position[k]);
+        }
+    }
+
+    Vector3f size = hi - lo;
+    float cell = max(size[0], max(size[1], size[2])) / CULLER_OCCLUDER_GRID;
+    if (cell <= 0)
+        cell = 1;
+
+    // Merge the vertices of each cell into their average.
+    const int cells = CULLER_OCCLUDER_GRID + 1;
+    unordered_map<int, unsigned> merged;
+    vector<unsigned> remap(mesh.vertices.size());
+    vector<float> sums;
+    vector<unsigned> counts;
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const Vector3f &p = mesh.vertices[i].position;
+        int key = 0;
+        for (int k = 0; k < 3; k++)
+            key = key * cells + min((int)((p[k] - lo[k]) / cell), CULLER_OCCLUDER_GRID);
+
+        unordered_map<int, unsigned>::iterator it = merged.find(key);
+        if (it == merged.end())
+        {
+            it = merged.insert(make_pair(key, (unsigned)counts.size())).first;
+            sums.insert(sums.end(), 3, 0.0f);
+            counts.push_back(0);
+        }
+
+        for (int k = 0; k < 3; k++)
+            sums[3 * it->second + k] += p[k];
+        counts[it->second]++;
+        remap[i] = it->second;
+    }
+
+    occluder.positions.resize(sums.size());
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+            occluder.positions[3 * i + k] = sums[3 * i + k] / counts[i];
+    }
+
+    // Keep the triangles whose corners landed in three different cells.
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        unsigned a = remap[mesh.indices[i]];
+        unsigned b = remap[mesh.indices[i + 1]];
+        unsigned c = remap[mesh.indices[i + 2]];
+        if (a != b && b != c && c != a)
+        {
+            occluder.indices.push_back(a);
+            occluder.indices.push_back(b);
+            occluder.indices.push_back(c);
+        }
+    }
+
+    return (unsigned)m_occluders.size() - 1;
+}
+
+void OcclusionCuller::begin(const Matrix4f &clip)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            m_clip[4 * i + j] = clip(i, j);
+    }
+
+    fill(m_nearest[0].begin(), m_nearest[0].end(), FAR_DEPTH);
+    m_triangles = 0;
+}
+
+void OcclusionCuller::rasterize(unsigned occluder, const float *transform)
+{
+    const Occluder &o = m_occluders[occluder];
+    if (o.indices.empty())
+        return;
+
+    // Combine the clip matrix with the column-major transform, row by row.
+    float m[16];
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            m[4 * i + j] = m_clip[4 * i] * transform[4 * j] + m_clip[4 * i + 1] * transform[4 * j + 1]
+                + m_clip[4 * i + 2] * transform[4 * j + 2] + m_clip[4 * i + 3] * transform[4 * j + 3];
+        }
+    }
+
+    // Take every vertex to clip space once.
+    size_t count = o.positions.size() / 3;
+    vector<float> clipped(count * 4);
+    for (size_t v = 0; v < count; v++)
+    {
+        const float *p = &o.positions[3 * v];
+        for (int i = 0; i < 4; i++)
+            clipped[4 * v + i] = m[4 * i] * p[0] + m[4 * i + 1] * p[1] + m[4 * i + 2] * p[2] + m[4 * i + 3];
+    }
+
+    for (size_t t = 0; t < o.indices.size(); t += 3)
+    {
+        const float *corners[3] = { &clipped[4 * o.indices[t]], &clipped[4 * o.indices[t + 1]], &clipped[4 * o.indices[t + 2]] };
+
+        // Skip triangles wholly outside one side of the view.
+        bool outside = false;
+        for (int axis = 0; axis < 2 && !outside; axis++)
+        {
+            outside = (corners[0][axis] > corners[0][3] && corners[1][axis] > corners[1][3] && corners[2][axis] > corners[2][3])
+                || (corners[0][axis] < -corners[0][3] && corners[1][axis] < -corners[1][3] && corners[2][axis] < -corners[2][3]);
+        }
+        if (outside)
+            continue;
+
+        // Cut off whatever is in front of the near plane, then project to the buffer.
+        float polygon[4 * 3];
+        float cut[4 * MAX_CLIPPED];
+        for (int c = 0; c < 3; c++)
+        {
+            for (int k = 0; k < 4; k++)
+                polygon[4 * c + k] = corners[c][k];
+        }
+
+        int kept = clipNear(polygon, 3, cut);
+        if (kept < 3)
+            continue;
+
+        float screen[3 * MAX_CLIPPED];
+        for (int c = 0; c < kept; c++)
+        {
+            float inverse = 1.0f / cut[4 * c + 3];
+            screen[3 * c + 0] = (cut[4 * c + 0] * inverse * 0.5f + 0.5f) * CULLER_WIDTH;
+            screen[3 * c + 1] = (cut[4 * c + 1] * inverse * 0.5f + 0.5f) * CULLER_HEIGHT;
+            screen[3 * c + 2] = cut[4 * c + 2] * inverse;
+        }
+
+        for (int c = 2; c < kept; c++)
+            fillTriangle(screen, screen + 3 * (c - 1), screen + 3 * c);
+    }
+}
+
+void OcclusionCuller::fillTriangle(const float *a, const float *b, const float *c)
+{
+    // Both sides are filled, so either winding is turned counterclockwise.
+    float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    if (area == 0)
+        return;
+    if (area < 0)
+    {
+        swap(b, c);
+        area = -area;
+    }
+
+    int minX = max((int)floor(min(a[0], min(b[0], c[0]))), 0);
+    int maxX = min((int)ceil(max(a[0], max(b[0], c[0]))), CULLER_WIDTH - 1);
+    int minY = max((int)floor(min(a[1], min(b[1], c[1]))), 0);
+    int maxY = min((int)ceil(max(a[1], max(b[1], c[1]))), CULLER_HEIGHT - 1);
+    if (minX > maxX || minY > maxY)
+        return;
+
+    m_triangles++;
+
+    // Edge functions, positive inside: the edge opposite each corner, scaled so the
+    // three sum to the area. Depth is their blend of the corner depths.
+    float edgeX[3] = { b[1] - c[1], c[1] - a[1], a[1] - b[1] };
+    float edgeY[3] = { c[0] - b[0], a[0] - c[0], b[0] - a[0] };
+    float edgeC[3] = { b[0] * c[1] - b[1] * c[0], c[0] * a[1] - c[1] * a[0], a[0] * b[1] - a[1] * b[0] };
+    float inverseArea = 1.0f / area;
+    float depthX = (edgeX[0] * a[2] + edgeX[1] * b[2] + edgeX[2] * c[2]) * inverseArea;
+    float depthY = (edgeY[0] * a[2] + edgeY[1] * b[2] + edgeY[2] * c[2]) * inverseArea;
+    float depthC = (edgeC[0] * a[2] + edgeC[1] * b[2] + edgeC[2] * c[2]) * inverseArea;
+
+    // Start rows on a group of four, which the buffer width is a multiple of.
+    minX &= ~3;
+    float *depth = &m_nearest[0][0];
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        float py = y + 0.5f;
+        float *row = depth + (size_t)y * CULLER_WIDTH;
+
+#ifdef CULLER_SSE2
+        // Four pixels at a time: every edge and the depth step by four x per group.
+        __m128 e0 = _mm_set1_ps(edgeY[0] * py + edgeC[0]);
+        __m128 e1 = _mm_set1_ps(edgeY[1] * py + edgeC[1]);
+        __m128 e2 = _mm_set1_ps(edgeY[2] * py + edgeC[2]);
+        __m128 z = _mm_set1_ps(depthY * py + depthC);
+        __m128 px = _mm_add_ps(_mm_set1_ps(minX + 0.5f), _mm_set_ps(3, 2, 1, 0));
+        e0 = _mm_add_ps(e0, _mm_mul_ps(_mm_set1_ps(edgeX[0]), px));
+        e1 = _mm_add_ps(e1, _mm_mul_ps(_mm_set1_ps(edgeX[1]), px));
+        e2 = _mm_add_ps(e2, _mm_mul_ps(_mm_set1_ps(edgeX[2]), px));
+        z = _mm_add_ps(z, _mm_mul_ps(_mm_set1_ps(depthX), px));
+        __m128 step0 = _mm_set1_ps(edgeX[0] * 4);
+        __m128 step1 = _mm_set1_ps(edgeX[1] * 4);
+        __m128 step2 = _mm_set1_ps(edgeX[2] * 4);
+        __m128 stepZ = _mm_set1_ps(depthX * 4);
+        __m128 zero = _mm_setzero_ps();
+
+        for (int x = minX; x <= maxX; x += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(e0, zero), _mm_cmpgt_ps(e1, zero)), _mm_cmpgt_ps(e2, zero));
+            if (_mm_movemask_ps(inside))
+            {
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_and_ps(inside, _mm_min_ps(old, z));
+                _mm_storeu_ps(row + x, _mm_or_ps(nearer, _mm_andnot_ps(inside, old)));
+            }
+
+            e0 = _mm_add_ps(e0, step0);
+            e1 = _mm_add_ps(e1, step1);
+            e2 = _mm_add_ps(e2, step2);
+            z = _mm_add_ps(z, stepZ);
+        }
+#else
+        for (int x = minX; x <= maxX; x++)
+        {
+            float px = x + 0.5f;
+            if (edgeX[0] * px + edgeY[0] * py + edgeC[0] > 0 && edgeX[1] * px + edgeY[1] * py + edgeC[1] > 0
+                && edgeX[2] * px + edgeY[2] * py + edgeC[2] > 0)
+            {
+                row[x] = min(row[x], depthX * px + depthY * py + depthC);
+            }
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::end()
+{
+    m_farthest[0] = m_nearest[0];
+
+    // Each texel keeps the nearest and farthest of the (up to) four below it.
+    for (size_t level = 1; level < m_widths.size(); level++)
+    {
+        int width = m_widths[level], height = m_heights[level];
+        int fineWidth = m_widths[level - 1], fineHeight = m_heights[level - 1];
+        const float *fineNearest = &m_nearest[level - 1][0];
+        const float *fineFarthest = &m_farthest[level - 1][0];
+        float *nearest = &m_nearest[level][0];
+        float *farthest = &m_farthest[level][0];
+
+        for (int y = 0; y < height; y++)
+        {
+            int y0 = 2 * y, y1 = min(2 * y + 1, fineHeight - 1);
+            for (int x = 0; x < width; x++)
+            {
+                int x0 = 2 * x, x1 = min(2 * x + 1, fineWidth - 1);
+                int i00 = y0 * fineWidth + x0, i01 = y0 * fineWidth + x1;
+                int i10 = y1 * fineWidth + x0, i11 = y1 * fineWidth + x1;
+
+                nearest[y * width + x] = min(min(fineNearest[i00], fineNearest[i01]), min(fineNearest[i10], fineNearest[i11]));
+                farthest[y * width + x] = max(max(fineFarthest[i00], fineFarthest[i01]), max(fineFarthest[i10], fineFarthest[i11]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::occluded(const Vector3f &center, float radius) const
+{
+    // Bound the sphere's box on screen. Boxes reaching past the near plane are never
+    // hidden.
+    float minX = CULLER_WIDTH, maxX = 0, minY = CULLER_HEIGHT, maxY = 0, nearest = FAR_DEPTH;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float p[3] = {
+            center[0] + (corner & 1 ? radius : -radius),
+            center[1] + (corner & 2 ? radius : -radius),
+            center[2] + (corner & 4 ? radius : -radius) };
+
+        float q[4];
+        for (int i = 0; i < 4; i++)
+            q[i] = m_clip[4 * i] * p[0] + m_clip[4 * i + 1] * p[1] + m_clip[4 * i + 2] * p[2] + m_clip[4 * i + 3];
+        if (q[3] <= 0 || q[2] < -q[3])
+            return false;
+
+        float inverse = 1.0f / q[3];
+        float x = (q[0] * inverse * 0.5f + 0.5f) * CULLER_WIDTH;
+        float y = (q[1] * inverse * 0.5f + 0.5f) * CULLER_HEIGHT;
+        minX = min(minX, x);
+        maxX = max(maxX, x);
+        minY = min(minY, y);
+        maxY = max(maxY, y);
+        nearest = min(nearest, q[2] * inverse);
+    }
+
+    int x0 = max((int)floor(minX), 0), x1 = min((int)floor(maxX), CULLER_WIDTH - 1);
+    int y0 = max((int)floor(minY), 0), y1 = min((int)floor(maxY), CULLER_HEIGHT - 1);
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    // Start at the finest level where the bounds span at most two texels each way.
+    int level = 0;
+    while ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)
+        level++;
+
+    return hidden(level, x0, y0, x1, y1, nearest);
+}
+
+bool OcclusionCuller::hidden(int level, int x0, int y0, int x1, int y1, float depth) const
+{
+    const vector<float> &nearest = m_nearest[level];
+    const vector<float> &farthest = m_farthest[level];
+    int width = m_widths[level];
+
+    for (int ty = y0 >> level; ty <= y1 >> level; ty++)
+    {
+        for (int tx = x0 >> level; tx <= x1 >> level; tx++)
+        {
+            int i = ty * width + tx;
+            if (depth > farthest[i])
+                continue;
+            if (level == 0 || depth <= nearest[i])
+                return false;
+
+            // Partly in front of this texel: look at the part of the bounds in each
+            // of the texels below it.
+            int size = 1 << level;
+            if (!hidden(level - 1, max(x0, tx * size), max(y0, ty * size),
+                min(x1, (tx + 1) * size - 1), min(y1, (ty + 1) * size - 1), depth))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+unsigned OcclusionCuller::occluderTriangles(unsigned occluder) const
+{
+    return (unsigned)m_occluders[occluder].indices.size() / 3;
+}
+
+unsigned OcclusionCuller::rasterizedTriangles() const
+{
+    return m_triangles;
+}
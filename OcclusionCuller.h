@@ -0,0 +1,84 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <vector>
+#include "vecmath.h"
+#include "MeshBuffer.h"
+
+// Size of the software depth buffer, stretched over the whole view. The width must be
+// a multiple of four.
+#define CULLER_WIDTH 256
+#define CULLER_HEIGHT 128
+
+// The most objects rasterized as occluders each frame, largest on screen first.
+#define CULLER_OCCLUDERS 16
+
+// Cells along the longest side of the grid an occluder's vertices are clustered on.
+#define CULLER_OCCLUDER_GRID 24
+
+// Hides objects behind others on the CPU, before they are submitted. A few occluders,
+// coarse copies of the objects that cover the most of the screen, are rasterized into
+// a small depth buffer four pixels at a time with SSE2 edge functions. The buffer is
+// reduced into a pyramid holding the nearest and farthest depth of each texel, and
+// each object's screen bounds are tested against it from the coarsest useful level
+// down: an object is hidden where its nearest depth is behind a texel's farthest, and
+// visible as soon as it is in front of one's nearest.
+class OcclusionCuller
+{
+public:
+
+    OcclusionCuller();
+
+    // Simplifies a mesh into an occluder by clustering its vertices on a grid.
+    // Returns its index.
+    unsigned addOccluder(const IndexedMesh &mesh);
+
+    // Starts a frame seen through a projection * modelview matrix, with an empty
+    // depth buffer. Objects are given in that modelview's object space.
+    void begin(const Matrix4f &clip);
+
+    // Rasterizes an occluder, placed by a column-major transform, into the depth
+    // buffer.
+    void rasterize(unsigned occluder, const float *transform);
+
+    // Builds the depth pyramid once every occluder is rasterized.
+    void end();
+
+    // Determines whether a sphere is hidden behind the occluders.
+    bool occluded(const Vector3f &center, float radius) const;
+
+    unsigned occluderTriangles(unsigned occluder) const;
+
+    // The triangles rasterized this frame.
+    unsigned rasterizedTriangles() const;
+
+private:
+
+    struct Occluder
+    {
+        std::vector<float> positions;
+        std::vector<unsigned> indices;
+    };
+
+    // Fills a triangle of screen-space (x, y, depth) vertices with its nearest depth.
+    void fillTriangle(const float *a, const float *b, const float *c);
+
+    // Tests a rectangle of level texels against a depth, refining where it is unsure.
+    bool hidden(int level, int x0, int y0, int x1, int y1, float depth) const;
+
+    std::vector<Occluder> m_occluders;
+
+    // The frame's clip matrix, row by row.
+    float m_clip[16];
+
+    // The nearest and farthest depth of every texel of each level; level 0 is the
+    // depth buffer itself.
+    std::vector<std::vector<float> > m_nearest;
+    std::vector<std::vector<float> > m_farthest;
+    std::vector<int> m_widths;
+    std::vector<int> m_heights;
+
+    unsigned m_triangles;
+};
+
+#endif // OCCLUSION_CULLER_H
@@ -0,0 +1,113 @@
+#include "PixelReadback.h"
+#include "GLStateCache.h"
+#include <cstring>
+
+using namespace std;
+
+PixelReadback::PixelReadback() :
+    m_next(0),
+    m_inFlight(0),
+    m_frame(0),
+    m_buffered(false)
+{
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+bool PixelReadback::create()
+{
+    // Pixel buffer objects need OpenGL 2.1.
+    if (!glVersionAtLeast(2, 1))
+        return false;
+
+    for (int i = 0; i < PIXEL_READBACK_BUFFERS; i++)
+        glGenBuffers(1, &m_slots[i].buffer);
+
+    m_buffered = true;
+    return true;
+}
+
+bool PixelReadback::read(int x, int y, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+
+    // Rows of RGBA pixels are always four-byte aligned.
+    GLsizeiptr size = (GLsizeiptr)width * height * 4;
+
+    if (!m_buffered)
+    {
+        m_ready.push_back(Image());
+        Image &image = m_ready.back();
+        image.width = width;
+        image.height = height;
+        image.pixels.resize(size);
+        glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &image.pixels[0]);
+        return true;
+    }
+
+    if (m_inFlight == PIXEL_READBACK_BUFFERS)
+        return false;
+
+    Slot &slot = m_slots[m_next];
+    m_next = (m_next + 1) % PIXEL_READBACK_BUFFERS;
+    m_inFlight++;
+
+    slot.frame = m_frame;
+    slot.width = width;
+    slot.height = height;
+
+    // With a pack buffer bound, glReadPixels returns at once and the copy happens on the GPU.
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.capacity < size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+    glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid *)0);
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return true;
+}
+
+void PixelReadback::beginFrame()
+{
+    m_frame++;
+}
+
+bool PixelReadback::receive(Image &image)
+{
+    if (!m_ready.empty())
+    {
+        image = m_ready.front();
+        m_ready.pop_front();
+        return true;
+    }
+
+    if (!m_inFlight)
+        return false;
+
+    Slot &slot = m_slots[(m_next + PIXEL_READBACK_BUFFERS - m_inFlight) % PIXEL_READBACK_BUFFERS];
+    if (m_frame - slot.frame < PIXEL_READBACK_DELAY)
+        return false;
+
+    image.width = slot.width;
+    image.height = slot.height;
+    image.pixels.resize((size_t)slot.width * slot.height * 4);
+
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void *pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (pixels)
+    {
+        memcpy(&image.pixels[0], pixels, image.pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_inFlight--;
+    return pixels != NULL;
+}
+
+bool PixelReadback::pending() const
+{
+    return m_inFlight || !m_ready.empty();
+}
@@ -0,0 +1,72 @@
+#ifndef PIXEL_READBACK_H
+#define PIXEL_READBACK_H
+
+#include <deque>
+#include <vector>
+#include "GLExtensions.h"
+
+// Number of pixel buffers reads can be in flight in at once.
+#define PIXEL_READBACK_BUFFERS 3
+
+// Number of frames a read waits before its buffer is mapped.
+#define PIXEL_READBACK_DELAY 2
+
+// An RGBA image, bottom row first as GL reads it.
+struct Image
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+// Reads the framebuffer without stalling. Each read goes into one of a ring of pixel
+// buffer objects, which is mapped PIXEL_READBACK_DELAY frames later, once the GPU has
+// long since finished drawing the frame and copying it out.
+class PixelReadback
+{
+public:
+
+    PixelReadback();
+
+    // Creates the pixel buffers. Returns false if the context has none, in which case
+    // reads are done on the spot.
+    bool create();
+
+    // Starts reading a region of the current read buffer. Returns false if every
+    // pixel buffer is still in flight.
+    bool read(int x, int y, int width, int height);
+
+    // Counts a new frame, which is how reads age.
+    void beginFrame();
+
+    // Hands back the oldest read that has waited long enough, if any.
+    bool receive(Image &image);
+
+    // Whether any read has yet to be received.
+    bool pending() const;
+
+private:
+
+    struct Slot
+    {
+        GLuint buffer;
+        GLsizeiptr capacity;
+        unsigned frame;
+        int width;
+        int height;
+    };
+
+    Slot m_slots[PIXEL_READBACK_BUFFERS];
+
+    // The slot the next read goes into, and how many reads are in flight.
+    unsigned m_next;
+    unsigned m_inFlight;
+
+    unsigned m_frame;
+    bool m_buffered;
+
+    // Reads done on the spot, waiting to be received.
+    std::deque<Image> m_ready;
+};
+
+#endif // PIXEL_READBACK_H
@@ -0,0 +1,418 @@
+#include "PointCloud.h"
+#include "GLStateCache.h"
+#include "Frustum.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+using namespace std;
+
+namespace
+{
+    // Sizes each splat to cover its diameter on screen, in perspective or not.
+    const char *splatVertexShader =
+        "#version 330 compatibility\n"
+        "uniform float radius;\n"
+        "uniform float viewportHeight;\n"
+        "out vec3 eyeCenter;\n"
+        "out vec3 eyeNormal;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+        "    eyeCenter = eye.xyz;\n"
+        "    eyeNormal = gl_NormalMatrix * gl_Normal;\n"
+        "    gl_Position = gl_ProjectionMatrix * eye;\n"
+        "    gl_PointSize = max(radius * gl_ProjectionMatrix[1][1] * viewportHeight / gl_Position.w, 1.0);\n"
+        "}\n";
+
+    // Finds where the fragment's part of the square falls on the sphere, or on the
+    // disc facing the eye's side of the normal, leaves out what is not on it, and
+    // writes that point's depth and lighting.
+    const char *splatFragmentShader =
+        "#version 330 compatibility\n"
+        "uniform float radius;\n"
+        "uniform float oriented;\n"
+        "in vec3 eyeCenter;\n"
+        "in vec3 eyeNormal;\n"
+        "out vec4 fragColor;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 offset = vec2(gl_PointCoord.x, 1.0 - gl_PointCoord.y) * 2.0 - 1.0;\n"
+        "    float across = dot(offset, offset);\n"
+        "    vec3 n;\n"
+        "    float rise;\n"
+        "    if (oriented != 0.0)\n"
+        "    {\n"
+        "        n = normalize(eyeNormal);\n"
+        "        if (dot(n, eyeCenter) > 0.0)\n"
+        "            n = -n;\n"
+        "        rise = -dot(n.xy, offset) / max(n.z, 0.1);\n"
+        "        if (across + rise * rise > 1.0)\n"
+        "            discard;\n"
+        "    }\n"
+        "    else\n"
+        "    {\n"
+        "        if (across > 1.0)\n"
+        "            discard;\n"
+        "        rise = sqrt(1.0 - across);\n"
+        "        n = vec3(offset, rise);\n"
+        "    }\n"
+        "    vec3 eye = eyeCenter + vec3(offset, rise) * radius;\n"
+        "    vec4 clip = gl_ProjectionMatrix * vec4(eye, 1.0);\n"
+        "    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;\n"
+        "    vec4 light = gl_LightSource[0].position;\n"
+        "    vec3 l = normalize(light.xyz - eye * light.w);\n"
+        "    vec3 h = normalize(l - normalize(eye));\n"
+        "    float diffuse = max(dot(n, l), 0.0);\n"
+        "    float specular = diffuse > 0.0 ? pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+        "    vec3 color = gl_FrontMaterial.diffuse.rgb * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb\n"
+        "        + diffuse * gl_LightSource[0].diffuse.rgb) + specular * gl_FrontLightProduct[0].specular.rgb;\n"
+        "    fragColor = vec4(color, 1.0);\n"
+        "}\n";
+
+    // The cell of a grid over a node's cube that a point falls in.
+    int gridCell(const float *point, const float *center, float halfSize)
+    {
+        int cell = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            int i = (int)((point[k] - center[k] + halfSize) / (2 * halfSize) * POINT_CLOUD_GRID);
+            cell = cell * POINT_CLOUD_GRID + min(max(i, 0), POINT_CLOUD_GRID - 1);
+        }
+
+        return cell;
+    }
+
+    int octant(const float *point, const float *center)
+    {
+        return (point[0] >= center[0]) | (point[1] >= center[1]) << 1 | (point[2] >= center[2]) << 2;
+    }
+}
+
+PointCloud::PointCloud() :
+    m_stride(3),
+    m_pointCount(0),
+    m_buffer(0),
+    m_budget(POINT_CLOUD_BUDGET),
+    m_drawnPoints(0),
+    m_selectMilliseconds(0)
+{
+}
+
+void PointCloud::destroy()
+{
+    if (m_buffer)
+        glState.deleteBuffers(1, &m_buffer);
+
+    m_buffer = 0;
+}
+
+void PointCloud::build(const vector<Vector3f> &positions, const vector<Vector3f> &normals)
+{
+    m_nodes.clear();
+    m_pointCount = (unsigned)positions.size();
+    if (positions.empty())
+        return;
+
+    // Work on plain floats, in the layout they will be drawn from.
+    bool withNormals = normals.size() == positions.size();
+    m_stride = withNormals ? 6 : 3;
+    vector<float> points((size_t)m_pointCount * m_stride);
+    float low[3], high[3];
+    for (int k = 0; k < 3; k++)
+        low[k] = high[k] = positions[0][k];
+
+    for (unsigned i = 0; i < m_pointCount; i++)
+    {
+        float *point = &points[(size_t)i * m_stride];
+        for (int k = 0; k < 3; k++)
+        {
+            point[k] = positions[i][k];
+            low[k] = min(low[k], point[k]);
+            high[k] = max(high[k], point[k]);
+            if (withNormals)
+                point[3 + k] = normals[i][k];
+        }
+    }
+
+    // The root is the cube around the bounding box.
+    float center[3];
+    float halfSize = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        center[k] = (low[k] + high[k]) / 2;
+        halfSize = max(halfSize, (high[k] - low[k]) / 2);
+    }
+    halfSize = max(halfSize, 1e-6f);
+
+    m_points.swap(points);
+    vector<unsigned> order(m_pointCount);
+    for (unsigned i = 0; i < m_pointCount; i++)
+        order[i] = i;
+
+    m_taken.resize(POINT_CLOUD_GRID * POINT_CLOUD_GRID * POINT_CLOUD_GRID);
+    buildNode(order, 0, m_pointCount, center, halfSize, 0);
+    vector<char>().swap(m_taken);
+
+    // Lay the points out in the order the nodes own them.
+    vector<float> sorted(m_points.size());
+    for (unsigned i = 0; i < m_pointCount; i++)
+        copy(&m_points[(size_t)order[i] * m_stride], &m_points[(size_t)order[i] * m_stride] + m_stride, &sorted[(size_t)i * m_stride]);
+    m_points.swap(sorted);
+}
+
+int PointCloud::buildNode(vector<unsigned> &order, unsigned begin, unsigned end,
+    const float *center, float halfSize, int depth)
+{
+    int index = (int)m_nodes.size();
+    m_nodes.push_back(Node());
+    Node node;
+    for (int k = 0; k < 3; k++)
+        node.center[k] = center[k];
+    node.halfSize = halfSize;
+    node.spacing = 2 * halfSize / POINT_CLOUD_GRID;
+    node.first = begin;
+    node.count = end - begin;
+    for (int i = 0; i < 8; i++)
+        node.children[i] = -1;
+
+    if (end - begin <= POINT_CLOUD_LEAF_POINTS || depth == POINT_CLOUD_MAX_DEPTH)
+    {
+        m_nodes[index] = node;
+        return index;
+    }
+
+    // Keep the first point in each cell of the grid, moved to the front.
+    fill(m_taken.begin(), m_taken.end(), 0);
+    unsigned kept = begin;
+    for (unsigned i = begin; i < end; i++)
+    {
+        int cell = gridCell(&m_points[(size_t)order[i] * m_stride], center, halfSize);
+        if (!m_taken[cell])
+        {
+            m_taken[cell] = 1;
+            swap(order[kept++], order[i]);
+        }
+    }
+    node.count = kept - begin;
+
+    // Sort the rest by octant.
+    unsigned starts[9] = { 0 };
+    for (unsigned i = kept; i < end; i++)
+        starts[octant(&m_points[(size_t)order[i] * m_stride], center) + 1]++;
+    starts[0] = kept;
+    for (int o = 1; o <= 8; o++)
+        starts[o] += starts[o - 1];
+
+    vector<unsigned> rest(order.begin() + kept, order.begin() + end);
+    unsigned next[8];
+    copy(starts, starts + 8, next);
+    for (size_t i = 0; i < rest.size(); i++)
+        order[next[octant(&m_points[(size_t)rest[i] * m_stride], center)]++] = rest[i];
+    vector<unsigned>().swap(rest);
+
+    for (int o = 0; o < 8; o++)
+    {
+        if (starts[o] == starts[o + 1])
+            continue;
+
+        float childCenter[3];
+        for (int k = 0; k < 3; k++)
+            childCenter[k] = center[k] + (o >> k & 1 ? halfSize : -halfSize) / 2;
+        node.children[o] = buildNode(order, starts[o], starts[o + 1], childCenter, halfSize / 2, depth + 1);
+    }
+
+    m_nodes[index] = node;
+    return index;
+}
+
+bool PointCloud::create()
+{
+    if (m_points.empty() || !glVersionAtLeast(3, 3) || !m_program.create(splatVertexShader, splatFragmentShader, NULL))
+        return false;
+
+    glGenBuffers(1, &m_buffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, m_points.size() * sizeof(float), &m_points[0], GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The buffer holds the only copy needed from now on.
+    vector<float>().swap(m_points);
+    return true;
+}
+
+void PointCloud::draw(bool oriented)
+{
+    if (m_nodes.empty())
+        return;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // A length at clip w spans this many pixels.
+    Matrix4f clip = currentClipMatrix();
+    Frustum frustum(clip);
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    Matrix4f projection;
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    float pixels = projection(1, 1) * viewport[3] / 2;
+    Vector4f w = clip.getRow(3);
+
+    // Refine whichever node in view has its points furthest apart on screen, until
+    // they are close enough or the budget is spent.
+    m_selected.clear();
+    m_drawnPoints = 0;
+    priority_queue<pair<float, int> > open;
+    const Node &root = m_nodes[0];
+    Vector3f rootCenter(root.center[0], root.center[1], root.center[2]);
+    Vector3f rootExtent(root.halfSize, root.halfSize, root.halfSize);
+    if (frustum.intersectsBox(rootCenter - rootExtent, rootCenter + rootExtent))
+        open.push(make_pair(numeric_limits<float>::max(), 0));
+    while (!open.empty())
+    {
+        float spacing = open.top().first;
+        const Node &node = m_nodes[open.top().second];
+        int index = open.top().second;
+        open.pop();
+
+        if (m_drawnPoints + node.count > m_budget)
+            break;
+
+        m_selected.push_back(index);
+        m_drawnPoints += node.count;
+        if (spacing <= POINT_CLOUD_SPACING_PIXELS)
+            continue;
+
+        for (int o = 0; o < 8; o++)
+        {
+            if (node.children[o] < 0)
+                continue;
+
+            const Node &child = m_nodes[node.children[o]];
+            Vector3f center(child.center[0], child.center[1], child.center[2]);
+            Vector3f extent(child.halfSize, child.halfSize, child.halfSize);
+            if (!frustum.intersectsBox(center - extent, center + extent))
+                continue;
+
+            // Measure at the nearest the child's cube comes to the eye.
+            float distance = w[0] * center[0] + w[1] * center[1] + w[2] * center[2] + w[3] - child.halfSize * 1.7321f;
+            float childSpacing = distance > 0 ? child.spacing * pixels / distance : numeric_limits<float>::max();
+            open.push(make_pair(childSpacing, node.children[o]));
+        }
+    }
+
+    // A node whose children are drawn too is as dense as they are, so its splats can
+    // be as small as theirs.
+    vector<char> selected(m_nodes.size(), 0);
+    for (size_t i = 0; i < m_selected.size(); i++)
+        selected[m_selected[i]] = 1;
+
+    m_radii.resize(m_selected.size());
+    for (size_t i = 0; i < m_selected.size(); i++)
+    {
+        const Node &node = m_nodes[m_selected[i]];
+        float spacing = node.spacing;
+        for (int o = 0; o < 8; o++)
+        {
+            if (node.children[o] >= 0 && selected[node.children[o]])
+                spacing = node.spacing / 2;
+        }
+        m_radii[i] = spacing * POINT_CLOUD_SPLAT_SIZE / 2;
+    }
+
+    m_selectMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    const float *points = NULL;
+    if (m_program.valid())
+    {
+        m_program.use();
+        glUniform1f(m_program.uniform("viewportHeight"), (float)viewport[3]);
+        glUniform1f(m_program.uniform("oriented"), oriented && hasNormals() ? 1.0f : 0.0f);
+        glState.enable(GL_PROGRAM_POINT_SIZE);
+        glState.enable(GL_POINT_SPRITE);
+        glState.bindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    }
+    else
+    {
+        // Plain dots, lit only if they have normals to be lit by.
+        points = &m_points[0];
+        glPointSize(POINT_CLOUD_SPACING_PIXELS);
+        if (!hasNormals())
+            glState.disable(GL_LIGHTING);
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, m_stride * sizeof(float), points);
+    if (hasNormals())
+    {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, m_stride * sizeof(float), points + 3);
+    }
+
+    for (size_t i = 0; i < m_selected.size(); i++)
+    {
+        const Node &node = m_nodes[m_selected[i]];
+        if (m_program.valid())
+            glUniform1f(m_program.uniform("radius"), m_radii[i]);
+        glDrawArrays(GL_POINTS, node.first, node.count);
+    }
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    if (m_program.valid())
+    {
+        glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+        glState.disable(GL_POINT_SPRITE);
+        glState.disable(GL_PROGRAM_POINT_SIZE);
+        glState.useProgram(0);
+    }
+    else
+    {
+        glPointSize(1);
+        if (!hasNormals())
+            glState.enable(GL_LIGHTING);
+    }
+}
+
+bool PointCloud::empty() const
+{
+    return m_nodes.empty();
+}
+
+bool PointCloud::hasNormals() const
+{
+    return m_stride == 6;
+}
+
+void PointCloud::setBudget(unsigned points)
+{
+    m_budget = points;
+}
+
+unsigned PointCloud::pointCount() const
+{
+    return m_pointCount;
+}
+
+unsigned PointCloud::nodeCount() const
+{
+    return (unsigned)m_nodes.size();
+}
+
+unsigned PointCloud::drawnPoints() const
+{
+    return m_drawnPoints;
+}
+
+unsigned PointCloud::drawnNodes() const
+{
+    return (unsigned)m_selected.size();
+}
+
+double PointCloud::selectMilliseconds() const
+{
+    return m_selectMilliseconds;
+}
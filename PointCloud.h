@@ -0,0 +1,113 @@
+#ifndef POINT_CLOUD_H
+#define POINT_CLOUD_H
+
+#include <vector>
+#include "vecmath.h"
+#include "Shader.h"
+
+// Cells along each side of the grid a node's own points are picked on: a node keeps
+// one point per occupied cell and passes the rest down to its children.
+#define POINT_CLOUD_GRID 32
+
+// The most points a node holds before it splits, and the deepest it may split.
+#define POINT_CLOUD_LEAF_POINTS 8192
+#define POINT_CLOUD_MAX_DEPTH 20
+
+// The most points drawn in a frame by default.
+#define POINT_CLOUD_BUDGET 4000000
+
+// Nodes are refined until their points are at most this many pixels apart.
+#define POINT_CLOUD_SPACING_PIXELS 2.0f
+
+// Splat diameter as a multiple of the spacing of its node's points.
+#define POINT_CLOUD_SPLAT_SIZE 1.5f
+
+// Draws a cloud of points, such as a scan with no faces, as round splats sized on
+// screen to close the gaps between them. The points are sorted into an octree in
+// which every node holds an even sample of its part of the cloud, one point per
+// cell of a grid over it, and its children hold the rest, so any cut through the
+// tree draws the cloud at a coarser or finer spacing. Each frame the nodes in view
+// are refined coarsest on screen first until their points are a couple of pixels
+// apart or the point budget runs out; each node is one draw from a single buffer.
+// Splats write the depth of the sphere, or of the disc square to the point's normal
+// when normals are given, that they stand for.
+class PointCloud
+{
+public:
+
+    PointCloud();
+
+    // Builds the octree over the points. Normals are used if there is one per point.
+    void build(const std::vector<Vector3f> &positions, const std::vector<Vector3f> &normals);
+
+    // Uploads the points and compiles the splat shader. Returns false if the context
+    // has no OpenGL 3.3, in which case the points are drawn as plain dots.
+    bool create();
+
+    // Frees the GL objects, which must happen while the context they were made in
+    // is current.
+    void destroy();
+
+    // Picks the nodes to draw against the current GL view and viewport, and draws
+    // them with the current material and main light, facing the normals if asked.
+    void draw(bool oriented);
+
+    bool empty() const;
+    bool hasNormals() const;
+
+    void setBudget(unsigned points);
+
+    unsigned pointCount() const;
+    unsigned nodeCount() const;
+
+    // What the last frame drew, and the CPU time it took to pick the nodes.
+    unsigned drawnPoints() const;
+    unsigned drawnNodes() const;
+    double selectMilliseconds() const;
+
+private:
+
+    struct Node
+    {
+        float center[3];
+        float halfSize;
+
+        // Distance between this node's points, the size of its grid cells.
+        float spacing;
+
+        // Its own points in the sorted buffer.
+        unsigned first;
+        unsigned count;
+
+        // Indices of the child in each octant, or -1.
+        int children[8];
+    };
+
+    // Sorts the points order[begin, end) into a node of the given bounds and its
+    // subtree. Returns the node's index.
+    int buildNode(std::vector<unsigned> &order, unsigned begin, unsigned end,
+        const float *center, float halfSize, int depth);
+
+    // Points as x, y, z, then the normal's x, y, z if there are normals.
+    std::vector<float> m_points;
+    int m_stride;
+    unsigned m_pointCount;
+
+    std::vector<Node> m_nodes;
+
+    // Which cells of a node's grid have a point, while it is built.
+    std::vector<char> m_taken;
+
+    ShaderProgram m_program;
+    GLuint m_buffer;
+
+    // This frame's nodes and the radius of their splats.
+    std::vector<int> m_selected;
+    std::vector<float> m_radii;
+
+    unsigned m_budget;
+    unsigned m_drawnPoints;
+    double m_selectMilliseconds;
+};
+
+#endif // POINT_CLOUD_H
@@ -0,0 +1,857 @@
+#include "ProgressiveMesh.h"
+#include "LightingShader.h"
+#include "GL/freeglut.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Identifies the streaming format and its version.
+#define PM_MAGIC   0x48534D50 // "PMSH"
+#define PM_VERSION 1
+
+// The most vertices, triangles, and triangles per split a stream may hold, so that a
+// corrupt or hostile stream cannot ask for more memory than any real mesh needs.
+#define PM_MAX_VERTICES (1u << 26)
+#define PM_MAX_FACES (1u << 27)
+#define PM_MAX_SPLIT_FACES (1u << 16)
+
+// Weight of the planes that keep open boundaries from shrinking.
+#define BOUNDARY_WEIGHT 10.0
+
+// Smallest allowed cosine between a face normal before and after a collapse.
+#define MIN_NORMAL_COSINE 0.2f
+
+namespace
+{
+    // Symmetric 4x4 error quadric of Garland and Heckbert, stored as its upper triangle.
+    struct Quadric
+    {
+        double a[10];
+
+        Quadric()
+        {
+            memset(a, 0, sizeof(a));
+        }
+
+        // Adds the squared distance to plane ax + by + cz + d = 0.
+        void addPlane(double x, double y, double z, double d, double weight)
+        {
+            a[0] += weight * x * x; a[1] += weight * x * y; a[2] += weight * x * z; a[3] += weight * x * d;
+            a[4] += weight * y * y; a[5] += weight * y * z; a[6] += weight * y * d;
+            a[7] += weight * z * z; a[8] += weight * z * d;
+            a[9] += weight * d * d;
+        }
+
+        Quadric &operator += (const Quadric &q)
+        {
+            for (int i = 0; i < 10; i++)
+                a[i] += q.a[i];
+            return *this;
+        }
+
+        // Evaluates the squared error of a point.
+        double evaluate(const Vector3f &p) const
+        {
+            double x = p[0], y = p[1], z = p[2];
+            return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                + a[7] * z * z + 2 * a[8] * z
+                + a[9];
+        }
+    };
+
+    // A pending collapse of vertex u into its best neighbor, valid while u's version is unchanged.
+    struct Candidate
+    {
+        double cost;
+        unsigned u;
+        unsigned v;
+        unsigned version;
+
+        bool operator < (const Candidate &c) const
+        {
+            // Reverse order so the priority queue pops the cheapest collapse first.
+            return cost > c.cost;
+        }
+    };
+
+    // A collapse as it happened during simplification.
+    struct Collapse
+    {
+        unsigned u;
+        unsigned v;
+        float error;
+
+        // Faces removed by the collapse and their vertices just before it.
+        vector<unsigned> removed;
+        vector<unsigned> removedVertices;
+
+        // Face slots that were moved from u to v, as (face * 3 + slot).
+        vector<unsigned> corners;
+    };
+
+    // Mesh connectivity used while simplifying.
+    struct Simplifier
+    {
+        vector<Vector3f> positions;
+        vector<unsigned> faces;
+        vector<bool> faceAlive;
+        vector<vector<unsigned> > vertexFaces;
+        vector<Quadric> quadrics;
+        vector<unsigned> versions;
+        vector<bool> vertexAlive;
+
+        // Collects the live neighbors of a vertex.
+        void neighbors(unsigned u, vector<unsigned> &result) const
+        {
+            result.clear();
+            for (size_t i = 0; i < vertexFaces[u].size(); i++)
+            {
+                unsigned f = vertexFaces[u][i];
+                if (!faceAlive[f])
+                    continue;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned w = faces[f * 3 + k];
+                    if (w != u && find(result.begin(), result.end(), w) == result.end())
+                        result.push_back(w);
+                }
+            }
+        }
+
+        // Determines whether u can be collapsed into v without folding or pinching the surface.
+        bool canCollapse(unsigned u, unsigned v) const
+        {
+            // Link condition: u and v may share at most the two vertices opposite their edge.
+            vector<unsigned> nu, nv;
+            neighbors(u, nu);
+            neighbors(v, nv);
+
+            int shared = 0;
+            for (size_t i = 0; i < nu.size(); i++)
+            {
+                if (find(nv.begin(), nv.end(), nu[i]) != nv.end())
+                    shared++;
+            }
+            if (shared > 2)
+                return false;
+
+            // Faces that survive the collapse must not flip.
+            for (size_t i = 0; i < vertexFaces[u].size(); i++)
+            {
+                unsigned f = vertexFaces[u][i];
+                if (!faceAlive[f])
+                    continue;
+
+                const unsigned *t = &faces[f * 3];
+                if (t[0] == v || t[1] == v || t[2] == v)
+                    continue;
+
+                Vector3f p[3], q[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = positions[t[k]];
+                    q[k] = t[k] == u ? positions[v] : p[k];
+                }
+
+                Vector3f before = Vector3f::cross(p[1] - p[0], p[2] - p[0]);
+                Vector3f after = Vector3f::cross(q[1] - q[0], q[2] - q[0]);
+                float lengths = before.abs() * after.abs();
+                if (lengths <= 0 || Vector3f::dot(before, after) < MIN_NORMAL_COSINE * lengths)
+                    return false;
+            }
+
+            return true;
+        }
+
+        // Finds the cheapest valid collapse of u. Returns false if there is none.
+        bool bestCandidate(unsigned u, Candidate &result) const
+        {
+            vector<unsigned> nu;
+            neighbors(u, nu);
+
+            bool found = false;
+            for (size_t i = 0; i < nu.size(); i++)
+            {
+                unsigned v = nu[i];
+                Quadric q = quadrics[u];
+                q += quadrics[v];
+                double cost = max(0.0, q.evaluate(positions[v]));
+
+                if ((!found || cost < result.cost) && canCollapse(u, v))
+                {
+                    result.cost = cost;
+                    result.u = u;
+                    result.v = v;
+                    result.version = versions[u];
+                    found = true;
+                }
+            }
+
+            return found;
+        }
+    };
+
+    // Writes a plain array to the stream.
+    template <class T>
+    bool writeArray(FILE *file, const T *data, size_t count)
+    {
+        return count == 0 || fwrite(data, sizeof(T), count, file) == count;
+    }
+
+    // Reads a plain array from the stream.
+    template <class T>
+    bool readArray(FILE *file, T *data, size_t count)
+    {
+        return count == 0 || fread(data, sizeof(T), count, file) == count;
+    }
+
+    bool writeVectors(FILE *file, const vector<Vector3f> &v)
+    {
+        return v.empty() || writeArray(file, &v[0][0], v.size() * 3);
+    }
+
+    bool readVectors(FILE *file, vector<Vector3f> &v, size_t count)
+    {
+        v.resize(count);
+        return count == 0 || readArray(file, &v[0][0], count * 3);
+    }
+}
+
+ProgressiveMesh::ProgressiveMesh() :
+    m_baseVertexCount(0),
+    m_baseError(0),
+    m_level(0)
+{
+}
+
+void ProgressiveMesh::build(const vector<Vector3f> &positions, const vector<Vector3f> &normals,
+    const vector<vector<unsigned> > &faces, unsigned baseFaces)
+{
+    unsigned vertexCount = (unsigned)positions.size();
+    unsigned faceCount = (unsigned)faces.size();
+
+    Simplifier s;
+    s.positions = positions;
+    s.faces.resize(faceCount * 3);
+    s.faceAlive.assign(faceCount, true);
+    s.vertexFaces.resize(vertexCount);
+    s.quadrics.resize(vertexCount);
+    s.versions.assign(vertexCount, 0);
+    s.vertexAlive.assign(vertexCount, true);
+
+    // Weld the OBJ corners by position and average the normals referenced at each vertex.
+    vector<Vector3f> vertexNormals(vertexCount, Vector3f::ZERO);
+    for (unsigned f = 0; f < faceCount; f++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned v = faces[f][k * 3 + 0];
+            unsigned n = faces[f][k * 3 + 2];
+            s.faces[f * 3 + k] = v;
+            s.vertexFaces[v].push_back(f);
+
+            if (n < normals.size())
+                vertexNormals[v] += normals[n];
+        }
+    }
+
+    // Each face contributes its plane to the error of its vertices.
+    map<pair<unsigned, unsigned>, int> edgeUse;
+    for (unsigned f = 0; f < faceCount; f++)
+    {
+        const unsigned *t = &s.faces[f * 3];
+        Vector3f n = Vector3f::cross(positions[t[1]] - positions[t[0]], positions[t[2]] - positions[t[0]]);
+        if (n.abs() > 0)
+            n.normalize();
+
+        double d = -Vector3f::dot(n, positions[t[0]]);
+        for (int k = 0; k < 3; k++)
+        {
+            s.quadrics[t[k]].addPlane(n[0], n[1], n[2], d, 1.0);
+
+            // Fall back to face normals for vertices without OBJ normals.
+            if (normals.empty())
+                vertexNormals[t[k]] += n;
+
+            unsigned a = t[k], b = t[(k + 1) % 3];
+            edgeUse[make_pair(min(a, b), max(a, b))]++;
+        }
+    }
+
+    // Boundary edges get a perpendicular plane so open borders keep their shape.
+    for (unsigned f = 0; f < faceCount; f++)
+    {
+        const unsigned *t = &s.faces[f * 3];
+        Vector3f n = Vector3f::cross(positions[t[1]] - positions[t[0]], positions[t[2]] - positions[t[0]]);
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned a = t[k], b = t[(k + 1) % 3];
+            if (edgeUse[make_pair(min(a, b), max(a, b))] != 1)
+                continue;
+
+            Vector3f edge = positions[b] - positions[a];
+            Vector3f p = Vector3f::cross(edge, n);
+            if (p.abs() == 0)
+                continue;
+
+            p.normalize();
+            double d = -Vector3f::dot(p, positions[a]);
+            s.quadrics[a].addPlane(p[0], p[1], p[2], d, BOUNDARY_WEIGHT);
+            s.quadrics[b].addPlane(p[0], p[1], p[2], d, BOUNDARY_WEIGHT);
+        }
+    }
+
+    for (unsigned v = 0; v < vertexCount; v++)
+    {
+        if (vertexNormals[v].abs() > 0)
+            vertexNormals[v].normalize();
+    }
+
+    // Queue the cheapest collapse of every vertex.
+    priority_queue<Candidate> queue;
+    for (unsigned u = 0; u < vertexCount; u++)
+    {
+        Candidate c;
+        if (s.bestCandidate(u, c))
+            queue.push(c);
+    }
+
+    vector<Collapse> collapses;
+    unsigned aliveFaces = faceCount;
+    float error = 0;
+    vector<unsigned> ring;
+
+    while (aliveFaces > baseFaces && !queue.empty())
+    {
+        Candidate c = queue.top();
+        queue.pop();
+
+        // Skip collapses whose neighborhood changed since they were queued.
+        if (!s.vertexAlive[c.u] || !s.vertexAlive[c.v] || c.version != s.versions[c.u])
+            continue;
+
+        unsigned u = c.u, v = c.v;
+
+        Collapse collapse;
+        collapse.u = u;
+        collapse.v = v;
+
+        // The error never decreases as the mesh gets coarser.
+        error = max(error, (float)sqrt(c.cost));
+        collapse.error = error;
+
+        // Remove the faces on the edge and move the rest of u's faces to v.
+        for (size_t i = 0; i < s.vertexFaces[u].size(); i++)
+        {
+            unsigned f = s.vertexFaces[u][i];
+            if (!s.faceAlive[f])
+                continue;
+
+            unsigned *t = &s.faces[f * 3];
+            if (t[0] == v || t[1] == v || t[2] == v)
+            {
+                s.faceAlive[f] = false;
+                aliveFaces--;
+                collapse.removed.push_back(f);
+                collapse.removedVertices.insert(collapse.removedVertices.end(), t, t + 3);
+                continue;
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                if (t[k] == u)
+                {
+                    t[k] = v;
+                    collapse.corners.push_back(f * 3 + k);
+                }
+            }
+            s.vertexFaces[v].push_back(f);
+        }
+
+        s.vertexFaces[u].clear();
+        s.vertexAlive[u] = false;
+        s.quadrics[v] += s.quadrics[u];
+        collapses.push_back(collapse);
+
+        // Drop dead faces from v so its ring stays short.
+        vector<unsigned> &vf = s.vertexFaces[v];
+        size_t live = 0;
+        for (size_t i = 0; i < vf.size(); i++)
+        {
+            if (s.faceAlive[vf[i]])
+                vf[live++] = vf[i];
+        }
+        vf.resize(live);
+
+        // Everything around v has new costs.
+        s.neighbors(v, ring);
+        ring.push_back(v);
+        for (size_t i = 0; i < ring.size(); i++)
+        {
+            unsigned w = ring[i];
+            s.versions[w]++;
+
+            Candidate next;
+            if (s.bestCandidate(w, next))
+                queue.push(next);
+        }
+    }
+
+    // Base vertices keep their relative order; collapsed vertices follow in refinement order.
+    vector<unsigned> remap(vertexCount);
+    unsigned baseVertexCount = 0;
+    for (unsigned v = 0; v < vertexCount; v++)
+    {
+        if (s.vertexAlive[v])
+            remap[v] = baseVertexCount++;
+    }
+
+    unsigned splitCount = (unsigned)collapses.size();
+    for (unsigned r = 0; r < splitCount; r++)
+        remap[collapses[splitCount - 1 - r].u] = baseVertexCount + r;
+
+    // Base faces come first, then the faces each split adds back, in refinement order.
+    vector<unsigned> faceOrder(faceCount);
+    unsigned slot = 0;
+    for (unsigned f = 0; f < faceCount; f++)
+    {
+        if (s.faceAlive[f])
+            faceOrder[f] = slot++;
+    }
+
+    for (unsigned r = 0; r < splitCount; r++)
+    {
+        const Collapse &collapse = collapses[splitCount - 1 - r];
+        for (size_t i = 0; i < collapse.removed.size(); i++)
+            faceOrder[collapse.removed[i]] = slot++;
+    }
+
+    vector<Vector3f> basePositions(baseVertexCount);
+    vector<Vector3f> baseNormals(baseVertexCount);
+    for (unsigned v = 0; v < vertexCount; v++)
+    {
+        if (s.vertexAlive[v])
+        {
+            basePositions[remap[v]] = positions[v];
+            baseNormals[remap[v]] = vertexNormals[v];
+        }
+    }
+
+    vector<unsigned> baseIndices;
+    for (unsigned f = 0; f < faceCount; f++)
+    {
+        if (s.faceAlive[f])
+        {
+            for (int k = 0; k < 3; k++)
+                baseIndices.push_back(remap[s.faces[f * 3 + k]]);
+        }
+    }
+
+    setBase(basePositions, baseNormals, baseIndices, splitCount ? collapses.back().error : 0);
+
+    for (unsigned r = 0; r < splitCount; r++)
+    {
+        const Collapse &collapse = collapses[splitCount - 1 - r];
+
+        VertexSplit split;
+        split.parent = remap[collapse.v];
+        split.position = positions[collapse.u];
+        split.normal = vertexNormals[collapse.u];
+
+        // The mesh before this split is the mesh right after the previous collapse.
+        split.error = collapse.error;
+
+        for (size_t i = 0; i < collapse.corners.size(); i++)
+        {
+            unsigned corner = collapse.corners[i];
+            split.corners.push_back(faceOrder[corner / 3] * 3 + corner % 3);
+        }
+
+        for (size_t i = 0; i < collapse.removedVertices.size(); i++)
+            split.faces.push_back(remap[collapse.removedVertices[i]]);
+
+        appendSplit(split);
+    }
+}
+
+void ProgressiveMesh::setBase(const vector<Vector3f> &positions, const vector<Vector3f> &normals,
+    const vector<unsigned> &indices, float error)
+{
+    m_positions = positions;
+    m_normals = normals;
+    m_indices = indices;
+    m_splits.clear();
+    m_baseVertexCount = (unsigned)positions.size();
+    m_baseError = error;
+    m_level = 0;
+}
+
+void ProgressiveMesh::appendSplit(const VertexSplit &split)
+{
+    m_splits.push_back(split);
+    m_positions.push_back(split.position);
+    m_normals.push_back(split.normal);
+}
+
+void ProgressiveMesh::applySplit(unsigned i)
+{
+    const VertexSplit &split = m_splits[i];
+    unsigned vertex = m_baseVertexCount + i;
+
+    for (size_t k = 0; k < split.corners.size(); k++)
+        m_indices[split.corners[k]] = vertex;
+
+    m_indices.insert(m_indices.end(), split.faces.begin(), split.faces.end());
+}
+
+void ProgressiveMesh::undoSplit(unsigned i)
+{
+    const VertexSplit &split = m_splits[i];
+
+    m_indices.resize(m_indices.size() - split.faces.size());
+
+    for (size_t k = 0; k < split.corners.size(); k++)
+        m_indices[split.corners[k]] = split.parent;
+}
+
+void ProgressiveMesh::setLevel(unsigned level)
+{
+    level = min(level, (unsigned)m_splits.size());
+
+    while (m_level < level)
+        applySplit(m_level++);
+
+    while (m_level > level)
+        undoSplit(--m_level);
+}
+
+void ProgressiveMesh::selectError(float tolerance)
+{
+    // Split errors never increase along the stream, so walk in whichever direction is needed.
+    while (m_level < m_splits.size() && m_splits[m_level].error > tolerance)
+        applySplit(m_level++);
+
+    while (m_level > 0 && m_splits[m_level - 1].error <= tolerance)
+        undoSplit(--m_level);
+}
+
+bool ProgressiveMesh::write(FILE *file) const
+{
+    // Write the fully coarsened base mesh, whatever level is currently shown.
+    ProgressiveMesh base = *this;
+    base.setLevel(0);
+
+    unsigned header[5] =
+    {
+        PM_MAGIC, PM_VERSION,
+        m_baseVertexCount,
+        (unsigned)base.m_indices.size() / 3,
+        (unsigned)m_splits.size()
+    };
+
+    vector<Vector3f> positions(m_positions.begin(), m_positions.begin() + m_baseVertexCount);
+    vector<Vector3f> normals(m_normals.begin(), m_normals.begin() + m_baseVertexCount);
+
+    bool ok = writeArray(file, header, 5)
+        && writeArray(file, &m_baseError, 1)
+        && writeVectors(file, positions)
+        && writeVectors(file, normals)
+        && writeArray(file, base.m_indices.empty() ? NULL : &base.m_indices[0], base.m_indices.size());
+
+    for (size_t i = 0; ok && i < m_splits.size(); i++)
+    {
+        const VertexSplit &split = m_splits[i];
+        unsigned counts[3] = { split.parent, (unsigned)split.corners.size(), (unsigned)split.faces.size() / 3 };
+
+        ok = writeArray(file, counts, 3)
+            && writeArray(file, &split.position[0], 3)
+            && writeArray(file, &split.normal[0], 3)
+            && writeArray(file, &split.error, 1)
+            && writeArray(file, split.corners.empty() ? NULL : &split.corners[0], split.corners.size())
+            && writeArray(file, split.faces.empty() ? NULL : &split.faces[0], split.faces.size());
+    }
+
+    return ok;
+}
+
+void ProgressiveMesh::render(bool barycentric) const
+{
+    if (m_indices.empty())
+        return;
+
+    if (barycentric)
+    {
+        glBegin(GL_TRIANGLES);
+        for (size_t i = 0; i < m_indices.size(); i++)
+        {
+            unsigned v = m_indices[i], corner = i % 3;
+            glVertexAttrib3f(ATTRIB_BARYCENTRIC, corner == 0, corner == 1, corner == 2);
+            glNormal3f(m_normals[v][0], m_normals[v][1], m_normals[v][2]);
+            glVertex3f(m_positions[v][0], m_positions[v][1], m_positions[v][2]);
+        }
+        glEnd();
+
+        // Leave whatever is drawn next without edges.
+        glVertexAttrib3f(ATTRIB_BARYCENTRIC, 1, 1, 1);
+        return;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    glVertexPointer(3, GL_FLOAT, sizeof(Vector3f), &m_positions[0]);
+    glNormalPointer(GL_FLOAT, sizeof(Vector3f), &m_normals[0]);
+    glDrawElements(GL_TRIANGLES, (GLsizei)m_indices.size(), GL_UNSIGNED_INT, &m_indices[0]);
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+bool ProgressiveMesh::empty() const
+{
+    return m_positions.empty();
+}
+
+unsigned ProgressiveMesh::level() const
+{
+    return m_level;
+}
+
+unsigned ProgressiveMesh::splitCount() const
+{
+    return (unsigned)m_splits.size();
+}
+
+unsigned ProgressiveMesh::faceCount() const
+{
+    return (unsigned)m_indices.size() / 3;
+}
+
+unsigned ProgressiveMesh::vertexCount() const
+{
+    return m_baseVertexCount + m_level;
+}
+
+float ProgressiveMesh::error() const
+{
+    if (m_level < m_splits.size())
+        return m_splits[m_level].error;
+
+    return m_splits.empty() ? m_baseError : 0;
+}
+
+ProgressiveMeshStream::ProgressiveMeshStream() :
+    m_file(NULL),
+    m_baseReady(false),
+    m_baseReceived(false),
+    m_done(false),
+    m_baseError(0)
+{
+}
+
+ProgressiveMeshStream::~ProgressiveMeshStream()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool ProgressiveMeshStream::open(const string &source)
+{
+    const string socketPrefix = "unix:";
+
+    if (source.compare(0, socketPrefix.size(), socketPrefix) == 0)
+    {
+#ifndef _WIN32
+        string path = source.substr(socketPrefix.size());
+
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) < 0)
+        {
+            cerr << "Could not connect to progressive mesh socket " << path << "." << endl;
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+
+        m_file = fdopen(fd, "rb");
+#else
+        cerr << "Local sockets are not supported on this platform." << endl;
+        return false;
+#endif
+    }
+    else
+    {
+        m_file = fopen(source.c_str(), "rb");
+    }
+
+    if (!m_file)
+    {
+        cerr << "Could not open progressive mesh " << source << "." << endl;
+        return false;
+    }
+
+    m_thread = thread(readLoop, this);
+    return true;
+}
+
+void ProgressiveMeshStream::readLoop(ProgressiveMeshStream *stream)
+{
+    FILE *file = stream->m_file;
+
+    unsigned header[5];
+    float baseError;
+    vector<Vector3f> positions, normals;
+    vector<unsigned> indices;
+
+    bool ok = readArray(file, header, 5) && header[0] == PM_MAGIC && header[1] == PM_VERSION
+        && header[2] <= PM_MAX_VERTICES && header[3] <= PM_MAX_FACES && header[4] <= PM_MAX_VERTICES - header[2]
+        && readArray(file, &baseError, 1);
+
+    if (ok)
+    {
+        indices.resize(header[3] * 3);
+        ok = readVectors(file, positions, header[2])
+            && readVectors(file, normals, header[2])
+            && readArray(file, indices.empty() ? NULL : &indices[0], indices.size());
+    }
+
+    // Every base triangle must use base vertices.
+    for (size_t i = 0; ok && i < indices.size(); i++)
+        ok = indices[i] < header[2];
+
+    if (!ok)
+    {
+        cerr << "Invalid progressive mesh stream." << endl;
+        fclose(file);
+
+        lock_guard<mutex> lock(stream->m_mutex);
+        stream->m_done = true;
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(stream->m_mutex);
+        stream->m_basePositions.swap(positions);
+        stream->m_baseNormals.swap(normals);
+        stream->m_baseIndices.swap(indices);
+        stream->m_baseError = baseError;
+        stream->m_baseReady = true;
+    }
+
+    // Hand splits over in small batches so the viewer can refine as they arrive.
+    const size_t batchSize = 256;
+    vector<VertexSplit> batch;
+
+    // The vertices and index slots there will be when each split is applied, which
+    // it may not reach past.
+    unsigned vertexCount = header[2];
+    size_t indexCount = (size_t)header[3] * 3;
+    bool valid = true;
+
+    for (unsigned i = 0; ok && i < header[4]; i++)
+    {
+        VertexSplit split;
+        unsigned counts[3];
+
+        ok = readArray(file, counts, 3);
+        if (ok)
+        {
+            valid = counts[0] < vertexCount && counts[1] <= indexCount && counts[2] <= PM_MAX_SPLIT_FACES
+                && indexCount + counts[2] * 3 <= (size_t)PM_MAX_FACES * 3;
+            ok = valid;
+        }
+
+        if (ok)
+        {
+            split.parent = counts[0];
+            split.corners.resize(counts[1]);
+            split.faces.resize(counts[2] * 3);
+
+            ok = readArray(file, &split.position[0], 3)
+                && readArray(file, &split.normal[0], 3)
+                && readArray(file, &split.error, 1)
+                && readArray(file, split.corners.empty() ? NULL : &split.corners[0], split.corners.size())
+                && readArray(file, split.faces.empty() ? NULL : &split.faces[0], split.faces.size());
+        }
+
+        // Corners must be slots that exist, and the new triangles may use the new vertex.
+        for (size_t k = 0; ok && k < split.corners.size(); k++)
+            ok = valid = split.corners[k] < indexCount;
+        for (size_t k = 0; ok && k < split.faces.size(); k++)
+            ok = valid = split.faces[k] <= vertexCount;
+
+        if (ok)
+        {
+            batch.push_back(split);
+            vertexCount++;
+            indexCount += split.faces.size();
+        }
+
+        if (batch.size() >= batchSize || i + 1 == header[4] || !ok)
+        {
+            lock_guard<mutex> lock(stream->m_mutex);
+            stream->m_pending.insert(stream->m_pending.end(), batch.begin(), batch.end());
+            batch.clear();
+        }
+    }
+
+    if (!valid)
+        cerr << "Invalid progressive mesh stream." << endl;
+    else if (!ok)
+        cerr << "Progressive mesh stream ended early." << endl;
+
+    fclose(file);
+
+    lock_guard<mutex> lock(stream->m_mutex);
+    stream->m_done = true;
+}
+
+bool ProgressiveMeshStream::receive(ProgressiveMesh &mesh)
+{
+    lock_guard<mutex> lock(m_mutex);
+    bool changed = false;
+
+    if (m_baseReady && !m_baseReceived)
+    {
+        mesh.setBase(m_basePositions, m_baseNormals, m_baseIndices, m_baseError);
+        m_baseReceived = true;
+        changed = true;
+    }
+
+    if (m_baseReceived && !m_pending.empty())
+    {
+        for (size_t i = 0; i < m_pending.size(); i++)
+            mesh.appendSplit(m_pending[i]);
+
+        m_pending.clear();
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool ProgressiveMeshStream::finished()
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_done && m_pending.empty() && (m_baseReceived || !m_baseReady);
+}
@@ -0,0 +1,136 @@
+#ifndef PROGRESSIVE_MESH_H
+#define PROGRESSIVE_MESH_H
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vecmath.h"
+
+// A single vertex split record. Applying it re-introduces one vertex that was
+// collapsed into its parent while the mesh was simplified.
+struct VertexSplit
+{
+    // Index of the vertex the new vertex splits away from.
+    unsigned parent;
+
+    // Position and normal of the new vertex.
+    Vector3f position;
+    Vector3f normal;
+
+    // Geometric error of the mesh before this split is applied.
+    float error;
+
+    // Index buffer slots that move from the parent to the new vertex.
+    std::vector<unsigned> corners;
+
+    // Triangles appended by this split (three vertex indices each).
+    std::vector<unsigned> faces;
+};
+
+// A base mesh plus an ordered list of vertex splits that refine it back to full detail.
+// Vertex i of the refined mesh is introduced by split (i - base vertex count), so the
+// level of detail can be moved continuously in either direction.
+class ProgressiveMesh
+{
+public:
+
+    ProgressiveMesh();
+
+    // Simplifies an OBJ-style mesh (see loadInput) down to roughly baseFaces triangles
+    // and stores the collapses in reverse as vertex splits.
+    void build(const std::vector<Vector3f> &positions, const std::vector<Vector3f> &normals,
+        const std::vector<std::vector<unsigned> > &faces, unsigned baseFaces);
+
+    // Replaces the mesh with a base mesh and no splits.
+    void setBase(const std::vector<Vector3f> &positions, const std::vector<Vector3f> &normals,
+        const std::vector<unsigned> &indices, float error);
+
+    // Appends a split record to the end of the refinement stream.
+    void appendSplit(const VertexSplit &split);
+
+    // Refines or coarsens until the given number of splits are applied.
+    void setLevel(unsigned level);
+
+    // Refines or coarsens to the coarsest level whose error is within the tolerance.
+    void selectError(float tolerance);
+
+    // Writes the base mesh and every split record in the streaming format.
+    bool write(FILE *file) const;
+
+    // Draws the mesh at its current level of detail. With barycentric set, each
+    // corner gets its own coordinate in ATTRIB_BARYCENTRIC for the lighting shaders'
+    // wireframe, which takes drawing every corner on its own.
+    void render(bool barycentric) const;
+
+    bool empty() const;
+    unsigned level() const;
+    unsigned splitCount() const;
+    unsigned faceCount() const;
+    unsigned vertexCount() const;
+
+    // Error of the mesh at its current level of detail.
+    float error() const;
+
+private:
+
+    void applySplit(unsigned i);
+    void undoSplit(unsigned i);
+
+    // Every known vertex: the base vertices followed by one per received split.
+    std::vector<Vector3f> m_positions;
+    std::vector<Vector3f> m_normals;
+
+    // Index buffer of the mesh at its current level of detail.
+    std::vector<unsigned> m_indices;
+
+    std::vector<VertexSplit> m_splits;
+
+    unsigned m_baseVertexCount;
+    float m_baseError;
+    unsigned m_level;
+};
+
+// Reads a progressive mesh from a file or local socket on a background thread,
+// so the viewer can draw the base mesh while the splits are still arriving.
+class ProgressiveMeshStream
+{
+public:
+
+    ProgressiveMeshStream();
+
+    // Waits for the reading thread to end, which it does once the stream is finished.
+    ~ProgressiveMeshStream();
+
+    // Opens a file path, or a local socket path prefixed with "unix:", and starts reading.
+    bool open(const std::string &source);
+
+    // Moves everything that arrived since the last call into the mesh.
+    // Returns true if the mesh changed.
+    bool receive(ProgressiveMesh &mesh);
+
+    // Returns true once the whole stream has been received.
+    bool finished();
+
+private:
+
+    static void readLoop(ProgressiveMeshStream *stream);
+
+    FILE *m_file;
+    std::thread m_thread;
+
+    // Guards everything below, which is shared with the reading thread.
+    std::mutex m_mutex;
+
+    bool m_baseReady;
+    bool m_baseReceived;
+    bool m_done;
+    std::vector<Vector3f> m_basePositions;
+    std::vector<Vector3f> m_baseNormals;
+    std::vector<unsigned> m_baseIndices;
+    float m_baseError;
+    std::vector<VertexSplit> m_pending;
+};
+
+#endif // PROGRESSIVE_MESH_H
@@ -0,0 +1,217 @@
+#include "ScalarField.h"
+#include "GLStateCache.h"
+#include "LightingShader.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+using namespace std;
+
+namespace
+{
+    // The colormap's hue, chroma, and luma at either end, chosen so that every color
+    // between them is in gamut but for the red end, whose red comes out a hair over
+    // full and is clamped after conversion.
+    const float LOW_HUE = 2.0f / 3.0f;
+    const float HIGH_HUE = 0;
+    const float CHROMA = 0.5f;
+    const float LOW_LUMA = 0.4f;
+    const float HIGH_LUMA = 0.65f;
+}
+
+ScalarField::ScalarField() :
+    m_low(0),
+    m_high(1),
+    m_minimum(0),
+    m_maximum(1),
+    m_vertexBuffer(0),
+    m_indexBuffer(0),
+    m_colorBuffer(0),
+    m_recolorMilliseconds(0)
+{
+}
+
+void ScalarField::destroy()
+{
+    if (m_vertexBuffer)
+        glState.deleteBuffers(1, &m_vertexBuffer);
+    if (m_indexBuffer)
+        glState.deleteBuffers(1, &m_indexBuffer);
+    if (m_colorBuffer)
+        glState.deleteBuffers(1, &m_colorBuffer);
+
+    m_vertexBuffer = 0;
+    m_indexBuffer = 0;
+    m_colorBuffer = 0;
+}
+
+bool ScalarField::load(const char *path, size_t count)
+{
+    ifstream input(path);
+    if (!input)
+        return false;
+
+    m_values.clear();
+    m_values.reserve(count);
+
+    float value;
+    while (input >> value)
+        m_values.push_back(value);
+
+    // Stopping anywhere but the end means something that was not a number.
+    if (!input.eof() || m_values.size() != count || m_values.empty())
+    {
+        m_values.clear();
+        return false;
+    }
+
+    m_minimum = *min_element(m_values.begin(), m_values.end());
+    m_maximum = *max_element(m_values.begin(), m_values.end());
+    m_low = m_minimum;
+    m_high = m_maximum;
+    return true;
+}
+
+bool ScalarField::create(const vector<Vector3f> &positions, const vector<Vector3f> &normals,
+    const vector<vector<unsigned> > &faces)
+{
+    if (m_values.empty())
+        return false;
+
+    m_mesh.build(positions, normals, faces);
+    if (m_mesh.empty())
+        return false;
+
+    glGenBuffers(1, &m_vertexBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_mesh.vertices.size() * sizeof(MeshVertex), &m_mesh.vertices[0], GL_STATIC_DRAW);
+
+    // The colors are rewritten whenever the range changes.
+    glGenBuffers(1, &m_colorBuffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_colorBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_mesh.vertices.size() * sizeof(RGB), NULL, GL_DYNAMIC_DRAW);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &m_indexBuffer);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_mesh.indices.size() * sizeof(unsigned), &m_mesh.indices[0], GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    m_hcy.assign(m_mesh.vertices.size(), HCY(1, 0, 0, 0));
+    m_colors.resize(m_mesh.vertices.size());
+    recolor();
+
+    return true;
+}
+
+bool ScalarField::valid() const
+{
+    return m_colorBuffer != 0;
+}
+
+void ScalarField::setRange(float low, float high)
+{
+    if (low == m_low && high == m_high)
+        return;
+
+    m_low = low;
+    m_high = high;
+    if (valid())
+        recolor();
+}
+
+void ScalarField::scaleRange(float factor)
+{
+    float middle = (m_low + m_high) * 0.5f;
+    float halfWidth = (m_high - m_low) * 0.5f * factor;
+    setRange(middle - halfWidth, middle + halfWidth);
+}
+
+float ScalarField::low() const
+{
+    return m_low;
+}
+
+float ScalarField::high() const
+{
+    return m_high;
+}
+
+float ScalarField::minimum() const
+{
+    return m_minimum;
+}
+
+float ScalarField::maximum() const
+{
+    return m_maximum;
+}
+
+HCY ScalarField::colormap(float t)
+{
+    return HCY(1, LOW_HUE + (HIGH_HUE - LOW_HUE) * t, CHROMA, LOW_LUMA + (HIGH_LUMA - LOW_LUMA) * t);
+}
+
+void ScalarField::recolor()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // A range of no width puts every value at one end or the other.
+    float scale = m_high > m_low ? 1 / (m_high - m_low) : 0;
+
+    // Map every vertex's value through its OBJ vertex, then convert them all at once.
+    size_t count = m_mesh.vertices.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        float t = (m_values[m_mesh.origins[i]] - m_low) * scale;
+        m_hcy[i] = colormap(t >= 0 ? min(t, 1.0f) : 0);
+    }
+    hcy2rgb(&m_hcy[0], &m_colors[0], count);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+            m_colors[i].values[channel] = min(max(m_colors[i].values[channel], 0.0f), 1.0f);
+    }
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_colorBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(RGB), &m_colors[0]);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_recolorMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void ScalarField::draw()
+{
+    // Positions and normals go through the fixed-function arrays the lighting shaders
+    // read, and colors through their color attribute.
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), (const GLvoid *)0);
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), (const GLvoid *)sizeof(Vector3f));
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_colorBuffer);
+    glEnableVertexAttribArray(ATTRIB_COLOR);
+    glVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(RGB), (const GLvoid *)0);
+
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glDrawElements(GL_TRIANGLES, (GLsizei)m_mesh.indices.size(), GL_UNSIGNED_INT, (const GLvoid *)0);
+
+    // Leave whatever is drawn next white.
+    glDisableVertexAttribArray(ATTRIB_COLOR);
+    glVertexAttrib4f(ATTRIB_COLOR, 1, 1, 1, 1);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned ScalarField::vertexCount() const
+{
+    return (unsigned)m_mesh.vertices.size();
+}
+
+double ScalarField::recolorMilliseconds() const
+{
+    return m_recolorMilliseconds;
+}
@@ -0,0 +1,88 @@
+#ifndef SCALAR_FIELD_H
+#define SCALAR_FIELD_H
+
+#include <vector>
+#include "MeshBuffer.h"
+#include "HcyColor.h"
+
+// How much narrowing or widening the colormap's range scales it by.
+#define SCALAR_RANGE_STEP 1.25f
+
+// A value per vertex of the mesh, such as deviation, stress, or curvature, drawn as
+// a color on it. The colormap runs from blue at the low end of its range to red at
+// the high end through cyan, green, and yellow in HCY, with the luma rising evenly
+// so the order still reads where hues are hard to tell apart; values beyond the
+// range take its ends. The mesh is indexed into static position and normal buffers
+// with the colors in a buffer of their own, so changing the range converts the
+// colors in one batch and rewrites that buffer alone.
+class ScalarField
+{
+public:
+
+    ScalarField();
+
+    // Reads whitespace-separated values, one for each of count vertices in the order
+    // of the mesh's v lines. Returns false if the file cannot be read or holds a
+    // different number of values. The range is set to the values' extent.
+    bool load(const char *path, size_t count);
+
+    // Indexes an OBJ-style mesh (see loadInput) and creates its buffers. Returns
+    // false if nothing was loaded or the mesh is empty.
+    bool create(const std::vector<Vector3f> &positions, const std::vector<Vector3f> &normals,
+        const std::vector<std::vector<unsigned> > &faces);
+
+    // Frees the GL objects, which must happen while the context they were made in
+    // is current.
+    void destroy();
+
+    bool valid() const;
+
+    // Maps values from low to high across the colormap, recoloring the mesh.
+    void setRange(float low, float high);
+
+    // Scales the range about its middle, narrowing it below 1 and widening it above.
+    void scaleRange(float factor);
+
+    float low() const;
+    float high() const;
+
+    // The smallest and largest value loaded.
+    float minimum() const;
+    float maximum() const;
+
+    // Draws the mesh colored by its values, with the current lighting, which must be
+    // one of the lighting shaders.
+    void draw();
+
+    unsigned vertexCount() const;
+
+    // The CPU time the last recoloring took to map, convert, and upload the colors.
+    double recolorMilliseconds() const;
+
+    // The colormap's color for a value at a fraction t of the range.
+    static HCY colormap(float t);
+
+private:
+
+    // Converts every vertex's value to a color and uploads the colors.
+    void recolor();
+
+    std::vector<float> m_values;
+    float m_low;
+    float m_high;
+    float m_minimum;
+    float m_maximum;
+
+    IndexedMesh m_mesh;
+    GLuint m_vertexBuffer;
+    GLuint m_indexBuffer;
+
+    // Each vertex's color, in HCY for the batch conversion and in RGB for GL.
+    std::vector<HCY> m_hcy;
+    std::vector<RGB> m_colors;
+    GLuint m_colorBuffer;
+
+    double m_recolorMilliseconds;
+};
+
+#endif // SCALAR_FIELD_H
@@ -0,0 +1,130 @@
+#include "Shader.h"
+#include "GLStateCache.h"
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // Compiles one shader stage. Returns 0 on failure.
+    GLuint compileShader(GLenum type, const char *source)
+    {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+
+        GLint status = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            GLint length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+            vector<char> log(length + 1);
+            glGetShaderInfoLog(shader, length, NULL, &log[0]);
+            cerr << "Shader compilation failed:" << endl << &log[0] << endl;
+
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        return shader;
+    }
+}
+
+ShaderProgram::ShaderProgram() :
+    m_program(0)
+{
+}
+
+bool ShaderProgram::create(const char *vertexSource, const char *fragmentSource, const char *const *attributes)
+{
+    destroy();
+
+    GLuint vertex = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+    if (vertex && fragment)
+    {
+        m_program = glCreateProgram();
+        glAttachShader(m_program, vertex);
+        glAttachShader(m_program, fragment);
+
+        for (GLuint i = 0; attributes && attributes[i]; i++)
+            glBindAttribLocation(m_program, i, attributes[i]);
+
+        glLinkProgram(m_program);
+    }
+
+    // The program keeps the stages alive for as long as it needs them.
+    if (vertex)
+        glDeleteShader(vertex);
+    if (fragment)
+        glDeleteShader(fragment);
+
+    if (!m_program)
+        return false;
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(m_program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        GLint length = 0;
+        glGetProgramiv(m_program, GL_INFO_LOG_LENGTH, &length);
+
+        vector<char> log(length + 1);
+        glGetProgramInfoLog(m_program, length, NULL, &log[0]);
+        cerr << "Shader linking failed:" << endl << &log[0] << endl;
+
+        destroy();
+        return false;
+    }
+
+    return true;
+}
+
+void ShaderProgram::destroy()
+{
+    if (m_program)
+        glDeleteProgram(m_program);
+
+    m_program = 0;
+    m_uniforms.clear();
+}
+
+void ShaderProgram::use() const
+{
+    glState.useProgram(m_program);
+}
+
+GLint ShaderProgram::uniform(const char *name) const
+{
+    map<string, GLint>::const_iterator it = m_uniforms.find(name);
+    if (it != m_uniforms.end())
+        return it->second;
+
+    GLint location = glGetUniformLocation(m_program, name);
+    m_uniforms[name] = location;
+    return location;
+}
+
+bool ShaderProgram::bindUniformBlock(const char *name, GLuint binding) const
+{
+    GLuint index = glGetUniformBlockIndex(m_program, name);
+    if (index == GL_INVALID_INDEX)
+        return false;
+
+    glUniformBlockBinding(m_program, index, binding);
+    return true;
+}
+
+GLuint ShaderProgram::id() const
+{
+    return m_program;
+}
+
+bool ShaderProgram::valid() const
+{
+    return m_program != 0;
+}
@@ -0,0 +1,42 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <map>
+#include <string>
+#include "GLExtensions.h"
+
+// A linked GLSL program built from a vertex and a fragment shader.
+class ShaderProgram
+{
+public:
+
+    ShaderProgram();
+
+    // Compiles and links the program. Attribute i of the NULL-terminated list is bound to
+    // location i. Prints the info log and returns false on failure.
+    bool create(const char *vertexSource, const char *fragmentSource, const char *const *attributes);
+
+    void destroy();
+
+    // Makes this the current program.
+    void use() const;
+
+    // Looks up a uniform location. Locations are cached after the first lookup.
+    GLint uniform(const char *name) const;
+
+    // Binds a uniform block to a uniform buffer binding point.
+    // Returns false if the program has no such block.
+    bool bindUniformBlock(const char *name, GLuint binding) const;
+
+    GLuint id() const;
+    bool valid() const;
+
+private:
+
+    GLuint m_program;
+
+    // Uniform locations looked up so far.
+    mutable std::map<std::string, GLint> m_uniforms;
+};
+
+#endif // SHADER_H
@@ -0,0 +1,178 @@
+#include "ShadowMap.h"
+#include "GLStateCache.h"
+#include "LightingShader.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // Depth offsets applied while rendering the map, which keep lit surfaces from
+    // shadowing themselves. The slope factor covers surfaces seen edge-on.
+    const float OFFSET_SLOPE = 2.0f;
+    const float OFFSET_UNITS = 4.0f;
+
+    // The nearest the frustum's near plane gets to the light, as a fraction of the
+    // light's distance or the sphere's radius, for lights inside the sphere.
+    const float MIN_NEAR_FRACTION = 0.01f;
+}
+
+ShadowMap::ShadowMap() :
+    m_texture(0),
+    m_framebuffer(0),
+    m_size(0),
+    m_rendered(false),
+    m_radius(0),
+    m_key(0),
+    m_previousFramebuffer(0),
+    m_renderCount(0)
+{
+}
+
+void ShadowMap::destroy()
+{
+    if (m_framebuffer)
+        glDeleteFramebuffers(1, &m_framebuffer);
+    if (m_texture)
+        glDeleteTextures(1, &m_texture);
+
+    m_framebuffer = 0;
+    m_texture = 0;
+}
+
+bool ShadowMap::create(int size)
+{
+    // Framebuffer objects need OpenGL 3.0 or ARB_framebuffer_object.
+    if (!glVersionAtLeast(3, 0) && !glHasExtension("GL_ARB_framebuffer_object"))
+        return false;
+
+    m_size = size;
+
+    // Compare depths when sampling, filtering the results of the four nearest texels.
+    // Everything outside the map is lit.
+    const GLfloat border[] = { 1, 1, 1, 1 };
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+
+    // Depth only: nothing is drawn to or read from a color buffer.
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    if (!complete)
+    {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteTextures(1, &m_texture);
+        m_framebuffer = m_texture = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool ShadowMap::begin(const Vector3f &light, const Vector3f &center, float radius, float key)
+{
+    if (m_rendered && light == m_light && center == m_center && radius == m_radius && key == m_key)
+        return false;
+
+    m_rendered = true;
+    m_light = light;
+    m_center = center;
+    m_radius = radius;
+    m_key = key;
+
+    // Look from the light at the sphere's center, with an up direction square to that.
+    // A light right at the center looks down.
+    Vector3f forward = center - light;
+    float distance = forward.abs();
+    forward = distance > 0 ? forward / distance : -Vector3f::UP;
+    Vector3f up = fabs(forward.y()) > 0.99f ? Vector3f::RIGHT : Vector3f::UP;
+    up = Vector3f::cross(Vector3f::cross(forward, up), forward).normalized();
+    m_view = Matrix4f::lookAt(light, light + forward, up);
+
+    // Just contain the sphere: the cone touching it, from its near to its far side.
+    float halfAngle = distance > radius ? (float)asin(radius / distance) : 1.4f;
+    float zNear = max(distance - radius, max(distance, radius) * MIN_NEAR_FRACTION);
+    float zFar = distance + radius;
+    m_projection = Matrix4f::perspectiveProjection(2 * halfAngle, 1, zNear, zFar, false);
+
+    // Draw depth into the map with the light's matrices.
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, m_previousViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, m_size, m_size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadMatrixf(m_projection);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadMatrixf(m_view);
+
+    glState.enable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(OFFSET_SLOPE, OFFSET_UNITS);
+
+    m_renderCount++;
+    return true;
+}
+
+void ShadowMap::end()
+{
+    glState.disable(GL_POLYGON_OFFSET_FILL);
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_previousFramebuffer);
+    glViewport(m_previousViewport[0], m_previousViewport[1], m_previousViewport[2], m_previousViewport[3]);
+}
+
+Matrix4f ShadowMap::eyeToShadow(const Matrix4f &modelView) const
+{
+    // Clip coordinates run from -1 to 1, texture coordinates and depth from 0 to 1.
+    Matrix4f bias = Matrix4f::translation(0.5f, 0.5f, 0.5f) * Matrix4f::uniformScaling(0.5f);
+    return bias * m_projection * m_view * modelView.inverse();
+}
+
+void ShadowMap::bind() const
+{
+    glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+bool ShadowMap::valid() const
+{
+    return m_framebuffer != 0;
+}
+
+int ShadowMap::size() const
+{
+    return m_size;
+}
+
+unsigned ShadowMap::renderCount() const
+{
+    return m_renderCount;
+}
@@ -0,0 +1,75 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include "vecmath.h"
+#include "GLExtensions.h"
+
+// The default width and height of the shadow map in texels.
+#define SHADOW_MAP_SIZE 2048
+
+// A depth map of the mesh seen from the main light, for shadowing it per pixel.
+// The light's frustum is fitted tightly around a sphere bounding the casters, so
+// every texel lands on them. The map is only re-rendered when something it depends
+// on changes: the light, the casters' placement, or the casters themselves.
+class ShadowMap
+{
+public:
+
+    ShadowMap();
+
+    // Creates a square depth texture and its framebuffer. Returns false if the
+    // context has no framebuffer objects or cannot render to this one.
+    bool create(int size);
+
+    // Frees the GL objects, which must happen while the context they were made in
+    // is current.
+    void destroy();
+
+    // Aims the light's frustum from a point light at a sphere bounding the casters,
+    // all in the same coordinates. The key identifies the casters' geometry and
+    // placement. Returns true if the map must be re-rendered, in which case depth
+    // drawing is directed into it with the light's matrices loaded until end(), and
+    // the casters must be drawn in between in the sphere's coordinates.
+    bool begin(const Vector3f &light, const Vector3f &center, float radius, float key);
+
+    // Restores the framebuffer, viewport, and matrices begin() replaced.
+    void end();
+
+    // Returns the matrix taking eye coordinates to shadow map coordinates for a
+    // modelview taking the sphere's coordinates to eye coordinates.
+    Matrix4f eyeToShadow(const Matrix4f &modelView) const;
+
+    // Binds the map to SHADOW_TEXTURE_UNIT.
+    void bind() const;
+
+    bool valid() const;
+    int size() const;
+
+    // The number of times the map has been rendered.
+    unsigned renderCount() const;
+
+private:
+
+    GLuint m_texture;
+    GLuint m_framebuffer;
+    int m_size;
+
+    // What the map was last rendered for.
+    bool m_rendered;
+    Vector3f m_light;
+    Vector3f m_center;
+    float m_radius;
+    float m_key;
+
+    // Light coordinates to shadow map coordinates, and sphere coordinates to light.
+    Matrix4f m_projection;
+    Matrix4f m_view;
+
+    // What begin() replaced.
+    GLint m_previousFramebuffer;
+    GLint m_previousViewport[4];
+
+    unsigned m_renderCount;
+};
+
+#endif // SHADOW_MAP_H
@@ -0,0 +1,138 @@
+#include "StreamBuffer.h"
+#include "GLStateCache.h"
+#include <chrono>
+
+using namespace std;
+
+StreamBuffer::StreamBuffer() :
+    m_buffer(0),
+    m_memory(NULL),
+    m_regionSize(0),
+    m_region(0),
+    m_stalls(0),
+    m_stallMilliseconds(0)
+{
+    for (int i = 0; i < STREAM_BUFFER_REGIONS; i++)
+        m_fences[i] = 0;
+}
+
+bool StreamBuffer::create(GLsizeiptr regionSize)
+{
+    destroy();
+
+    if (!glVersionAtLeast(4, 4) && !glHasExtension("GL_ARB_buffer_storage"))
+        return false;
+    if (!glBufferStorage || !glMapBufferRange || !glFenceSync || !glClientWaitSync || !glDeleteSync)
+        return false;
+
+    // The storage can never be resized or orphaned, so it stays mapped at one address.
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = regionSize * STREAM_BUFFER_REGIONS;
+
+    glGenBuffers(1, &m_buffer);
+    glState.bindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    m_memory = (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (!m_memory)
+    {
+        destroy();
+        return false;
+    }
+
+    m_regionSize = regionSize;
+    m_region = STREAM_BUFFER_REGIONS - 1;
+    return true;
+}
+
+void StreamBuffer::destroy()
+{
+    for (int i = 0; i < STREAM_BUFFER_REGIONS; i++)
+    {
+        if (m_fences[i])
+            glDeleteSync(m_fences[i]);
+        m_fences[i] = 0;
+    }
+
+    // Deleting a buffer unmaps it.
+    if (m_buffer)
+        glState.deleteBuffers(1, &m_buffer);
+
+    m_buffer = 0;
+    m_memory = NULL;
+    m_regionSize = 0;
+}
+
+void *StreamBuffer::map()
+{
+    m_region = (m_region + 1) % STREAM_BUFFER_REGIONS;
+
+    // Wait for the draws that read this region last time round, flushing them to the
+    // GPU in case they have not even been submitted yet.
+    GLsync &fence = m_fences[m_region];
+    if (fence)
+    {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            do
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            while (status == GL_TIMEOUT_EXPIRED);
+
+            m_stalls++;
+            m_stallMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        }
+
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    return m_memory + offset();
+}
+
+void StreamBuffer::fence()
+{
+    // A region drawn more than once a frame needs only its last draw's fence, which
+    // signals after the others.
+    if (m_fences[m_region])
+        glDeleteSync(m_fences[m_region]);
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint StreamBuffer::id() const
+{
+    return m_buffer;
+}
+
+GLintptr StreamBuffer::offset() const
+{
+    return m_region * m_regionSize;
+}
+
+GLsizeiptr StreamBuffer::regionSize() const
+{
+    return m_regionSize;
+}
+
+bool StreamBuffer::valid() const
+{
+    return m_memory != NULL;
+}
+
+unsigned StreamBuffer::stallCount() const
+{
+    return m_stalls;
+}
+
+double StreamBuffer::stallMilliseconds() const
+{
+    return m_stallMilliseconds;
+}
+
+void StreamBuffer::resetStatistics()
+{
+    m_stalls = 0;
+    m_stallMilliseconds = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include "GLExtensions.h"
+
+// Regions in the ring, so the CPU can fill one while the GPU still reads the two
+// before it.
+#define STREAM_BUFFER_REGIONS 3
+
+// A buffer the CPU writes fresh data into every frame without waiting on the draws
+// still reading older data. It is mapped once, persistently and coherently, and split
+// into STREAM_BUFFER_REGIONS regions used in turn. A fence is set after the draws
+// reading a region, and mapping the region again first waits on that fence, which
+// has normally long since passed. No data is copied and nothing is remapped.
+class StreamBuffer
+{
+public:
+
+    StreamBuffer();
+
+    // Creates the buffer with STREAM_BUFFER_REGIONS regions of a size and maps it for
+    // good. Returns false if the context has no persistent mapping (OpenGL 4.4 or
+    // ARB_buffer_storage).
+    bool create(GLsizeiptr regionSize);
+
+    void destroy();
+
+    // Waits until the GPU is done with the next region and returns it for writing.
+    // Writes are seen by draws issued after this without flushing.
+    void *map();
+
+    // Fences the region last mapped once the draws reading it have been issued.
+    void fence();
+
+    // The buffer, and the byte offset into it of the region last mapped, for pointing
+    // vertex arrays or other bindings into it.
+    GLuint id() const;
+    GLintptr offset() const;
+
+    GLsizeiptr regionSize() const;
+    bool valid() const;
+
+    // How many maps had to wait for the GPU, and for how long in all.
+    unsigned stallCount() const;
+    double stallMilliseconds() const;
+    void resetStatistics();
+
+private:
+
+    GLuint m_buffer;
+    char *m_memory;
+    GLsizeiptr m_regionSize;
+    int m_region;
+    GLsync m_fences[STREAM_BUFFER_REGIONS];
+
+    unsigned m_stalls;
+    double m_stallMilliseconds;
+};
+
+#endif // STREAM_BUFFER_H
@@ -0,0 +1,222 @@
+#include "Transparency.h"
+#include "GLStateCache.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // Covers the screen with one triangle.
+    const char *compositeVertexShader =
+        "#version 330 compatibility\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;\n"
+        "    gl_Position = vec4(corner, 0.0, 1.0);\n"
+        "}\n";
+
+    // The targets were drawn in the same viewport, so each pixel reads its own
+    // texel. Pixels nothing was drawn over let everything through and are skipped.
+    const char *compositeFragmentShader =
+        "#version 330 compatibility\n"
+        "uniform sampler2D accumulation;\n"
+        "uniform sampler2D weights;\n"
+        "out vec4 fragColor;\n"
+        "void main()\n"
+        "{\n"
+        "    ivec2 texel = ivec2(gl_FragCoord.xy);\n"
+        "    vec4 sum = texelFetch(accumulation, texel, 0);\n"
+        "    if (sum.a >= 1.0)\n"
+        "        discard;\n"
+        "\n"
+        "    float weight = texelFetch(weights, texel, 0).r;\n"
+        "    fragColor = vec4(sum.rgb / max(weight, 1e-5), 1.0 - sum.a);\n"
+        "}\n";
+
+    // Makes a target texture read one texel at a time.
+    GLuint createTarget(GLint format, int width, int height)
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        return texture;
+    }
+}
+
+Transparency::Transparency() :
+    m_framebuffer(0),
+    m_accumulation(0),
+    m_weights(0),
+    m_depth(0),
+    m_width(0),
+    m_height(0),
+    m_previous(0),
+    m_active(false)
+{
+}
+
+bool Transparency::create()
+{
+    // Half-float targets, gl_VertexID and texelFetch need OpenGL 3.3.
+    if (!glVersionAtLeast(3, 3) || !glDrawBuffers || !glClearBufferfv || !glBlendFuncSeparate
+        || !glActiveTexture || !m_composite.create(compositeVertexShader, compositeFragmentShader, NULL))
+        return false;
+
+    m_composite.use();
+    glUniform1i(m_composite.uniform("accumulation"), 0);
+    glUniform1i(m_composite.uniform("weights"), 1);
+    glState.useProgram(0);
+
+    return true;
+}
+
+bool Transparency::valid() const
+{
+    return m_composite.valid();
+}
+
+bool Transparency::resize(int width, int height)
+{
+    destroy();
+
+    m_accumulation = createTarget(GL_RGBA16F, width, height);
+    m_weights = createTarget(GL_R16F, width, height);
+
+    // Depth is only tested, never read back, so it need not be a texture.
+    glGenRenderbuffers(1, &m_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_accumulation, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_weights, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+
+    const GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, buffers);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_previous);
+
+    if (!complete)
+    {
+        destroy();
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+void Transparency::destroy()
+{
+    if (m_framebuffer)
+        glDeleteFramebuffers(1, &m_framebuffer);
+    if (m_accumulation)
+        glDeleteTextures(1, &m_accumulation);
+    if (m_weights)
+        glDeleteTextures(1, &m_weights);
+    if (m_depth)
+        glDeleteRenderbuffers(1, &m_depth);
+
+    m_framebuffer = 0;
+    m_accumulation = 0;
+    m_weights = 0;
+    m_depth = 0;
+    m_width = 0;
+    m_height = 0;
+}
+
+void Transparency::begin()
+{
+    if (!valid())
+        return;
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previous);
+
+    // Grow the targets to cover the viewport; they are never shrunk, so views and
+    // scaled frames smaller than the last do not reallocate them.
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    int width = viewport[0] + viewport[2], height = viewport[1] + viewport[3];
+    if (width > m_width || height > m_height)
+    {
+        if (!resize(max(width, m_width), max(height, m_height)))
+            return;
+    }
+
+    m_active = true;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+
+    // Start the viewport with no color, no weight, everything let through, and
+    // nothing in front.
+    const GLfloat clearAccumulation[] = { 0, 0, 0, 1 };
+    const GLfloat clearWeights[] = { 0, 0, 0, 0 };
+    const GLfloat clearDepth = 1;
+    glState.enable(GL_SCISSOR_TEST);
+    glScissor(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+    glClearBufferfv(GL_COLOR, 1, clearWeights);
+    glState.depthMask(GL_TRUE);
+    glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+    glState.disable(GL_SCISSOR_TEST);
+}
+
+void Transparency::beginLayers()
+{
+    if (!m_active)
+        return;
+
+    glState.depthMask(GL_FALSE);
+
+    // Colors and weights add up; alpha multiplies in each fragment's transparency.
+    glState.enable(GL_BLEND);
+    glState.blendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void Transparency::end()
+{
+    if (!m_active)
+        return;
+    m_active = false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_previous);
+    glState.depthMask(GL_TRUE);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_weights);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_accumulation);
+
+    // Blend the average color over the frame by the coverage of all the layers.
+    glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_composite.use();
+    glState.disable(GL_DEPTH_TEST);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState.enable(GL_DEPTH_TEST);
+    glState.useProgram(0);
+    glState.disable(GL_BLEND);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+int Transparency::width() const
+{
+    return m_width;
+}
+
+int Transparency::height() const
+{
+    return m_height;
+}
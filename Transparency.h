@@ -0,0 +1,74 @@
+#ifndef TRANSPARENCY_H
+#define TRANSPARENCY_H
+
+#include "Shader.h"
+
+// The opacity the mesh is given when it is made see-through while it is opaque.
+#define TRANSPARENCY_DEFAULT_ALPHA 0.35f
+
+// Draws see-through geometry with weighted blended order-independent transparency.
+// The accumulation pass adds every fragment's premultiplied color, scaled by a
+// weight that falls off with depth, into a half-float target while multiplying its
+// transparency into that target's alpha, and sums the weights in a second target;
+// the composite pass divides the weights out and blends the average color over the
+// frame by what the product lets through. Nothing is sorted, so the cost is the
+// fragments drawn plus one pass over the pixels however large the mesh is. One layer
+// comes out exact; more are an average ordered only by their weights, which is
+// close enough to see the parts inside a shell.
+class Transparency
+{
+public:
+
+    Transparency();
+
+    // Compiles the composite program. Returns false if the context has no OpenGL
+    // 3.3, in which case geometry is drawn opaque.
+    bool create();
+
+    // Frees the targets, which must happen while the context they were made in is
+    // current.
+    void destroy();
+
+    bool valid() const;
+
+    // Directs drawing in the current viewport to the accumulation targets, cleared,
+    // and grows them to cover the viewport. The targets have a depth buffer of
+    // their own: what is drawn into it before beginLayers, with depth only, hides
+    // the layers behind it.
+    void begin();
+
+    // Blends what is drawn from here on into the targets as layers. They test
+    // against the depth buffer without writing it, so every layer in front of the
+    // occluders counts.
+    void beginLayers();
+
+    // Blends the accumulated layers over the same viewport of the framebuffer that
+    // was bound at begin, and directs drawing back there.
+    void end();
+
+    // The size of the accumulation targets, or 0 before the first pass.
+    int width() const;
+    int height() const;
+
+private:
+
+    // Remakes the targets at a new size. Returns false if they cannot be drawn to.
+    bool resize(int width, int height);
+
+    ShaderProgram m_composite;
+    GLuint m_framebuffer;
+
+    // Premultiplied weighted colors with the product of transparencies in alpha,
+    // and the sum of the weights.
+    GLuint m_accumulation;
+    GLuint m_weights;
+    GLuint m_depth;
+    int m_width;
+    int m_height;
+
+    // The framebuffer drawing was directed to before, and whether a pass is open.
+    GLint m_previous;
+    bool m_active;
+};
+
+#endif // TRANSPARENCY_H
@@ -0,0 +1,364 @@
+#include "VideoRecorder.h"
+#include <cstdlib>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VIDEO_SSE2
+#endif
+
+using namespace std;
+
+namespace
+{
+    // Output is buffered in large writes, which pipes in particular prefer.
+    const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+
+    // BT.601 studio-range conversion of one pixel or one averaged 2 x 2 block,
+    // in 8.8 fixed point.
+    inline unsigned char luma(int r, int g, int b)
+    {
+        return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    inline unsigned char chromaBlue(int r, int g, int b)
+    {
+        return (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+
+    inline unsigned char chromaRed(int r, int g, int b)
+    {
+        return (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+    void lumaRow(const unsigned char *rgba, int begin, int end, unsigned char *y)
+    {
+        for (int x = begin; x < end; x++)
+            y[x] = luma(rgba[x * 4], rgba[x * 4 + 1], rgba[x * 4 + 2]);
+    }
+
+    // Averages each 2 x 2 block of two rows into one chroma sample.
+    void chromaRows(const unsigned char *top, const unsigned char *bottom, int begin, int end, unsigned char *u, unsigned char *v)
+    {
+        for (int x = begin; x < end; x += 2)
+        {
+            int c[3];
+            for (int k = 0; k < 3; k++)
+                c[k] = (top[x * 4 + k] + top[x * 4 + 4 + k] + bottom[x * 4 + k] + bottom[x * 4 + 4 + k] + 2) >> 2;
+
+            u[x / 2] = chromaBlue(c[0], c[1], c[2]);
+            v[x / 2] = chromaRed(c[0], c[1], c[2]);
+        }
+    }
+
+#ifdef VIDEO_SSE2
+    // Splits eight RGBA pixels into 16-bit red, green and blue lanes.
+    inline void unpackPixels(const unsigned char *rgba, __m128i &r, __m128i &g, __m128i &b)
+    {
+        __m128i low = _mm_loadu_si128((const __m128i *)rgba);
+        __m128i high = _mm_loadu_si128((const __m128i *)(rgba + 16));
+        __m128i mask = _mm_set1_epi32(0xff);
+
+        r = _mm_packs_epi32(_mm_and_si128(low, mask), _mm_and_si128(high, mask));
+        g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(low, 8), mask), _mm_and_si128(_mm_srli_epi32(high, 8), mask));
+        b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(low, 16), mask), _mm_and_si128(_mm_srli_epi32(high, 16), mask));
+    }
+
+    // Eight pixels per step. The weighted sum stays below 2^16, so it is exact in
+    // unsigned 16-bit lanes.
+    int lumaRowSse2(const unsigned char *rgba, int width, unsigned char *y)
+    {
+        const __m128i kr = _mm_set1_epi16(66), kg = _mm_set1_epi16(129), kb = _mm_set1_epi16(25);
+        const __m128i round = _mm_set1_epi16(128), offset = _mm_set1_epi16(16);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i r, g, b;
+            unpackPixels(rgba + x * 4, r, g, b);
+
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, kr), _mm_mullo_epi16(g, kg)),
+                _mm_add_epi16(_mm_mullo_epi16(b, kb), round));
+            __m128i value = _mm_add_epi16(_mm_srli_epi16(sum, 8), offset);
+            _mm_storel_epi64((__m128i *)(y + x), _mm_packus_epi16(value, value));
+        }
+
+        return x;
+    }
+
+    // Sums horizontal pixel pairs of sixteen pixels into eight 16-bit lanes.
+    inline __m128i pairSums(__m128i first, __m128i second)
+    {
+        const __m128i ones = _mm_set1_epi16(1);
+        return _mm_packs_epi32(_mm_madd_epi16(first, ones), _mm_madd_epi16(second, ones));
+    }
+
+    // Sixteen pixels of each row per step, giving eight chroma samples.
+    int chromaRowsSse2(const unsigned char *top, const unsigned char *bottom, int width, unsigned char *u, unsigned char *v)
+    {
+        const __m128i two = _mm_set1_epi16(2), round = _mm_set1_epi16(128), offset = _mm_set1_epi16(128);
+
+        int x = 0;
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+            unpackPixels(top + x * 4, r0, g0, b0);
+            unpackPixels(top + x * 4 + 32, r1, g1, b1);
+            unpackPixels(bottom + x * 4, r2, g2, b2);
+            unpackPixels(bottom + x * 4 + 32, r3, g3, b3);
+
+            __m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(pairSums(r0, r1), pairSums(r2, r3)), two), 2);
+            __m128i g = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(pairSums(g0, g1), pairSums(g2, g3)), two), 2);
+            __m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(pairSums(b0, b1), pairSums(b2, b3)), two), 2);
+
+            // Each weighted sum lies within a signed 16-bit lane.
+            __m128i cb = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(-38)), _mm_mullo_epi16(g, _mm_set1_epi16(-74)));
+            cb = _mm_add_epi16(_mm_add_epi16(cb, _mm_mullo_epi16(b, _mm_set1_epi16(112))), round);
+            cb = _mm_add_epi16(_mm_srai_epi16(cb, 8), offset);
+
+            __m128i cr = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)), _mm_mullo_epi16(g, _mm_set1_epi16(-94)));
+            cr = _mm_add_epi16(_mm_add_epi16(cr, _mm_mullo_epi16(b, _mm_set1_epi16(-18))), round);
+            cr = _mm_add_epi16(_mm_srai_epi16(cr, 8), offset);
+
+            _mm_storel_epi64((__m128i *)(u + x / 2), _mm_packus_epi16(cb, cb));
+            _mm_storel_epi64((__m128i *)(v + x / 2), _mm_packus_epi16(cr, cr));
+        }
+
+        return x;
+    }
+#endif
+}
+
+void rgbaToYuv420(const unsigned char *rgba, int width, int height, unsigned char *yuv)
+{
+    unsigned char *yPlane = yuv;
+    unsigned char *uPlane = yPlane + width * height;
+    unsigned char *vPlane = uPlane + (width / 2) * (height / 2);
+    size_t stride = (size_t)width * 4;
+
+    // GL rows run bottom to top; video rows run top to bottom.
+    for (int row = 0; row < height; row += 2)
+    {
+        const unsigned char *top = rgba + (height - 1 - row) * stride;
+        const unsigned char *bottom = top - stride;
+        unsigned char *u = uPlane + (row / 2) * (width / 2);
+        unsigned char *v = vPlane + (row / 2) * (width / 2);
+
+        int lumaDone = 0, chromaDone = 0;
+#ifdef VIDEO_SSE2
+        lumaDone = lumaRowSse2(top, width, yPlane + row * width);
+        lumaRowSse2(bottom, width, yPlane + (row + 1) * width);
+        chromaDone = chromaRowsSse2(top, bottom, width, u, v);
+#endif
+
+        lumaRow(top, lumaDone, width, yPlane + row * width);
+        lumaRow(bottom, lumaDone, width, yPlane + (row + 1) * width);
+        chromaRows(top, bottom, chromaDone, width, u, v);
+    }
+}
+
+VideoRecorder::VideoRecorder() :
+    m_file(NULL),
+    m_format(VIDEO_Y4M),
+    m_width(0),
+    m_height(0),
+    m_skipped(0),
+    m_waits(0),
+    m_written(0),
+    m_stopping(false)
+{
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    close();
+}
+
+bool VideoRecorder::open(const string &target, VideoFormat format, int width, int height, int framesPerSecond)
+{
+    const string descriptorPrefix = "fd:";
+
+    if (target.compare(0, descriptorPrefix.size(), descriptorPrefix) == 0)
+    {
+#ifndef _WIN32
+        m_file = fdopen(atoi(target.c_str() + descriptorPrefix.size()), "wb");
+#else
+        cerr << "Recording to file descriptors is not supported on this platform." << endl;
+        return false;
+#endif
+    }
+    else
+    {
+        m_file = fopen(target.c_str(), "wb");
+    }
+
+    if (!m_file)
+    {
+        cerr << "Could not open video output " << target << "." << endl;
+        return false;
+    }
+
+    setvbuf(m_file, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    m_format = format;
+    m_width = width & ~1;
+    m_height = height & ~1;
+    m_skipped = 0;
+    m_waits = 0;
+    m_written = 0;
+    m_stopping = false;
+
+    if (format == VIDEO_Y4M)
+        fprintf(m_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", m_width, m_height, framesPerSecond);
+
+    m_thread = thread(writeLoop, this);
+    return true;
+}
+
+void VideoRecorder::close()
+{
+    if (!m_file)
+        return;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_queued.notify_one();
+    m_thread.join();
+
+    fclose(m_file);
+    m_file = NULL;
+}
+
+void VideoRecorder::write(Image &image)
+{
+    if (!m_file)
+        return;
+
+    // Frames are read at the video size, so any other size means the window shrank.
+    if (image.width != m_width || image.height != m_height)
+    {
+        m_skipped++;
+        return;
+    }
+
+    unique_lock<mutex> lock(m_mutex);
+
+    if (m_queue.size() >= VIDEO_QUEUE_FRAMES)
+    {
+        m_waits++;
+        while (m_queue.size() >= VIDEO_QUEUE_FRAMES)
+            m_space.wait(lock);
+    }
+
+    m_queue.push_back(Image());
+    m_queue.back().width = image.width;
+    m_queue.back().height = image.height;
+    m_queue.back().pixels.swap(image.pixels);
+
+    if (!m_free.empty())
+    {
+        image.pixels.swap(m_free.back());
+        m_free.pop_back();
+    }
+
+    lock.unlock();
+    m_queued.notify_one();
+}
+
+bool VideoRecorder::recording() const
+{
+    return m_file != NULL;
+}
+
+int VideoRecorder::width() const
+{
+    return m_width;
+}
+
+int VideoRecorder::height() const
+{
+    return m_height;
+}
+
+unsigned VideoRecorder::framesWritten()
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_written;
+}
+
+unsigned VideoRecorder::framesSkipped() const
+{
+    return m_skipped;
+}
+
+unsigned VideoRecorder::waits() const
+{
+    return m_waits;
+}
+
+void VideoRecorder::writeLoop(VideoRecorder *recorder)
+{
+    unique_lock<mutex> lock(recorder->m_mutex);
+
+    for (;;)
+    {
+        while (recorder->m_queue.empty() && !recorder->m_stopping)
+            recorder->m_queued.wait(lock);
+
+        // Only stop once everything queued has been written.
+        if (recorder->m_queue.empty())
+            return;
+
+        Image image;
+        image.width = recorder->m_queue.front().width;
+        image.height = recorder->m_queue.front().height;
+        image.pixels.swap(recorder->m_queue.front().pixels);
+        recorder->m_queue.pop_front();
+
+        // Convert and write while frames keep coming.
+        lock.unlock();
+        recorder->m_space.notify_one();
+        bool written = recorder->writeFrame(image);
+        lock.lock();
+
+        if (written)
+            recorder->m_written++;
+
+        recorder->m_free.push_back(vector<unsigned char>());
+        recorder->m_free.back().swap(image.pixels);
+    }
+}
+
+bool VideoRecorder::writeFrame(const Image &image)
+{
+    int width = m_width, height = m_height;
+
+    if (m_format == VIDEO_RGB)
+    {
+        m_frame.resize((size_t)width * height * 3);
+        for (int row = 0; row < height; row++)
+        {
+            const unsigned char *source = &image.pixels[(size_t)(height - 1 - row) * width * 4];
+            unsigned char *destination = &m_frame[(size_t)row * width * 3];
+            for (int x = 0; x < width; x++)
+            {
+                destination[x * 3] = source[x * 4];
+                destination[x * 3 + 1] = source[x * 4 + 1];
+                destination[x * 3 + 2] = source[x * 4 + 2];
+            }
+        }
+    }
+    else
+    {
+        m_frame.resize((size_t)width * height * 3 / 2);
+        rgbaToYuv420(&image.pixels[0], width, height, &m_frame[0]);
+
+        if (m_format == VIDEO_Y4M)
+            fputs("FRAME\n", m_file);
+    }
+
+    return fwrite(&m_frame[0], 1, m_frame.size(), m_file) == m_frame.size();
+}
@@ -0,0 +1,102 @@
+#ifndef VIDEO_RECORDER_H
+#define VIDEO_RECORDER_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PixelReadback.h"
+
+// Number of frames that may wait for the writer before recording holds up drawing.
+#define VIDEO_QUEUE_FRAMES 8
+
+// How recorded frames are stored.
+enum VideoFormat
+{
+    // YUV4MPEG2 with 4:2:0 chroma, which players and encoders read directly.
+    VIDEO_Y4M,
+
+    // Headerless 8-bit RGB frames, top row first.
+    VIDEO_RGB,
+
+    // Headerless planar 4:2:0 YUV frames.
+    VIDEO_YUV
+};
+
+// Converts one frame of RGBA pixels, bottom row first, to planar 4:2:0 YUV with BT.601
+// studio-range coefficients, top row first. Width and height must be even. Uses SSE2
+// where available; either way the result is the same.
+void rgbaToYuv420(const unsigned char *rgba, int width, int height, unsigned char *yuv);
+
+// Streams frames to a file, named pipe, or file descriptor from a writer thread.
+// Frames wait in a queue of at most VIDEO_QUEUE_FRAMES; when it is full, adding a
+// frame blocks until the writer catches up, so a slow output slows drawing rather than
+// growing memory or dropping frames.
+class VideoRecorder
+{
+public:
+
+    VideoRecorder();
+
+    // Finishes writing every queued frame and closes the output.
+    ~VideoRecorder();
+
+    // Opens a path, or a file descriptor written as "fd:N", for frames of the given
+    // size and rate. Odd sizes are rounded down, since 4:2:0 chroma covers pixel pairs,
+    // so check width() and height() for the size to read frames at.
+    bool open(const std::string &target, VideoFormat format, int width, int height, int framesPerSecond);
+
+    // Writes the queued frames and closes the output.
+    void close();
+
+    // Queues a frame, taking its pixels and handing back a used buffer in their place.
+    // Frames of another size than the video are skipped. May block until the writer
+    // has room.
+    void write(Image &image);
+
+    bool recording() const;
+
+    // The video size, in pixels.
+    int width() const;
+    int height() const;
+
+    // Frames written and skipped, and how many times drawing had to wait for the writer.
+    unsigned framesWritten();
+    unsigned framesSkipped() const;
+    unsigned waits() const;
+
+private:
+
+    static void writeLoop(VideoRecorder *recorder);
+
+    // Converts and writes one frame. Called on the writer thread.
+    bool writeFrame(const Image &image);
+
+    FILE *m_file;
+    VideoFormat m_format;
+    int m_width;
+    int m_height;
+    unsigned m_skipped;
+    unsigned m_waits;
+
+    // The converted frame, reused by the writer thread.
+    std::vector<unsigned char> m_frame;
+
+    std::thread m_thread;
+
+    // Guards everything below, which is shared with the writer thread.
+    std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::condition_variable m_space;
+    std::deque<Image> m_queue;
+
+    // Pixel buffers the writer is done with, handed back to be read into again.
+    std::vector<std::vector<unsigned char> > m_free;
+    unsigned m_written;
+    bool m_stopping;
+};
+
+#endif // VIDEO_RECORDER_H
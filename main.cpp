@@ -1,9 +1,39 @@
-#include "GL/freeglut.h"
+#include "GLExtensions.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include "vecmath.h"
+#include "AmbientOcclusion.h"
+#include "AntiAliasing.h"
+#include "BatchRenderer.h"
+#include "ClusteredLighting.h"
+#include "DepthPrepass.h"
+#include "DynamicResolution.h"
+#include "EnvironmentLighting.h"
+#include "FrameTimer.h"
+#include "GLStateCache.h"
+#include "GridShader.h"
+#include "HcyColor.h"
+#include "HeadlessContext.h"
+#include "ImageWriter.h"
+#include "InstancedMesh.h"
+#include "InteractionLod.h"
+#include "LightingShader.h"
+#include "MorphingMesh.h"
+#include "PixelReadback.h"
+#include "PointCloud.h"
+#include "ProgressiveMesh.h"
+#include "ScalarField.h"
+#include "ShadowMap.h"
+#include "Transparency.h"
+#include "VideoRecorder.h"
 using namespace std;
 
 // Define important constants.
@@ -22,6 +52,9 @@ using namespace std;
 // Shift amount for hue color change.
 #define HUE_SHIFT_DEGREES   1
 
+// How far the morph's ripple travels every frame, in radians of its phase.
+#define MORPH_PHASE_STEP 0.1f
+
 // Shift amount for light position change.
 #define LIGHT_SHIFT_DEGREES   15
 
@@ -34,6 +67,34 @@ using namespace std;
 // The mouse scaling factor when zooming in or out of an object.
 #define MOUSE_SCALE_FACTOR 1.1
 
+// The screen-space error, in pixels, the progressive mesh is refined down to.
+#define PM_PIXEL_ERROR 0.5
+
+// The fraction of the original faces kept in a progressive mesh's base mesh.
+#define PM_BASE_FACE_RATIO 0.02
+
+// The radius of a sphere bounding the GL teapot drawn when no mesh is loaded.
+#define TEAPOT_RADIUS 2
+
+// The fraction of a layout cell the radius of each instance fills.
+#define INSTANCE_CELL_FILL 0.4
+
+// The number of frames each configuration is timed over when benchmarking.
+#define BENCHMARK_FRAMES 100
+
+// The fewest and most point lights the light benchmark times, growing fourfold.
+#define BENCHMARK_MIN_LIGHTS 16
+#define BENCHMARK_MAX_LIGHTS 4096
+
+// The number of point lights expected to reach any point of the mesh.
+#define POINT_LIGHT_OVERLAP 6
+
+// The frame rate recordings play back at, which matches the update timer.
+#define VIDEO_FRAMES_PER_SECOND 60
+
+// The window or offscreen image size used unless one is given on the command line.
+#define DEFAULT_IMAGE_SIZE 360
+
 // Mathematical constant.
 #define PI 3.14159265358972
 
@@ -48,9 +109,12 @@ using namespace std;
 // GL list for rendering our static object.
 GLuint mesh;
 
-// GL list for rendering our grid;
+// GL list for rendering our grid when it cannot be computed per pixel.
 GLuint grid;
 
+// The reference grid computed per pixel when available.
+GridShader gridShader;
+
 // Defines the physical position of the camera. The object is always at the origin.
 Vector3f position(0, 0, 5);
 
@@ -66,9 +130,152 @@ vector<Vector3f> vecn;
 // This is the list of faces (indices into vecv and vecn).
 vector<vector<unsigned> > vecf;
 
+// The progressive mesh drawn instead of the static mesh when one is loaded.
+ProgressiveMesh progressiveMesh;
+
+// The stream a progressive mesh is being received from, if any.
+ProgressiveMeshStream *progressiveMeshStream = NULL;
+
+// A coarse copy of the mesh drawn instead of it while the view moves.
+InteractionLod interactionLod;
+
+// Copies of the mesh drawn instead of the single mesh when a layout is loaded.
+InstancedMesh instancedMesh;
+
+// Objects drawn in one batch instead of the single mesh when a scene is loaded.
+BatchRenderer batchRenderer;
+
+// Per-pixel lighting used instead of fixed-function lighting when available.
+LightingShader lightingShader;
+
+// Per-pixel lighting from many point lights binned into view clusters, when any are set.
+ClusteredLighting clusteredLighting;
+
+// The main light's view of the mesh, for shadowing it per pixel.
+ShadowMap shadowMap;
+
+// Determines whether the main light casts shadows (when available).
+bool shadowsEnabled = true;
+
+// A sphere bounding the mesh before it spins, which the shadow map is fitted to.
+Vector3f meshCenter;
+float meshRadius = TEAPOT_RADIUS;
+
+// The ambient occlusion of each vertex of the loaded mesh, baked in the background.
+AmbientOcclusion ambientOcclusion;
+
+// Determines whether baked ambient occlusion darkens the ambient light.
+bool occlusionEnabled = true;
+
+// File the ambient occlusion is cached in, if any.
+const char *occlusionCache = NULL;
+
+// Determines whether triangle edges are drawn over the shaded mesh, and how wide.
+bool wireframeEnabled = false;
+float wireframeWidth = WIREFRAME_WIDTH;
+
+// Determines whether the mesh is lit per pixel (when available) or per vertex.
+bool perPixelShading = true;
+
+// Times each pass of every frame on the CPU and the GPU.
+FrameTimer frameTimer;
+
+// Draws at a fraction of the window's resolution when frames run over budget.
+DynamicResolution dynamicResolution;
+
+// Smooths the edges of each frame by multisampling or filtering it.
+AntiAliasing antiAliasing;
+
+// Lays the mesh's depth down before shading it per pixel, when that is cheaper.
+DepthPrepass depthPrepass;
+
+// The views the quad view shows, in the order they are laid out.
+enum ViewKind
+{
+    VIEW_TOP,
+    VIEW_FRONT,
+    VIEW_SIDE,
+    VIEW_PERSPECTIVE,
+    VIEW_KINDS
+};
+
+// Each view's pass in the timings of the quad view.
+const char *VIEW_NAMES[VIEW_KINDS] = { "top", "front", "side", "persp" };
+
+// Whether to draw the top, front, and side views beside the free camera's.
+bool quadView = false;
+
+// Splats the vertices of an input that has no faces.
+PointCloud pointCloud;
+
+// Whether splats lie square to the input's normals rather than round toward the eye.
+bool splatNormals = true;
+
+// Blends every layer of the mesh by its alpha without sorting, when it is see-through.
+Transparency transparency;
+
+// Whether the mesh is drawn see-through (when available).
+bool transparent = false;
+
+// A value per vertex of the mesh, drawn through a colormap in place of its color.
+ScalarField scalarField;
+
+// Determines whether the mesh is colored by its values (when loaded).
+bool scalarsEnabled = true;
+
+// The size of the window, or of the offscreen image when headless.
+int windowWidth = DEFAULT_IMAGE_SIZE;
+int windowHeight = DEFAULT_IMAGE_SIZE;
+
+// Determines whether the pass timings are drawn over the scene.
+bool timingOverlay;
+
+// Reads screenshots back from the GPU a few frames after they are taken.
+PixelReadback pixelReadback;
+
+// Saves screenshots as PNG files in the background.
+ImageWriter imageWriter;
+
+// Determines whether the next frame is saved as a screenshot.
+bool screenshotRequested;
+
+// The number of screenshots saved so far, which numbers their files.
+unsigned screenshotCount;
+
+// Reads recorded frames back from the GPU a few frames after they are drawn.
+PixelReadback videoReadback;
+
+// Streams recorded frames to a file or pipe in the background.
+VideoRecorder videoRecorder;
+
+// The path or file descriptor frames are recorded to, if any, and how.
+const char *videoTarget = NULL;
+VideoFormat videoFormat = VIDEO_Y4M;
+
+// The number of frames to record before quitting, or 0 to record until quitting.
+unsigned videoFrameLimit;
+
+// The number of frames whose readback has started.
+unsigned videoFramesRead;
+
+// A recorded frame on its way from the GPU to the recorder, kept to reuse its memory.
+Image videoFrame;
+
+// Determines whether to benchmark on the first update and then exit.
+bool benchmarkOnStart;
+
+// Determines whether frames are drawn offscreen without a window.
+bool headless;
+
 // Light position for world.
 Vector4f Lt0pos(1, 1, 5, 1);
 
+// Ambient light from an HDR environment, which turns with the main light.
+EnvironmentLighting environmentLighting;
+
+// Determines whether the environment lights the mesh (when one is loaded).
+bool environmentEnabled = true;
+
 // Millisecond wait times indexed by frame. Sums to 60 frames per second.
 int timerInterval[] = { 17, 16, 16 };
 
@@ -78,6 +285,11 @@ bool meshSpinAnimate;
 // Determines whether the object should have an animated color cycle.
 bool diffuseColorAnimate;
 
+// The mesh rippling every frame, streamed to the GPU, and whether and how far it has.
+MorphingMesh morphingMesh;
+bool morphAnimate;
+float morphPhase = 0;
+
 // The current Y-rotated angle of the rendered object.
 GLfloat spinAngleY = 0;
 
@@ -85,176 +297,642 @@ GLfloat spinAngleY = 0;
 void rotateLightMatrix(const Vector3f &direction, float radians)
 {
     Lt0pos = Matrix4f::rotation(direction, radians) * Lt0pos;
+    environmentLighting.rotate(Matrix3f::rotation(direction, radians));
 }
 
-// Represents a color by its hue, chroma, and luma.
-struct HCY
+// The current display color in HCY form.
+HCY meshHcyColor(1, 0, 1, 0.5);
+
+// Toggles smooth color change animation on or off.
+void toggleDiffuseColorAnimate()
 {
-    GLfloat alpha;
-    GLfloat hue;
-    GLfloat chroma;
-    GLfloat luma;
+    if (diffuseColorAnimate ^= true)
+    {
+        cout << "Auto shifting hue: Enabled" << endl;
+    }
+    else
+    {
+        cout << "Auto shifting hue: Disabled" << endl;
+    }
+}
 
-    HCY(const GLfloat a, const GLfloat h, const GLfloat c, const GLfloat y)
+// Toggles spinning of mesh object on or off.
+void toggleMeshSpinAnimate()
+{
+    if (meshSpinAnimate ^= true)
+    {
+        cout << "Auto rotating: Enabled" << endl;
+    }
+    else
     {
-#define CLAMP(x) x < 0 ? 0 : (x > 1 ? 1 : x)
+        cout << "Auto rotating: Disabled" << endl;
+    }
+}
+
+// Determines whether the frame being drawn is saved, and so must be drawn in full.
+bool capturingFrame()
+{
+    return screenshotRequested || videoTarget;
+}
 
-        alpha = CLAMP(a);
-        hue = CLAMP(h);
-        chroma = CLAMP(c);
-        luma = CLAMP(y);
+// Determines whether the single mesh is drawn rippling from the stream buffer.
+bool morphing()
+{
+    return morphAnimate && morphingMesh.valid() && !batchRenderer.objectCount()
+        && !instancedMesh.instanceCount() && progressiveMesh.empty();
+}
 
-#undef CLAMP
+// Toggles the rippling morph of the mesh on or off, creating its buffers the first
+// time.
+void toggleMorph()
+{
+    if (!morphingMesh.valid() && (vecf.empty() || !morphingMesh.create(vecv, vecn, vecf)))
+    {
+        cout << "Morph: Unavailable" << endl;
+        return;
     }
 
-    // Rotate color's hue by given degrees.
-    void rotateHue(const GLfloat degrees)
+    if (morphAnimate ^= true)
+        cout << "Morph: Enabled" << endl;
+    else
+        cout << "Morph: Disabled" << endl;
+}
+
+// Toggles the coarse mesh drawn during interaction on or off.
+void toggleInteractionLod()
+{
+    interactionLod.setEnabled(!interactionLod.enabled());
+
+    if (interactionLod.enabled())
+        cout << "Interaction LOD: Enabled" << endl;
+    else
+        cout << "Interaction LOD: Disabled" << endl;
+}
+
+// Toggles baked ambient occlusion on or off.
+void toggleAmbientOcclusion()
+{
+    if (!ambientOcclusion.ready())
     {
-        float delta = degrees / 360.0f;
+        cout << "Ambient occlusion: Unavailable" << endl;
+        return;
+    }
 
-        // Add change to current hue.
-        hue += delta;
+    if (occlusionEnabled ^= true)
+        cout << "Ambient occlusion: Enabled" << endl;
+    else
+        cout << "Ambient occlusion: Disabled" << endl;
+}
 
-        // Modulus clamp the value to be between 0 and 1.
-        while (hue > 1)
-            hue -= 1;
-        while (hue < 0)
-            hue += 1;
+// Toggles splats lying square to the normals on or off.
+void toggleSplatNormals()
+{
+    if (!pointCloud.hasNormals())
+    {
+        cout << "Splat normals: Unavailable" << endl;
+        return;
     }
-} meshHcyColor(1, 0, 1, 0.5); // The current display color in HCY form.
 
-// Represents an OpenGL-styled color of floats
-union RGB
+    if (splatNormals ^= true)
+        cout << "Splat normals: Enabled" << endl;
+    else
+        cout << "Splat normals: Disabled" << endl;
+}
+
+// Whether the mesh is drawn see-through this frame: the single mesh, lit per pixel.
+bool seeThrough()
+{
+    return transparent && transparency.valid() && perPixelShading && lightingShader.valid()
+        && !batchRenderer.objectCount() && !instancedMesh.instanceCount() && pointCloud.empty();
+}
+
+// Toggles drawing the mesh see-through on or off. An opaque color is given the
+// default opacity, since blending it would show nothing through.
+void toggleTransparency()
 {
-    GLfloat values[4];
-    struct
+    if (!transparency.valid() || !lightingShader.valid())
     {
-        // Channels must be in this exact order to match OpenGL's system.
-        GLfloat red, green, blue, alpha;
-    };
-};
+        cout << "Transparency: Unavailable" << endl;
+        return;
+    }
 
-// Get an RGB color from an HCY color
-void hcy2rgb(const struct HCY &hcy, union RGB &rgb)
+    if (transparent ^= true)
+    {
+        if (meshHcyColor.alpha >= 1)
+            meshHcyColor.alpha = TRANSPARENCY_DEFAULT_ALPHA;
+        cout << "Transparency: Enabled, alpha " << meshHcyColor.alpha << endl;
+    }
+    else
+        cout << "Transparency: Disabled" << endl;
+}
+
+// Whether the mesh is colored by its values this frame, which needs per-pixel lighting.
+bool scalarColoring()
 {
-    GLfloat chroma = hcy.chroma;
+    return scalarsEnabled && scalarField.valid() && perPixelShading && lightingShader.valid();
+}
 
-    // Bound hue to [0, 6) since we have different cases depending on which integers the hue will be between.
-    GLfloat hue = hcy.hue * 6;
+// Toggles coloring the mesh by its values on or off.
+void toggleScalars()
+{
+    if (!scalarField.valid())
+    {
+        cout << "Scalars: Unavailable" << endl;
+        return;
+    }
 
-    // Initialize color to empty.
-    GLfloat r = 0.f;
-    GLfloat g = 0.f;
-    GLfloat b = 0.f;
+    if (scalarsEnabled ^= true)
+        cout << "Scalars: Enabled" << endl;
+    else
+        cout << "Scalars: Disabled" << endl;
+}
 
-    // Alpha channel is a simple copy.
-    rgb.alpha = hcy.alpha;
+// Whether the mesh as it is drawn now has the barycentric coordinates the wireframe
+// needs. The morphing and colored meshes share vertices between triangles in their
+// buffers, and layouts and point clouds have shaders of their own.
+bool wireframeAvailable()
+{
+    return perPixelShading && lightingShader.valid() && !morphing() && !scalarColoring()
+        && !batchRenderer.objectCount() && !instancedMesh.instanceCount() && pointCloud.empty();
+}
 
-    // Only care about color if there is a present chroma.
-    if (chroma > 0)
+// Toggles the wireframe over the mesh on or off.
+void toggleWireframe()
+{
+    if (!wireframeAvailable())
     {
-        // If hue's bounds are [0, 1), we have a predominately red-to-yellow color.
-        if (hue >= 0 && hue < 1)
-        {
-            r = chroma;
-            g = chroma * hue;
-        }
+        cout << "Wireframe: Unavailable" << endl;
+        return;
+    }
 
-        // [1, 2) is a yellow-to-green.
-        else if (hue >= 1 && hue < 2)
-        {
-            r = chroma * (2 - hue);
-            g = chroma;
-        }
+    if (wireframeEnabled ^= true)
+        cout << "Wireframe: Enabled" << endl;
+    else
+        cout << "Wireframe: Disabled" << endl;
+}
 
-        // Green-to-cyan.
-        else if (hue >= 2 && hue < 3)
-        {
-            g = chroma;
-            b = chroma * (hue - 2);
-        }
+// Narrows or widens the range the colormap spans, recoloring the mesh.
+void scaleScalarRange(float factor)
+{
+    if (!scalarField.valid())
+    {
+        cout << "Scalars: Unavailable" << endl;
+        return;
+    }
+
+    scalarField.scaleRange(factor);
+    cout << "Scalar range: " << scalarField.low() << " to " << scalarField.high() << endl;
+}
+
+// Toggles the top, front, and side views beside the free camera's on or off.
+void toggleQuadView()
+{
+    if (quadView ^= true)
+        cout << "Quad view: Enabled" << endl;
+    else
+        cout << "Quad view: Disabled" << endl;
+}
+
+// Toggles hiding objects behind the largest ones on or off.
+void toggleOcclusionCulling()
+{
+    if (!batchRenderer.objectCount())
+    {
+        cout << "Occlusion culling: Unavailable" << endl;
+        return;
+    }
+
+    batchRenderer.setOcclusionCulling(!batchRenderer.occlusionCulling());
+
+    if (batchRenderer.occlusionCulling())
+        cout << "Occlusion culling: Enabled" << endl;
+    else
+        cout << "Occlusion culling: Disabled" << endl;
+}
+
+// Toggles ambient light from the environment on or off.
+void toggleEnvironment()
+{
+    if (!environmentLighting.valid())
+    {
+        cout << "Environment lighting: Unavailable" << endl;
+        return;
+    }
+
+    if (environmentEnabled ^= true)
+        cout << "Environment lighting: Enabled" << endl;
+    else
+        cout << "Environment lighting: Disabled" << endl;
+}
+
+// Toggles shadows from the main light on or off.
+void toggleShadows()
+{
+    if (!shadowMap.valid())
+    {
+        cout << "Shadows: Unavailable" << endl;
+        return;
+    }
+
+    if (shadowsEnabled ^= true)
+        cout << "Shadows: Enabled" << endl;
+    else
+        cout << "Shadows: Disabled" << endl;
+}
+
+// Toggles dynamic resolution on or off.
+void toggleDynamicResolution()
+{
+    if (!dynamicResolution.valid())
+    {
+        cout << "Dynamic resolution: Unavailable" << endl;
+        return;
+    }
+
+    dynamicResolution.setEnabled(!dynamicResolution.enabled());
+
+    if (dynamicResolution.enabled())
+        cout << "Dynamic resolution: Enabled" << endl;
+    else
+        cout << "Dynamic resolution: Disabled" << endl;
+}
+
+// Says which mode frames are anti-aliased with, and how many samples it draws with
+// when the context allows fewer than the mode names.
+void printAntiAliasing()
+{
+    cout << "Anti-aliasing: " << AntiAliasing::name(antiAliasing.mode());
+    if (antiAliasing.clamped())
+        cout << ", " << antiAliasing.samples() << " samples (the most this context allows)";
+    cout << endl;
+}
 
-        // Cyan-to-blue.
-        else if (hue >= 3 && hue < 4)
+// Steps to the next anti-aliasing mode this context supports.
+void cycleAntiAliasing()
+{
+    if (!antiAliasing.valid())
+    {
+        cout << "Anti-aliasing: Unavailable" << endl;
+        return;
+    }
+
+    int mode = antiAliasing.mode();
+    do
+        mode = (mode + 1) % ANTIALIAS_MODES;
+    while (!antiAliasing.supported((AntiAliasingMode)mode));
+
+    antiAliasing.setMode((AntiAliasingMode)mode);
+    printAntiAliasing();
+}
+
+// Steps to the next depth pre-pass mode.
+void cycleDepthPrepass()
+{
+    if (!depthPrepass.valid())
+    {
+        cout << "Depth pre-pass: Unavailable" << endl;
+        return;
+    }
+
+    depthPrepass.setMode((DepthPrepassMode)((depthPrepass.mode() + 1) % DEPTH_PREPASS_MODES));
+    cout << "Depth pre-pass: " << DepthPrepass::name(depthPrepass.mode()) << endl;
+}
+
+// Formats the anti-aliasing mode and what resolving or filtering the last completed
+// frame cost, for the overlay and stats. Multisampling also slows every pass drawing
+// into it, which the benchmark measures.
+string antiAliasingLine()
+{
+    ostringstream line;
+    line << "Anti-aliasing " << AntiAliasing::name(antiAliasing.mode());
+    if (antiAliasing.samples())
+        line << " (" << antiAliasing.samples() << " samples)";
+
+    const FrameTiming &timing = frameTimer.latest();
+    for (size_t i = 0; i < timing.passes.size(); i++)
+    {
+        if (string(timing.passes[i].name) == "antialias")
         {
-            g = chroma * (4 - hue);
-            b = chroma;
+            double milliseconds = timing.passes[i].gpuMilliseconds >= 0 ? timing.passes[i].gpuMilliseconds : timing.passes[i].cpuMilliseconds;
+            line << fixed << setprecision(2) << ", " << milliseconds << " ms to "
+                << (antiAliasing.samples() ? "resolve" : "filter");
         }
+    }
+
+    return line.str();
+}
+
+// Formats the resolution the last frame was drawn at for the overlay and stats.
+string resolutionLine()
+{
+    ostringstream line;
+    line << dynamicResolution.width() << " x " << dynamicResolution.height() << " of "
+        << windowWidth << " x " << windowHeight;
+
+    if (dynamicResolution.enabled())
+    {
+        line << fixed << setprecision(0) << ", scale " << dynamicResolution.scale() * 100 << "%, "
+            << setprecision(1) << dynamicResolution.frameMilliseconds() << " of "
+            << dynamicResolution.budget() << " ms";
+    }
+
+    return line.str();
+}
+
+// Prints how many instances and objects the last frame drew, with how many draw calls,
+// and how many state changes it issued.
+void printSceneStats()
+{
+    if (instancedMesh.instanceCount())
+    {
+        cout << "Instances: " << instancedMesh.visibleCount() << " of " << instancedMesh.instanceCount()
+            << " visible, " << instancedMesh.drawCalls() << " draw calls" << endl;
+    }
 
-        // Blue-to-magenta.
-        else if (hue >= 4 && hue < 5)
+    if (batchRenderer.objectCount())
+    {
+        cout << "Objects: " << batchRenderer.visibleCount() << " of " << batchRenderer.objectCount()
+            << " visible, " << batchRenderer.meshCount() << " meshes, " << batchRenderer.drawCalls()
+            << " draw calls, " << batchRenderer.submitMilliseconds() << " ms to submit" << endl;
+
+        if (batchRenderer.occlusionCulling())
         {
-            r = chroma * (hue - 4);
-            b = chroma;
+            unsigned inView = batchRenderer.objectCount() - batchRenderer.frustumCulledCount();
+            cout << "Occlusion culling: " << batchRenderer.occlusionCulledCount() << " of " << inView
+                << " in view hidden (" << 100.0 * batchRenderer.occlusionCulledCount() / max(inView, 1u) << "%), "
+                << batchRenderer.occluderTriangles() << " occluder triangles, "
+                << batchRenderer.occlusionMilliseconds() << " ms" << endl;
         }
+    }
 
-        // This lost possible result is [5, 6) and is a magenta-to-red color.
-        else //if (hue >= 5 && hue < 6)
+    cout << "State changes: " << glState.issuedCalls() << " issued, "
+        << glState.savedCalls() << " redundant skipped" << endl;
+
+    cout << "Resolution: " << resolutionLine() << endl;
+    cout << antiAliasingLine() << endl;
+
+    if (depthPrepass.valid())
+    {
+        cout << "Depth pre-pass: " << DepthPrepass::name(depthPrepass.mode()) << ", "
+            << (depthPrepass.active() ? "drawn" : "not drawn");
+        if (depthPrepass.overdraw() > 0)
         {
-            r = chroma;
-            b = chroma * (6 - hue);
+            cout << ", overdraw " << depthPrepass.overdraw() << "x, shading " << depthPrepass.shadingMilliseconds()
+                << " ms alone or " << depthPrepass.prepassShadingMilliseconds() << " ms after a "
+                << depthPrepass.prepassMilliseconds() << " ms pre-pass";
         }
+        cout << endl;
     }
 
-    // Each color has a different defined weight in the luma color space.
-#define REDWEIGHT   0.299f
-#define GREENWEIGHT 0.587f
-#define BLUEWEIGHT  0.114f
+    if (scalarField.valid())
+    {
+        cout << "Scalars: " << scalarField.vertexCount() << " vertices, range " << scalarField.low() << " to "
+            << scalarField.high() << " of " << scalarField.minimum() << " to " << scalarField.maximum()
+            << ", " << scalarField.recolorMilliseconds() << " ms to recolor" << endl;
+    }
 
-    // The match value defines the "colorful intensity" of the color.
-    GLfloat match = hcy.luma - (REDWEIGHT * r + GREENWEIGHT * g + BLUEWEIGHT * b);
+    if (transparent && transparency.valid())
+    {
+        cout << "Transparency: alpha " << meshHcyColor.alpha << ", " << (seeThrough() ? "drawn" : "not drawn")
+            << ", targets " << transparency.width() << " x " << transparency.height() << endl;
+    }
+
+    if (clusteredLighting.lightCount())
+    {
+        cout << "Point lights: " << clusteredLighting.lightCount() << " in "
+            << CLUSTER_TILES_X << " x " << CLUSTER_TILES_Y << " x " << CLUSTER_SLICES << " clusters, "
+            << clusteredLighting.entryCount() << " cluster entries, "
+            << clusteredLighting.assignMilliseconds() << " ms to assign on up to "
+            << clusteredLighting.threadCount() << " threads" << endl;
+        clusteredLighting.resetStatistics();
+    }
 
-#undef REDWEIGHT
-#undef GREENWEIGHT
-#undef BLUEWEIGHT
+    if (ambientOcclusion.ready())
+    {
+        cout << "Ambient occlusion: " << ambientOcclusion.rayCount() << " rays per vertex, ";
+        if (ambientOcclusion.baked())
+            cout << ambientOcclusion.bakeMilliseconds() << " ms to bake on " << ambientOcclusion.bakeThreads() << " threads" << endl;
+        else
+            cout << "read from " << occlusionCache << endl;
+    }
+
+    if (environmentLighting.valid())
+    {
+        cout << "Environment: " << environmentLighting.width() << " x " << environmentLighting.height()
+            << ", " << environmentLighting.projectMilliseconds() << " ms to project on "
+            << environmentLighting.projectThreads() << " threads" << endl;
+    }
+
+    if (shadowMap.valid())
+    {
+        cout << "Shadow map: " << shadowMap.size() << " x " << shadowMap.size() << ", rendered "
+            << shadowMap.renderCount() << " times" << endl;
+    }
+
+    if (!pointCloud.empty())
+    {
+        cout << "Points: " << pointCloud.drawnPoints() << " of " << pointCloud.pointCount() << " drawn from "
+            << pointCloud.drawnNodes() << " of " << pointCloud.nodeCount() << " nodes, "
+            << pointCloud.selectMilliseconds() << " ms to select" << endl;
+    }
+
+    if (morphingMesh.valid())
+    {
+        const StreamBuffer &stream = morphingMesh.stream();
+        cout << "Morph: " << morphingMesh.vertexCount() << " vertices, " << STREAM_BUFFER_REGIONS
+            << " regions of " << stream.regionSize() / 1024 << " KB, " << morphingMesh.updateMilliseconds()
+            << " ms to write, " << stream.stallCount() << " stalls (" << stream.stallMilliseconds() << " ms)" << endl;
+        morphingMesh.resetStatistics();
+    }
 
-    // The final color result.
-    rgb.red = r + match;
-    rgb.green = g + match;
-    rgb.blue = b + match;
+    if (interactionLod.ready())
+    {
+        cout << "Interaction LOD: " << interactionLod.faceCount() << " proxy faces, "
+            << (interactionLod.active() ? "drawn" : "idle") << endl;
+    }
 }
 
-// Toggles smooth color change animation on or off.
-void toggleDiffuseColorAnimate()
+// Toggles per-pixel lighting on or off.
+void togglePerPixelShading()
 {
-    if (diffuseColorAnimate ^= true)
+    if (!lightingShader.valid())
     {
-        cout << "Auto shifting hue: Enabled" << endl;
+        cout << "Per-pixel shading: Unavailable" << endl;
+        return;
+    }
+
+    if (perPixelShading ^= true)
+    {
+        cout << "Per-pixel shading: Enabled" << endl;
     }
     else
     {
-        cout << "Auto shifting hue: Disabled" << endl;
+        cout << "Per-pixel shading: Disabled" << endl;
     }
 }
 
-// Toggles spinning of mesh object on or off.
-void toggleMeshSpinAnimate()
+// Toggles the pass timing overlay on or off.
+void toggleTimingOverlay()
 {
-    if (meshSpinAnimate ^= true)
+    if (timingOverlay ^= true)
     {
-        cout << "Auto rotating: Enabled" << endl;
+        cout << "Timing overlay: Enabled" << endl;
     }
     else
     {
-        cout << "Auto rotating: Disabled" << endl;
+        cout << "Timing overlay: Disabled" << endl;
     }
 }
 
-// This function is called whenever a "Normal" key press is received.
-void keyboardFunc(unsigned char key, int x, int y)
-{
-    switch (key)
-    {
-    case 27: // Escape key
-        exit(0);
+// Queues a screenshot whose pixels have arrived to be saved.
+void saveScreenshot(Image &image)
+{
+    ostringstream path;
+    path << "screenshot" << setw(3) << setfill('0') << ++screenshotCount << ".png";
+
+    cout << "Screenshot: Saving " << path.str() << endl;
+    imageWriter.write(path.str(), image);
+}
+
+// Collects the frames still being read back or timed, writes everything out, and reports.
+void stopRecording()
+{
+    frameTimer.flush();
+
+    if (!videoRecorder.recording())
+        return;
+
+    // Age the outstanding reads until they can all be collected.
+    while (videoReadback.pending())
+    {
+        videoReadback.beginFrame();
+        while (videoReadback.receive(videoFrame))
+            videoRecorder.write(videoFrame);
+    }
+
+    videoRecorder.close();
+    cout << "Recording: Wrote " << videoRecorder.framesWritten() << " frames to " << videoTarget
+        << " (" << videoRecorder.waits() << " waits for the writer, "
+        << videoRecorder.framesSkipped() << " frames skipped)" << endl;
+}
+
+void runBenchmark();
+
+// Frees the GL objects the modules own, while the context is still current; the
+// headless context goes before the globals' destructors run.
+void destroyGLObjects()
+{
+    frameTimer.destroy();
+    shadowMap.destroy();
+    clusteredLighting.destroy();
+    depthPrepass.destroy();
+    morphingMesh.destroy();
+    pointCloud.destroy();
+    scalarField.destroy();
+    transparency.destroy();
+}
+
+// This function is called whenever a "Normal" key press is received.
+void keyboardFunc(unsigned char key, int x, int y)
+{
+    switch (key)
+    {
+    case 27: // Escape key
+        stopRecording();
+        destroyGLObjects();
+        exit(0);
+        break;
+
+    case 'c':
+        toggleDiffuseColorAnimate();
+        break;
+
+    case 'r':
+        toggleMeshSpinAnimate();
+        break;
+
+    case 'i':
+        printSceneStats();
+        break;
+
+    case 's':
+        togglePerPixelShading();
+        break;
+
+    case 'b':
+        runBenchmark();
+        break;
+
+    case 't':
+        toggleTimingOverlay();
+        break;
+
+    case 'p':
+        screenshotRequested = true;
+        break;
+
+    case 'a':
+        cycleAntiAliasing();
+        break;
+
+    case 'd':
+        toggleDynamicResolution();
+        break;
+
+    case 'l':
+        toggleInteractionLod();
+        break;
+
+    case 'h':
+        toggleShadows();
+        break;
+
+    case 'e':
+        toggleEnvironment();
+        break;
+
+    case 'o':
+        toggleAmbientOcclusion();
+        break;
+
+    case 'w':
+        toggleWireframe();
+        break;
+
+    case 'm':
+        toggleMorph();
+        break;
+
+    case 'z':
+        toggleOcclusionCulling();
+        break;
+
+    case 'f':
+        cycleDepthPrepass();
+        break;
+
+    case 'q':
+        toggleQuadView();
         break;
 
-    case 'c':
-        toggleDiffuseColorAnimate();
+    case 'n':
+        toggleSplatNormals();
         break;
 
-    case 'r':
-        toggleMeshSpinAnimate();
+    case 'x':
+        toggleTransparency();
+        break;
+
+    case 'g':
+        toggleScalars();
+        break;
+
+    case '[':
+        scaleScalarRange(1 / SCALAR_RANGE_STEP);
+        break;
+
+    case ']':
+        scaleScalarRange(SCALAR_RANGE_STEP);
         break;
 
     default:
@@ -397,7 +1075,8 @@ void motionFunc(int x, int y)
         space = Matrix4f::rotateY(mouseDelta[0] * (float)MOUSE_ROTATE_FACTOR / position.abs()) * space;
         space = Matrix4f::rotateX(mouseDelta[1] * (float)MOUSE_ROTATE_FACTOR / position.abs()) * space;
 
-        // Redraw object to see our changes.
+        // Redraw object to see our changes, coarsely until the mouse rests.
+        interactionLod.interact();
         glutPostRedisplay();
     }
 }
@@ -428,15 +1107,20 @@ void mouseWheel(int button, int dir, int x, int y)
         position *= (float)MOUSE_SCALE_FACTOR;
     }
 
-    // Redraw object to see our changes.
+    // Redraw object to see our changes, coarsely until the wheel rests.
+    interactionLod.interact();
     glutPostRedisplay();
 }
 
 // Draws a triangle designated by a face vector, which specifies which
-// vertices and normals to index to.
-void drawTriangle(const vector<unsigned> &face)
+// vertices and normals to index to, with each vertex's ambient occlusion if any.
+// With barycentric set, each corner gets the coordinate it has all of, so the
+// lighting shaders can find the triangle's edges per pixel.
+void drawTriangle(const vector<unsigned> &face, const vector<float> &occlusion, bool barycentric)
 {
 #define DRAWPOINT(index) \
+if (!occlusion.empty()) glVertexAttrib1f(ATTRIB_OCCLUSION, occlusion[face[index+0]]);\
+if (barycentric) glVertexAttrib3f(ATTRIB_BARYCENTRIC, index == 0, index == 3, index == 6);\
 glNormal3d(vecn[face[index+2]][0], vecn[face[index+2]][1], vecn[face[index+2]][2]);\
 glVertex3d(vecv[face[index+0]][0], vecv[face[index+0]][1], vecv[face[index+0]][2])
 
@@ -461,13 +1145,24 @@ void renderMesh()
     // If we have a nonzero number of faces, draw the selected object.
     if (fsize)
     {
+        const vector<float> &occlusion = ambientOcclusion.values();
+
+        // Only the lighting shaders read generic attributes.
+        bool barycentric = lightingShader.valid();
+
         glBegin(GL_TRIANGLES);
         for (int i = 0; i < fsize; i++)
         {
             // Draw each triangle
-            drawTriangle(vecf[i]);
+            drawTriangle(vecf[i], occlusion, barycentric);
         }
         glEnd();
+
+        // Leave whatever is drawn next open and without edges.
+        if (!occlusion.empty())
+            glVertexAttrib1f(ATTRIB_OCCLUSION, 1);
+        if (barycentric)
+            glVertexAttrib3f(ATTRIB_BARYCENTRIC, 1, 1, 1);
     }
 
     // Draw the teapot if no mesh is loaded.
@@ -502,20 +1197,25 @@ void renderGrid()
 }
 
 
-// Draws a gray XY grid to help orient the user.
+// Draws a gray XY grid to help orient the user. The grid blends over the scene,
+// so it must be drawn after everything else that is opaque.
 void drawGrid()
 {
-    // Save the current lighting attributes.
-    glPushAttrib(GL_LIGHTING_BIT);
+    // Draw grid with a solid gray color.
+    glState.color(0.5, 0.5, 0.5, 1.0);
+
+    // Compute an endless grid per pixel when we can.
+    if (gridShader.valid())
+    {
+        gridShader.draw();
+        return;
+    }
 
     // Disable lighting effects for the grid.
-    glDisable(GL_LIGHTING);
+    glState.disable(GL_LIGHTING);
 
     // Draw grid of unit thickness.
-    glLineWidth(1.0f);
-
-    // Draw grid with a solid gray color.
-    glColor3f(0.5, 0.5, 0.5);
+    glState.lineWidth(1.0f);
 
     // Save the current modelview matrix.
     glPushMatrix();
@@ -529,12 +1229,58 @@ void drawGrid()
     // Restore the modelview matrix.
     glPopMatrix();
 
-    // Restore the lighting attributes.
-    glPopAttrib();
+    // Light everything drawn after the grid.
+    glState.enable(GL_LIGHTING);
+}
+
+// Refines the progressive mesh to what the camera distance needs and draws it.
+void drawProgressiveMesh()
+{
+    // Get the viewport height to know how large a pixel is.
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // The world-space size of one pixel at the object's distance.
+    float pixelSize = 2 * position.abs() * (float)tan(deg2rad(FIELD_OF_VIEW) / 2) / max(viewport[3], 1);
+
+    // Refine (or coarsen) until the geometric error is below our pixel tolerance.
+    progressiveMesh.selectError((float)PM_PIXEL_ERROR * pixelSize);
+    progressiveMesh.render(wireframeEnabled && lightingShader.valid());
+}
+
+// Draws the single mesh with whatever lighting is set up: the progressive mesh if
+// there is one, the morphing mesh, the coarse proxy while the view moves unless the
+// frame is being saved, the mesh colored by its values, or the full mesh.
+void drawMeshGeometry()
+{
+    if (!progressiveMesh.empty())
+        drawProgressiveMesh();
+    else if (morphing())
+        morphingMesh.draw();
+    else if (interactionLod.active() && !capturingFrame())
+        interactionLod.draw();
+    else if (scalarColoring())
+        scalarField.draw();
+    else
+        glCallList(mesh);
+}
+
+// Draws the depth of the single mesh alone, placed as drawMesh places it.
+void drawMeshDepth()
+{
+    glPushMatrix();
+    glRotatef(spinAngleY, 0, 1, 0);
+
+    depthPrepass.beginDepth();
+    drawMeshGeometry();
+    depthPrepass.endDepth();
+
+    glPopMatrix();
 }
 
-// Draws the mesh at the grid origin according and appropriately rotated.
-void drawMesh()
+// Draws the mesh at the grid origin according and appropriately rotated, lit by
+// the point lights too if asked and there are any.
+void drawMesh(bool pointLights)
 {
     // Save the current modelview matrix.
     glPushMatrix();
@@ -542,37 +1288,172 @@ void drawMesh()
     // Rotate the object according to how much it has spun.
     glRotatef(spinAngleY, 0, 1, 0);
 
-    // Render the static mesh object.
-    glCallList(mesh);
+    // Render the object scene or the instance layout if we have one, the points if
+    // the input had no faces, the progressive mesh if we have one, otherwise the
+    // static mesh object.
+    if (batchRenderer.objectCount())
+        batchRenderer.draw();
+    else if (instancedMesh.instanceCount())
+        instancedMesh.draw();
+    else if (!pointCloud.empty())
+        pointCloud.draw(splatNormals);
+    else
+    {
+        // Shade per pixel when we can, with the point lights if there are any,
+        // otherwise with fixed-function lighting.
+        bool shaded = perPixelShading && lightingShader.valid();
+        bool clustered = shaded && pointLights && clusteredLighting.lightCount();
+        if (clustered)
+        {
+            lightingShader.bindBlock();
+            clusteredLighting.begin();
+        }
+        else if (shaded)
+            lightingShader.begin();
+
+        drawMeshGeometry();
+
+        if (clustered)
+            clusteredLighting.end();
+        else if (shaded)
+            lightingShader.end();
+    }
 
     // Restore the modelview matrix.
     glPopMatrix();
 }
 
-// This function is responsible for displaying the object.
-void drawScene(void)
+// Formats a pass timing line for the overlay.
+string timingLine(const char *name, double cpuMilliseconds, double gpuMilliseconds)
 {
-    // Clear the rendering window
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    ostringstream line;
+    line << fixed << setprecision(2) << left << setw(8) << name << " CPU " << setw(6) << cpuMilliseconds << " ms";
+    if (gpuMilliseconds >= 0)
+        line << "  GPU " << setw(6) << gpuMilliseconds << " ms";
 
-    // Initialize the model-view matrix
+    return line.str();
+}
+
+// Draws the timings of the latest completed frame in the top-left corner of the window.
+void drawTimingOverlay()
+{
+    const FrameTiming &timing = frameTimer.latest();
+    if (timing.passes.empty())
+        return;
+
+    vector<string> lines;
+    ostringstream title;
+    title << "Frame " << timing.frame;
+    lines.push_back(timingLine(title.str().c_str(), timing.cpuMilliseconds, timing.gpuMilliseconds));
+    for (size_t i = 0; i < timing.passes.size(); i++)
+        lines.push_back(timingLine(timing.passes[i].name, timing.passes[i].cpuMilliseconds, timing.passes[i].gpuMilliseconds));
+    lines.push_back(resolutionLine());
+    lines.push_back(antiAliasingLine());
+
+    // Draw in window coordinates.
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, viewport[2], 0, viewport[3]);
     glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
     glLoadIdentity();
 
-    // Position the camera at [0,0,5], looking at [0,0,0],
-    // with [0,1,0] as the up direction.
-    gluLookAt(position[0], position[1], position[2],
-        0.0, 0.0, 0.0,
-        0.0, 1.0, 0.0);
+    // Text is drawn unlit and over everything.
+    glState.disable(GL_LIGHTING);
+    glState.disable(GL_DEPTH_TEST);
+    glState.color(1.0, 1.0, 1.0, 1.0);
+
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        glRasterPos2i(5, viewport[3] - 15 * (int)(i + 1));
+        glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char *)lines[i].c_str());
+    }
+
+    glState.enable(GL_DEPTH_TEST);
+    glState.enable(GL_LIGHTING);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// Places the camera of a view. The free camera looks from its position; the axis
+// views look from as far along an axis, down onto the top, at the front, or at the
+// right side.
+Matrix4f viewCamera(int kind)
+{
+    float distance = position.abs();
+    switch (kind)
+    {
+    case VIEW_TOP:
+        return Matrix4f::lookAt(Vector3f(0, distance, 0), Vector3f::ZERO, Vector3f(0, 0, -1));
+    case VIEW_FRONT:
+        return Matrix4f::lookAt(Vector3f(0, 0, distance), Vector3f::ZERO, Vector3f::UP);
+    case VIEW_SIDE:
+        return Matrix4f::lookAt(Vector3f(distance, 0, 0), Vector3f::ZERO, Vector3f::UP);
+    default:
+        return Matrix4f::lookAt(position, Vector3f::ZERO, Vector3f::UP);
+    }
+}
+
+// Sets the projection of a view drawn width x height pixels. The axis views are
+// orthographic, framing the origin as the free camera does at its distance, and deep
+// enough to hold everything in front of and behind it.
+void setProjection(int kind, int width, int height)
+{
+    double aspect = (double)width / max(height, 1);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    if (kind == VIEW_PERSPECTIVE)
+        gluPerspective(FIELD_OF_VIEW, aspect, NEAR_PERSPECTIVE, FAR_PERSPECTIVE);
+    else
+    {
+        double halfHeight = position.abs() * tan(deg2rad(FIELD_OF_VIEW) / 2);
+        glOrtho(-halfHeight * aspect, halfHeight * aspect, -halfHeight, halfHeight, -FAR_PERSPECTIVE, FAR_PERSPECTIVE);
+    }
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// Times a pass of a view, unless the quad view is timing each view as a whole.
+void beginScenePass(const char *name)
+{
+    if (!quadView)
+        frameTimer.beginPass(name);
+}
+
+void endScenePass()
+{
+    if (!quadView)
+        frameTimer.endPass();
+}
+
+// Draws the scene through one view's camera into the current viewport, shadowed
+// with the shadow map already rendered if asked.
+void drawView(int kind, bool shadowed)
+{
+    // Position the camera, looking at [0,0,0]. We keep our own copy of the
+    // view so we never have to read the modelview back from GL.
+    Matrix4f view = viewCamera(kind);
+
+    // The axis views see the world as it is, unturned by the mouse.
+    bool perspective = kind == VIEW_PERSPECTIVE;
+    Matrix4f world = perspective ? space : Matrix4f::identity();
+
+    // Initialize the model-view matrix
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(view);
 
     // Save the modelview matrix. This is our home-world space (useful for mouse scrolling).
     glPushMatrix();
 
     // Rotate the world space.
-    glMultMatrixf(space);
-
-    //Draw a grid to show how our world is oriented.
-    drawGrid();
+    glMultMatrixf(world);
 
     // Set material properties of object
 
@@ -580,34 +1461,510 @@ void drawScene(void)
     RGB meshRgbColor;
     hcy2rgb(meshHcyColor, meshRgbColor);
 
+    // Values color the mesh through the vertex colors, which tint a white material.
+    if (scalarColoring())
+        meshRgbColor.red = meshRgbColor.green = meshRgbColor.blue = 1;
+
     // Set the material color for our static object.
-    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, meshRgbColor.values);
+    glState.material(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, meshRgbColor.values);
+
+    // Define specular color and shininess
+    GLfloat specColor[] = { 1.0, 1.0, 1.0, 1.0 };
+    GLfloat shininess[] = { 100.0 };
+
+    // Note that the specular color and shininess can stay constant
+    glState.material(GL_FRONT_AND_BACK, GL_SPECULAR, specColor);
+    glState.material(GL_FRONT_AND_BACK, GL_SHININESS, shininess);
+
+    // Set light properties
+
+    // Light color (RGBA)
+    GLfloat Lt0diff[] = { 1.0,1.0,1.0,1.0 };
+
+    // The light position in eye coordinates, which is what GL stores.
+    Vector4f Lt0eye = view * world * Lt0pos;
+
+    // Set light diffusiion and position.
+    glState.light(GL_LIGHT0, GL_DIFFUSE, Lt0diff);
+    glState.lightPosition(GL_LIGHT0, Lt0pos, Lt0eye);
+
+    // Give per-pixel lighting the same material and light, in eye coordinates.
+    lightingShader.setMaterial(Vector4f(meshRgbColor.values), Vector4f(specColor), shininess[0]);
+    lightingShader.setLight(Lt0eye, Vector4f(Lt0diff), Vector4f(1, 1, 1, 1));
+
+    // Look the mesh up in the shadow map from wherever the camera is now.
+    if (shadowed)
+    {
+        shadowMap.bind();
+        lightingShader.setShadow(shadowMap.eyeToShadow(view * world), 1.0f / shadowMap.size());
+    }
+    else
+        lightingShader.clearShadow();
+
+    lightingShader.setOcclusionStrength(occlusionEnabled && ambientOcclusion.ready() ? 1.0f : 0.0f);
+
+    // Draw edges dark on light meshes and light on dark ones.
+    float wireShade = meshHcyColor.luma > 0.5f ? 0.0f : 1.0f;
+    lightingShader.setWireframe(wireframeEnabled ? wireframeWidth : 0.0f, Vector4f(wireShade, wireShade, wireShade, 1));
+
+    // Turn the environment's light into eye coordinates, as GL does the main light's.
+    if (environmentEnabled && environmentLighting.valid())
+    {
+        Vector3f coefficients[SH_COEFFICIENTS];
+        environmentLighting.irradiance((view * world).getSubmatrix3x3(0, 0), coefficients);
+        lightingShader.setEnvironment(coefficients);
+    }
+    else
+        lightingShader.clearEnvironment();
+
+    // Bin the point lights into this view's clusters. The clusters are slices of a
+    // perspective frustum, so the axis views are lit by the main light alone.
+    bool pointLights = perPixelShading && clusteredLighting.lightCount() && perspective;
+    if (pointLights)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        beginScenePass("lights");
+        clusteredLighting.assign(view * world, FIELD_OF_VIEW, (float)viewport[2] / max(viewport[3], 1),
+            NEAR_PERSPECTIVE, FAR_PERSPECTIVE);
+        endScenePass();
+    }
+
+    // Lay the single mesh's depth down first when it is shaded per pixel and the
+    // overdraw that saves is worth the extra pass. Its measurements come from the
+    // single view's passes.
+    bool blended = seeThrough();
+    bool prepassable = depthPrepass.valid() && perPixelShading && lightingShader.valid()
+        && !batchRenderer.objectCount() && !instancedMesh.instanceCount() && !morphing() && !quadView
+        && pointCloud.empty() && !blended;
+    if (prepassable)
+    {
+        depthPrepass.update(frameTimer.latest());
+        if (depthPrepass.choose())
+        {
+            frameTimer.beginPass("prepass");
+            drawMeshDepth();
+            frameTimer.endPass();
+        }
+    }
+
+    // The blended layers are composited over the frame as a whole, so the grid goes
+    // in first when the mesh is see-through.
+    if (blended)
+    {
+        beginScenePass("grid");
+        drawGrid();
+        endScenePass();
+    }
+
+    // Draw our static object, or accumulate its layers and blend them over the frame.
+    // The grid's lines hide the layers behind them.
+    beginScenePass("mesh");
+    if (blended)
+    {
+        lightingShader.setWeightedBlending(meshRadius);
+        transparency.begin();
+        if (gridShader.valid())
+            gridShader.drawDepth();
+        transparency.beginLayers();
+    }
+    else if (prepassable)
+        depthPrepass.beginShading();
+    drawMesh(pointLights);
+    if (blended)
+    {
+        transparency.end();
+        lightingShader.clearWeightedBlending();
+    }
+    else if (prepassable)
+        depthPrepass.endShading();
+    endScenePass();
+
+    //Draw a grid to show how our world is oriented.
+    if (!blended)
+    {
+        beginScenePass("grid");
+        drawGrid();
+        endScenePass();
+    }
+
+    // Restore our modelview matrix.
+    glPopMatrix();
+}
+
+// Draws every view into a quarter of the frame: top and front above, side and the
+// free camera below. They all draw from the same buffers, and each culls and picks
+// its level of detail for itself.
+void drawQuadView(bool shadowed)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    int width = viewport[2] / 2, height = viewport[3] / 2;
+
+    for (int kind = 0; kind < VIEW_KINDS; kind++)
+    {
+        int column = kind % 2, row = 1 - kind / 2;
+        glViewport(viewport[0] + column * width, viewport[1] + row * height, width, height);
+        setProjection(kind, width, height);
+
+        frameTimer.beginPass(VIEW_NAMES[kind]);
+        drawView(kind, shadowed);
+        frameTimer.endPass();
+    }
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    setProjection(VIEW_PERSPECTIVE, viewport[2], viewport[3]);
+}
+
+// This function is responsible for displaying the object.
+void drawScene(void)
+{
+    // Count this frame's state changes and time its passes from here.
+    glState.beginFrame();
+    frameTimer.beginFrame();
+
+    // Save any screenshots whose pixels have arrived.
+    pixelReadback.beginFrame();
+    Image screenshot;
+    while (pixelReadback.receive(screenshot))
+        saveScreenshot(screenshot);
+
+    // Pass recorded frames that have arrived on to the recorder.
+    videoReadback.beginFrame();
+    while (videoReadback.receive(videoFrame))
+        videoRecorder.write(videoFrame);
+
+    // Shadow the single mesh when it is lit per pixel, re-rendering the shadow map
+    // only when the light or the mesh moved. Both move with the world space, so
+    // turning that leaves the map as it is.
+    bool shadowed = shadowsEnabled && shadowMap.valid() && perPixelShading && lightingShader.valid()
+        && !batchRenderer.objectCount() && !instancedMesh.instanceCount() && progressiveMesh.empty() && !morphing()
+        && pointCloud.empty();
+    if (shadowed)
+    {
+        frameTimer.beginPass("shadow");
+
+        Vector3f spunCenter = (Matrix4f::rotateY((float)deg2rad(spinAngleY)) * Vector4f(meshCenter, 1)).xyz();
+        if (shadowMap.begin(Lt0pos.xyz(), spunCenter, meshRadius, spinAngleY))
+        {
+            glRotatef(spinAngleY, 0, 1, 0);
+            glCallList(mesh);
+            shadowMap.end();
+        }
+
+        frameTimer.endPass();
+    }
+
+    // Draw at the resolution the frame budget allows, but captured frames in full.
+    dynamicResolution.update(frameTimer.latest());
+    dynamicResolution.begin(windowWidth, windowHeight, capturingFrame());
+
+    // Draw into the anti-aliasing target, sized for a full-resolution frame.
+    antiAliasing.begin(dynamicResolution.width(), dynamicResolution.height(), windowWidth, windowHeight);
+
+    // Clear the rendering window
+    frameTimer.beginPass("clear");
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    frameTimer.endPass();
+
+    // Write this frame's rippled vertices straight into GPU-visible memory.
+    if (morphing())
+    {
+        frameTimer.beginPass("morph");
+        morphingMesh.update(morphPhase);
+        frameTimer.endPass();
+    }
+
+    // Draw the free camera's view over the whole frame, or every view in a quarter.
+    if (quadView)
+        drawQuadView(shadowed);
+    else
+        drawView(VIEW_PERSPECTIVE, shadowed);
+
+    // Resolve or filter the frame into the scaled one.
+    if (antiAliasing.mode() != ANTIALIAS_OFF)
+    {
+        frameTimer.beginPass("antialias");
+        antiAliasing.end();
+        frameTimer.endPass();
+    }
+
+    // Stretch a scaled frame over the window.
+    frameTimer.beginPass("upscale");
+    dynamicResolution.end();
+    frameTimer.endPass();
+
+    // Start reading the frame back if a screenshot was asked for.
+    if (screenshotRequested)
+    {
+        frameTimer.beginPass("capture");
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        if (pixelReadback.read(viewport[0], viewport[1], viewport[2], viewport[3]))
+            screenshotRequested = false;
+
+        frameTimer.endPass();
+    }
+
+    // Record the frame, starting the recording at the size of the first one.
+    if (videoTarget && (!videoFrameLimit || videoFramesRead < videoFrameLimit))
+    {
+        frameTimer.beginPass("record");
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        if (!videoRecorder.recording() && !videoRecorder.open(videoTarget, videoFormat, viewport[2], viewport[3], VIDEO_FRAMES_PER_SECOND))
+            videoTarget = NULL;
+
+        // A window shrunk below the video size gives a frame the recorder skips.
+        else if (videoReadback.read(viewport[0], viewport[1], min((int)viewport[2], videoRecorder.width()), min((int)viewport[3], videoRecorder.height())))
+            videoFramesRead++;
+
+        frameTimer.endPass();
+    }
+
+    // Show how long the passes took.
+    if (timingOverlay)
+    {
+        frameTimer.beginPass("overlay");
+        drawTimingOverlay();
+        frameTimer.endPass();
+    }
+
+    // Dump the image to the screen. Headless frames stay in their framebuffer.
+    frameTimer.beginPass("swap");
+    if (!headless)
+        glutSwapBuffers();
+    frameTimer.endPass();
+
+    frameTimer.endFrame();
+}
+
+// Draws a number of frames and returns the average time per frame in milliseconds.
+double timeFrames(int frames)
+{
+    // Let the driver settle before timing.
+    drawScene();
+    glFinish();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+        drawScene();
+        glFinish();
+    }
+
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frames;
+}
+
+// Scatters point lights of random hues around the mesh, sized so that about
+// POINT_LIGHT_OVERLAP of them reach any point. Random but the same every run.
+void createPointLights(unsigned count)
+{
+    // Fit a sphere around the mesh, or the teapot.
+    float radius = vecv.empty() ? TEAPOT_RADIUS : 0;
+    for (size_t i = 0; i < vecv.size(); i++)
+        radius = max(radius, vecv[i].abs());
+
+    // Lights fill a ball half as wide again as the mesh.
+    float spread = 1.5f * radius;
+    float reach = count ? spread * (float)pow((double)POINT_LIGHT_OVERLAP / count, 1.0 / 3) : 0;
+
+    vector<PointLight> lights(count);
+    unsigned seed = 1;
+    for (unsigned i = 0; i < count; i++)
+    {
+        // Pick points in the cube until one falls in the ball.
+        Vector3f p;
+        do
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                seed = seed * 1664525 + 1013904223;
+                p[k] = (seed >> 8) / 8388608.0f - 1;
+            }
+        } while (p.absSquared() > 1);
+
+        RGB color;
+        hcy2rgb(HCY(1, (float)i / count, 1, 0.5), color);
+
+        lights[i].position = p * spread;
+        lights[i].radius = min(reach, spread);
+        lights[i].color = Vector3f(color.red, color.green, color.blue);
+    }
+
+    clusteredLighting.setLights(lights);
+}
+
+// Times the fixed-function and per-pixel lighting paths and prints the results.
+void runBenchmark()
+{
+    cout << "Benchmarking " << BENCHMARK_FRAMES << " frames per configuration on "
+        << glGetString(GL_RENDERER) << endl;
+
+    // Time every frame at full resolution.
+    bool savedShading = perPixelShading;
+    bool savedDynamicResolution = dynamicResolution.enabled();
+    bool savedInteractionLod = interactionLod.enabled();
+    dynamicResolution.setEnabled(false);
+    interactionLod.setEnabled(false);
+
+    perPixelShading = false;
+    cout << "  Fixed-function lighting: " << timeFrames(BENCHMARK_FRAMES) << " ms/frame" << endl;
+
+    if (lightingShader.valid())
+    {
+        perPixelShading = true;
+        cout << "  Per-pixel lighting: " << timeFrames(BENCHMARK_FRAMES) << " ms/frame" << endl;
+    }
+
+    // Time the four views against the free camera's alone.
+    bool savedQuadView = quadView;
+    quadView = false;
+    double single = timeFrames(BENCHMARK_FRAMES);
+    quadView = true;
+    double quad = timeFrames(BENCHMARK_FRAMES);
+    quadView = savedQuadView;
+    cout << "  Quad view: " << quad << " ms/frame, " << quad / single << "x one view" << endl;
+
+    // Time per-pixel shading with and without the depth laid down first.
+    if (depthPrepass.valid() && lightingShader.valid() && !batchRenderer.objectCount() && !instancedMesh.instanceCount())
+    {
+        DepthPrepassMode savedMode = depthPrepass.mode();
+        perPixelShading = true;
+
+        for (int mode = DEPTH_PREPASS_OFF; mode <= DEPTH_PREPASS_ON; mode++)
+        {
+            depthPrepass.setMode((DepthPrepassMode)mode);
+            cout << "  Per-pixel lighting, depth pre-pass " << DepthPrepass::name(depthPrepass.mode()) << ": "
+                << timeFrames(BENCHMARK_FRAMES) << " ms/frame" << endl;
+        }
+
+        depthPrepass.setMode(savedMode);
+    }
+
+    // Time the mesh see-through against opaque.
+    if (transparency.valid() && lightingShader.valid() && !batchRenderer.objectCount() && !instancedMesh.instanceCount()
+        && pointCloud.empty())
+    {
+        bool savedTransparent = transparent;
+        float savedAlpha = meshHcyColor.alpha;
+        perPixelShading = true;
+
+        transparent = false;
+        double opaque = timeFrames(BENCHMARK_FRAMES);
+        transparent = true;
+        if (meshHcyColor.alpha >= 1)
+            meshHcyColor.alpha = TRANSPARENCY_DEFAULT_ALPHA;
+        double blended = timeFrames(BENCHMARK_FRAMES);
+        cout << "  Transparency: " << blended << " ms/frame, " << blended / opaque << "x opaque" << endl;
+
+        transparent = savedTransparent;
+        meshHcyColor.alpha = savedAlpha;
+    }
+
+    // Time converting the scalar colors one at a time against in one batch, for
+    // values spread over the range in no order, as values on a mesh are.
+    if (scalarField.valid())
+    {
+        size_t count = scalarField.vertexCount();
+        vector<HCY> hcy;
+        hcy.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            hcy.push_back(ScalarField::colormap((float)fmod(i * 0.6180339887, 1.0)));
+        vector<RGB> rgb(count);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++)
+            hcy2rgb(hcy[i], rgb[i]);
+        chrono::steady_clock::time_point middle = chrono::steady_clock::now();
+        hcy2rgb(&hcy[0], &rgb[0], count);
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+        cout << "  Scalar colors: " << count << " converted in "
+            << chrono::duration<double, milli>(middle - start).count() << " ms one at a time, "
+            << chrono::duration<double, milli>(end - middle).count() << " ms batched" << endl;
+    }
+
+    // Time each anti-aliasing mode against none, with the lighting in use.
+    perPixelShading = savedShading;
+    if (antiAliasing.valid())
+    {
+        AntiAliasingMode savedMode = antiAliasing.mode();
+        double aliased = 0;
+
+        for (int mode = ANTIALIAS_OFF; mode < ANTIALIAS_MODES; mode++)
+        {
+            if (!antiAliasing.supported((AntiAliasingMode)mode))
+                continue;
+
+            antiAliasing.setMode((AntiAliasingMode)mode);
+            double frame = timeFrames(BENCHMARK_FRAMES);
+            cout << "  Anti-aliasing " << AntiAliasing::name(antiAliasing.mode());
+            if (antiAliasing.samples())
+                cout << " (" << antiAliasing.samples() << " samples)";
+            cout << ": " << frame << " ms/frame";
+
+            if (mode == ANTIALIAS_OFF)
+                aliased = frame;
+            else
+                cout << ", " << showpos << frame - aliased << noshowpos << " ms";
+            cout << endl;
+        }
+
+        antiAliasing.setMode(savedMode);
+    }
 
-    // Define specular color and shininess
-    GLfloat specColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    GLfloat shininess[] = { 100.0 };
+    // Time the objects drawn with and without hiding those behind the largest.
+    if (batchRenderer.objectCount())
+    {
+        bool savedCulling = batchRenderer.occlusionCulling();
 
-    // Note that the specular color and shininess can stay constant
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, specColor);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, shininess);
+        batchRenderer.setOcclusionCulling(false);
+        double unculled = timeFrames(BENCHMARK_FRAMES);
+        unsigned drawn = batchRenderer.visibleCount();
+        batchRenderer.setOcclusionCulling(true);
+        double culled = timeFrames(BENCHMARK_FRAMES);
 
-    // Set light properties
+        cout << "  Objects without occlusion culling: " << unculled << " ms/frame, " << drawn << " drawn" << endl;
+        cout << "  Objects with occlusion culling: " << culled << " ms/frame, " << batchRenderer.visibleCount()
+            << " drawn, " << batchRenderer.occlusionMilliseconds() << " ms to cull" << endl;
 
-    // Light color (RGBA)
-    GLfloat Lt0diff[] = { 1.0,1.0,1.0,1.0 };
+        batchRenderer.setOcclusionCulling(savedCulling);
+    }
 
-    // Set light diffusiion and position.
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, Lt0diff);
-    glLightfv(GL_LIGHT0, GL_POSITION, Lt0pos);
+    // Time growing numbers of point lights, binning them on one thread and on all.
+    if (clusteredLighting.valid() && lightingShader.valid())
+    {
+        perPixelShading = true;
+        unsigned savedLights = clusteredLighting.lightCount();
+        unsigned threads = clusteredLighting.threadCount();
 
-    // Draw our static object.
-    drawMesh();
+        for (unsigned count = BENCHMARK_MIN_LIGHTS; count <= BENCHMARK_MAX_LIGHTS; count *= 4)
+        {
+            createPointLights(count);
+            cout << "  " << count << " point lights:";
+
+            clusteredLighting.setThreadCount(1);
+            clusteredLighting.resetStatistics();
+            double frame = timeFrames(BENCHMARK_FRAMES);
+            cout << " assign " << clusteredLighting.assignMilliseconds() << " ms on 1 thread";
+
+            clusteredLighting.setThreadCount(threads);
+            clusteredLighting.resetStatistics();
+            frame = timeFrames(BENCHMARK_FRAMES);
+            cout << ", " << clusteredLighting.assignMilliseconds() << " ms on " << threads << ", "
+                << frame << " ms/frame, " << clusteredLighting.entryCount() << " cluster entries" << endl;
+        }
 
-    // Restore our modelview matrix.
-    glPopMatrix();
+        createPointLights(savedLights);
+    }
 
-    // Dump the image to the screen.
-    glutSwapBuffers();
+    perPixelShading = savedShading;
+    dynamicResolution.setEnabled(savedDynamicResolution);
+    interactionLod.setEnabled(savedInteractionLod);
 }
 
 // Creates a static mesh using the supplied render function.
@@ -629,32 +1986,29 @@ void createStaticList(GLuint &glList, void func())
 // Initialize OpenGL's rendering modes
 void initRendering()
 {
-    glEnable(GL_DEPTH_TEST);   // Depth testing must be turned on
-    glEnable(GL_LIGHTING);     // Enable lighting calculations
-    glEnable(GL_LIGHT0);       // Turn on light #0.
+    glState.enable(GL_DEPTH_TEST);   // Depth testing must be turned on
+    glState.enable(GL_LIGHTING);     // Enable lighting calculations
+    glState.enable(GL_LIGHT0);       // Turn on light #0.
 }
 
 // Called when the window is resized
 // w, h - width and height of the window in pixels.
 void reshapeFunc(int w, int h)
 {
+    // Frames are drawn at a fraction of this size and stretched back over it.
+    windowWidth = w;
+    windowHeight = h;
+
     // Set up viewport to use full screen.
     glViewport(0, 0, w, h);
 
     // Set up a perspective view.
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(
-        FIELD_OF_VIEW,
-        (double)w / (double)h,
-        NEAR_PERSPECTIVE,
-        FAR_PERSPECTIVE
-    );
+    setProjection(VIEW_PERSPECTIVE, w, h);
 }
 
-void loadInput()
+// Loads an .OBJ mesh from a stream into vertex, normal, and face lists.
+void loadObj(istream &input, vector<Vector3f> &vertices, vector<Vector3f> &normals, vector<vector<unsigned> > &faces)
 {
-    // load the OBJ file here
 
     // Current line
     char buffer[MAX_BUFFER_SIZE];
@@ -673,7 +2027,7 @@ void loadInput()
     do
     {
         // Get current line
-        cin.getline(buffer, MAX_BUFFER_SIZE);
+        input.getline(buffer, MAX_BUFFER_SIZE);
 
         // Replace forward slashes with spaces (to better parse faces)
         for (int i = 0; buffer[i]; i++)
@@ -685,8 +2039,9 @@ void loadInput()
         // Initialize new string stream.
         stringstream ss(buffer);
 
-        // Get token
-        ss >> s;
+        // Get token, skipping blank lines, which would repeat the last one.
+        if (!(ss >> s))
+            continue;
 
         // This is a vertex token.
         if (s == "v")
@@ -695,7 +2050,7 @@ void loadInput()
             ss >> v[0] >> v[1] >> v[2];
 
             // Store to vertex array
-            vecv.push_back(v);
+            vertices.push_back(v);
             continue;
         }
 
@@ -706,7 +2061,7 @@ void loadInput()
             ss >> v[0] >> v[1] >> v[2];
 
             // Store to vertex array
-            vecn.push_back(v);
+            normals.push_back(v);
             continue;
         }
 
@@ -728,31 +2083,156 @@ void loadInput()
             }
 
             // push complete face vector
-            vecf.push_back(face);
+            faces.push_back(face);
             continue;
         }
-    } while (!cin.eof());
+    } while (!input.eof());
 }
 
-void update(int code)
+// Fits a sphere around the loaded mesh, centered on its bounding box.
+void computeMeshBounds()
+{
+    if (vecv.empty())
+        return;
+
+    Vector3f low = vecv[0], high = vecv[0];
+    for (size_t i = 1; i < vecv.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            low[k] = min(low[k], vecv[i][k]);
+            high[k] = max(high[k], vecv[i][k]);
+        }
+    }
+
+    meshCenter = (low + high) / 2;
+    meshRadius = 0;
+    for (size_t i = 0; i < vecv.size(); i++)
+        meshRadius = max(meshRadius, (vecv[i] - meshCenter).abs());
+}
+
+void loadInput()
+{
+    // load the OBJ file here
+    loadObj(cin, vecv, vecn, vecf);
+    computeMeshBounds();
+}
+
+// Steps the spin and color animations by one frame. Returns whether either moved.
+bool animate()
 {
     // Assume animation is disabled until a flag enables it.
-    bool redraw = false;
+    bool animated = false;
 
     // Update mesh rotation angle
     if (meshSpinAnimate)
     {
         spinAngleY += MESH_ROTATE_DEGREES;
-        redraw = true;
+        interactionLod.interact();
+        animated = true;
     }
 
     // Update diffuse color
     if (diffuseColorAnimate)
     {
         meshHcyColor.rotateHue(HUE_SHIFT_DEGREES);
+        animated = true;
+    }
+
+    // Move the ripple along
+    if (morphAnimate)
+    {
+        morphPhase += MORPH_PHASE_STEP;
+        animated = true;
+    }
+
+    return animated;
+}
+
+// Refines the progressive mesh with whatever arrived from its stream. Returns whether
+// anything arrived.
+bool receiveProgressiveMesh()
+{
+    if (!progressiveMeshStream)
+        return false;
+
+    bool received = progressiveMeshStream->receive(progressiveMesh);
+
+    // A stream can end, or fail, without anything new arriving.
+    if (progressiveMeshStream->finished())
+    {
+        cout << "Progressive mesh: Received " << progressiveMesh.splitCount() << " vertex splits" << endl;
+        delete progressiveMeshStream;
+        progressiveMeshStream = NULL;
+    }
+
+    return received;
+}
+
+// Compiles the baked ambient occlusion into the mesh once it is done, and caches it.
+// Returns true when it does.
+bool receiveAmbientOcclusion()
+{
+    if (!ambientOcclusion.receive())
+        return false;
+
+    if (occlusionCache && ambientOcclusion.baked() && !ambientOcclusion.write(occlusionCache))
+        cerr << "Could not write ambient occlusion " << occlusionCache << "." << endl;
+
+    glDeleteLists(mesh, 1);
+    createStaticList(mesh, renderMesh);
+    return true;
+}
+
+void update(int code)
+{
+    // Run the benchmark requested on the command line, then quit.
+    if (benchmarkOnStart)
+    {
+        runBenchmark();
+        destroyGLObjects();
+        exit(0);
+    }
+
+    // Redraw when something animated.
+    bool redraw = animate();
+
+    // Keep drawing frames until every screenshot has been read back.
+    if (screenshotRequested || pixelReadback.pending())
+        redraw = true;
+
+    // Draw every frame while recording, and quit once the frames asked for are done.
+    if (videoTarget)
+    {
+        if (videoFrameLimit && videoFramesRead >= videoFrameLimit)
+        {
+            stopRecording();
+            destroyGLObjects();
+            exit(0);
+        }
+
+        redraw = true;
+    }
+
+    // Refine the progressive mesh with whatever arrived from its stream.
+    if (receiveProgressiveMesh())
+        redraw = true;
+
+    // Pick up the interaction proxy once it is simplified.
+    if (interactionLod.receive(lightingShader.valid()))
+        cout << "Interaction LOD: " << interactionLod.faceCount() << " proxy faces ready" << endl;
+
+    // Shade with the ambient occlusion once it is baked.
+    if (receiveAmbientOcclusion())
+    {
+        cout << "Ambient occlusion: " << ambientOcclusion.values().size() << " vertices ready" << endl;
         redraw = true;
     }
 
+    // Draw the full mesh again once the view comes to rest.
+    if (interactionLod.settle())
+        redraw = true;
+
     // Redraw if an animation flag was set.
     if (redraw)
         glutPostRedisplay();
@@ -761,31 +2241,582 @@ void update(int code)
     glutTimerFunc(timerInterval[code], update, (code + 1) % (sizeof(timerInterval) / sizeof(int)));
 }
 
+// Draws frames offscreen, stepping the animations between them, and saves the last one.
+int renderHeadless(const char *output, int width, int height, unsigned frames)
+{
+    reshapeFunc(width, height);
+
+    // Take in the whole progressive mesh so the image shows it fully refined.
+    // The stream is let go once it is finished.
+    while (progressiveMeshStream)
+    {
+        if (!receiveProgressiveMesh())
+            this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    // Shade with the ambient occlusion, which was waited for.
+    receiveAmbientOcclusion();
+
+    if (benchmarkOnStart)
+    {
+        runBenchmark();
+        return 0;
+    }
+
+    for (unsigned i = 0; i < frames; i++)
+    {
+        if (i)
+            animate();
+        drawScene();
+    }
+
+    stopRecording();
+
+    // The framebuffer is still bound, so this reads the last frame straight from it.
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t)width * height * 4);
+    glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &image.pixels[0]);
+
+    if (!writePng(output, image))
+    {
+        cerr << "Could not write image " << output << "." << endl;
+        return 1;
+    }
+
+    cout << "Headless: Wrote " << output << " (" << width << " x " << height << ", "
+        << frames << " frames) on " << glGetString(GL_RENDERER) << endl;
+    return 0;
+}
+
+// Builds a progressive mesh from the loaded .OBJ file and writes it to a file.
+bool writeProgressiveMesh(const char *path)
+{
+    // Keep a small fraction of the faces in the base mesh.
+    unsigned baseFaces = (unsigned)(vecf.size() * PM_BASE_FACE_RATIO);
+    progressiveMesh.build(vecv, vecn, vecf, baseFaces);
+
+    FILE *file = fopen(path, "wb");
+    bool written = file && progressiveMesh.write(file);
+    if (file)
+        fclose(file);
+
+    if (!written)
+    {
+        cerr << "Could not write progressive mesh " << path << "." << endl;
+        return false;
+    }
+
+    cout << "Progressive mesh: Wrote " << progressiveMesh.faceCount() << " base faces and "
+        << progressiveMesh.splitCount() << " vertex splits to " << path << endl;
+    return true;
+}
+
+// Places item i of a square grid layout covering the world grid, turned at random.
+// The item is scaled so its bounding sphere fills its cell.
+Matrix4f layoutTransform(unsigned i, unsigned count, const Vector3f &center, float radius)
+{
+    unsigned side = (unsigned)ceil(sqrt((double)count));
+    float cell = 20.0f / side;
+    float scale = (float)INSTANCE_CELL_FILL * cell / max(radius, 1e-6f);
+
+    float x = ((i % side) + 0.5f) * cell - 10;
+    float z = ((i / side) + 0.5f) * cell - 10;
+    float angle = (float)(rand() % 360);
+
+    return Matrix4f::translation(x, 0, z)
+        * Matrix4f::rotateY((float)deg2rad(angle))
+        * Matrix4f::uniformScaling(scale)
+        * Matrix4f::translation(-center);
+}
+
+// Lays out copies of the mesh in a square grid.
+void createInstanceLayout(unsigned count)
+{
+    IndexedMesh indexedMesh;
+    indexedMesh.build(vecv, vecn, vecf);
+    instancedMesh.create(indexedMesh, mesh, Vector3f::ZERO, TEAPOT_RADIUS);
+
+    float radius = indexedMesh.empty() ? TEAPOT_RADIUS : indexedMesh.radius;
+
+    vector<Matrix4f> transforms;
+    for (unsigned i = 0; i < count; i++)
+        transforms.push_back(layoutTransform(i, count, indexedMesh.center, radius));
+
+    instancedMesh.setInstances(transforms);
+}
+
+// Lays out objects cycling through the loaded mesh and any extra meshes in a square
+// grid, each with its own color.
+void createObjectLayout(unsigned count, const vector<string> &meshFiles)
+{
+    vector<IndexedMesh> meshes(1);
+    meshes[0].build(vecv, vecn, vecf);
+
+    // Load the extra meshes.
+    for (size_t i = 0; i < meshFiles.size(); i++)
+    {
+        ifstream input(meshFiles[i].c_str());
+        if (!input)
+        {
+            cerr << "Could not open mesh " << meshFiles[i] << "." << endl;
+            continue;
+        }
+
+        vector<Vector3f> vertices, normals;
+        vector<vector<unsigned> > faces;
+        loadObj(input, vertices, normals, faces);
+
+        meshes.push_back(IndexedMesh());
+        meshes.back().build(vertices, normals, faces);
+    }
+
+    // Store every mesh that has faces in the shared arena.
+    vector<unsigned> arenaMeshes;
+    vector<const IndexedMesh *> sources;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (!meshes[i].empty())
+        {
+            arenaMeshes.push_back(batchRenderer.addMesh(meshes[i]));
+            sources.push_back(&meshes[i]);
+        }
+    }
+
+    if (arenaMeshes.empty())
+    {
+        cerr << "Object layouts need at least one mesh with faces." << endl;
+        return;
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned m = i % arenaMeshes.size();
+
+        // Spread the hues of the objects around the color wheel.
+        RGB color;
+        hcy2rgb(HCY(1, (float)i / count, 1, 0.5), color);
+
+        batchRenderer.addObject(arenaMeshes[m],
+            layoutTransform(i, count, sources[m]->center, sources[m]->radius),
+            Vector4f(color.red, color.green, color.blue, color.alpha));
+    }
+
+    if (!batchRenderer.create())
+        cout << "Multi-draw indirect is not supported; drawing objects one by one." << endl;
+}
+
+// Steps past option i to the value that follows it and returns that. Quits if the
+// option is the last argument, which leaves it without one.
+const char *optionValue(int argc, char **argv, int &i)
+{
+    if (i + 1 >= argc)
+    {
+        cerr << "Option " << argv[i] << " needs a value." << endl;
+        exit(1);
+    }
+
+    return argv[++i];
+}
+
 // Main routine.
 // Set up OpenGL, define the callbacks and start the main loop
 int main(int argc, char** argv)
 {
-    // Load an .OBJ file if one was specified.
-    loadInput();
+    // Progressive mesh to build from the .OBJ input, or to stream instead of it.
+    const char *pmOutput = NULL;
+    const char *pmSource = NULL;
+
+    // Number of mesh copies to lay out, if any.
+    unsigned instanceCount = 0;
+
+    // Number of objects to lay out, and the extra meshes they cycle through.
+    unsigned objectCount = 0;
+    vector<string> meshFiles;
+
+    // CSV file to write the frame timings to, if any.
+    const char *timingsOutput = NULL;
+
+    // Number of point lights to scatter around the mesh.
+    unsigned pointLightCount = 0;
+
+    // File of values to color the mesh by, if any, and the range to map them over.
+    const char *scalarsPath = NULL;
+    float scalarLow = 0, scalarHigh = 0;
+    bool scalarRange = false;
+
+    // Width and height of the shadow map.
+    int shadowSize = SHADOW_MAP_SIZE;
+
+    // Rays per vertex to bake ambient occlusion with, if any.
+    unsigned occlusionRays = 0;
+
+    // How to anti-alias frames.
+    AntiAliasingMode antiAliasingMode = ANTIALIAS_OFF;
+
+    // Whether to lay the mesh's depth down before shading it.
+    DepthPrepassMode depthPrepassMode = DEPTH_PREPASS_AUTO;
+
+    // Image to draw offscreen instead of opening a window, if any, and its size.
+    const char *headlessOutput = NULL;
+    int width = DEFAULT_IMAGE_SIZE;
+    int height = DEFAULT_IMAGE_SIZE;
+
+    // Number of frames to draw offscreen before saving the last one.
+    unsigned headlessFrames = 1;
+
+    // Pick out our own options; anything else is left for GLUT.
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--pm-write")
+            pmOutput = optionValue(argc, argv, i);
+        else if (string(argv[i]) == "--pm")
+            pmSource = optionValue(argc, argv, i);
+        else if (string(argv[i]) == "--instances")
+            instanceCount = (unsigned)atoi(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--objects")
+            objectCount = (unsigned)atoi(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--mesh")
+            meshFiles.push_back(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--timings")
+            timingsOutput = optionValue(argc, argv, i);
+        else if (string(argv[i]) == "--record")
+            videoTarget = optionValue(argc, argv, i);
+        else if (string(argv[i]) == "--record-frames")
+            videoFrameLimit = (unsigned)atoi(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--record-format")
+        {
+            string format = optionValue(argc, argv, i);
+            if (format == "rgb")
+                videoFormat = VIDEO_RGB;
+            else if (format == "yuv")
+                videoFormat = VIDEO_YUV;
+            else if (format != "y4m")
+            {
+                cerr << "Unknown recording format " << format << "; use y4m, rgb, or yuv." << endl;
+                return 1;
+            }
+        }
+        else if (string(argv[i]) == "--frame-budget")
+            dynamicResolution.setBudget(atof(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--render-scale")
+            dynamicResolution.setFixedScale((float)atof(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--antialias")
+        {
+            string mode = optionValue(argc, argv, i);
+            if (!AntiAliasing::parse(mode, antiAliasingMode))
+            {
+                cerr << "Unknown anti-aliasing mode " << mode << "; use off, msaa2, msaa4, msaa8, or fxaa." << endl;
+                return 1;
+            }
+        }
+        else if (string(argv[i]) == "--prepass")
+        {
+            string mode = optionValue(argc, argv, i);
+            if (!DepthPrepass::parse(mode, depthPrepassMode))
+            {
+                cerr << "Unknown depth pre-pass mode " << mode << "; use off, on, or auto." << endl;
+                return 1;
+            }
+        }
+        else if (string(argv[i]) == "--lights")
+            pointLightCount = (unsigned)atoi(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--point-budget")
+            pointCloud.setBudget((unsigned)atoi(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--scalars")
+            scalarsPath = optionValue(argc, argv, i);
+        else if (string(argv[i]) == "--scalar-range")
+        {
+            if (sscanf(optionValue(argc, argv, i), "%f,%f", &scalarLow, &scalarHigh) != 2)
+            {
+                cerr << "Could not read scalar range " << argv[i] << "; use LOW,HIGH." << endl;
+                return 1;
+            }
+            scalarRange = true;
+        }
+        else if (string(argv[i]) == "--light-threads")
+            clusteredLighting.setThreadCount((unsigned)atoi(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--environment")
+        {
+            string path = optionValue(argc, argv, i);
+            if (!environmentLighting.load(path))
+            {
+                cerr << "Could not load environment " << path << "; use a Radiance .hdr or a .pfm file." << endl;
+                return 1;
+            }
+        }
+        else if (string(argv[i]) == "--environment-intensity")
+            environmentLighting.setIntensity((float)atof(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--ao")
+            occlusionRays = (unsigned)atoi(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--ao-cache")
+            occlusionCache = optionValue(argc, argv, i);
+        else if (string(argv[i]) == "--ao-threads")
+            ambientOcclusion.setThreadCount((unsigned)atoi(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--wire-width")
+            wireframeWidth = (float)atof(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--shadow-size")
+            shadowSize = atoi(optionValue(argc, argv, i));
+        else if (string(argv[i]) == "--lod-idle")
+            interactionLod.setIdleMilliseconds(atoi(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--headless")
+            headlessOutput = optionValue(argc, argv, i);
+        else if (string(argv[i]) == "--frames")
+            headlessFrames = max(1, atoi(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--size")
+        {
+            if (sscanf(optionValue(argc, argv, i), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                cerr << "Could not read size " << argv[i] << "; use WIDTHxHEIGHT." << endl;
+                return 1;
+            }
+        }
+        else if (string(argv[i]) == "--distance")
+            position = Vector3f(0, 0, (float)atof(optionValue(argc, argv, i)));
+        else if (string(argv[i]) == "--rotate")
+        {
+            float yaw = 0, pitch = 0;
+            if (sscanf(optionValue(argc, argv, i), "%f,%f", &yaw, &pitch) < 1)
+            {
+                cerr << "Could not read rotation " << argv[i] << "; use YAW,PITCH in degrees." << endl;
+                return 1;
+            }
+            space = Matrix4f::rotateX((float)deg2rad(pitch)) * Matrix4f::rotateY((float)deg2rad(yaw));
+        }
+        else if (string(argv[i]) == "--light")
+        {
+            float x, y, z;
+            if (sscanf(optionValue(argc, argv, i), "%f,%f,%f", &x, &y, &z) != 3)
+            {
+                cerr << "Could not read light position " << argv[i] << "; use X,Y,Z." << endl;
+                return 1;
+            }
+            Lt0pos = Vector4f(x, y, z, 1);
+        }
+        else if (string(argv[i]) == "--hcy")
+        {
+            float hue, chroma, luma, alpha = 1;
+            if (sscanf(optionValue(argc, argv, i), "%f,%f,%f,%f", &hue, &chroma, &luma, &alpha) < 3)
+            {
+                cerr << "Could not read color " << argv[i] << "; use HUE,CHROMA,LUMA[,ALPHA]." << endl;
+                return 1;
+            }
+            meshHcyColor = HCY(alpha, hue / 360.0f, chroma, luma);
+        }
+    }
+
+    // Options without a value.
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--benchmark")
+            benchmarkOnStart = true;
+        else if (string(argv[i]) == "--spin")
+            meshSpinAnimate = true;
+        else if (string(argv[i]) == "--cycle")
+            diffuseColorAnimate = true;
+        else if (string(argv[i]) == "--morph")
+            morphAnimate = true;
+        else if (string(argv[i]) == "--wireframe")
+            wireframeEnabled = true;
+        else if (string(argv[i]) == "--quad")
+            quadView = true;
+        else if (string(argv[i]) == "--transparent")
+            transparent = true;
+        else if (string(argv[i]) == "--occlusion-culling")
+            batchRenderer.setOcclusionCulling(true);
+    }
+
+    headless = headlessOutput != NULL;
+
+    // Stream a progressive mesh if one was specified.
+    if (pmSource)
+    {
+        progressiveMeshStream = new ProgressiveMeshStream();
+        if (!progressiveMeshStream->open(pmSource))
+            return 1;
+    }
+
+    // Otherwise load an .OBJ file if one was specified.
+    else
+    {
+        loadInput();
+
+        // Build a progressive mesh from it if asked to.
+        if (pmOutput && !writeProgressiveMesh(pmOutput))
+            return 1;
+    }
+
+    // Splat the vertices if there are no faces to draw them with.
+    if (vecf.empty())
+        pointCloud.build(vecv, vecn);
+
+    // Read the values to color the mesh by, one per vertex.
+    if (scalarsPath)
+    {
+        if (vecf.empty() || !scalarField.load(scalarsPath, vecv.size()))
+        {
+            cerr << "Could not read " << vecv.size() << " scalars for the mesh's vertices from "
+                << scalarsPath << "." << endl;
+            return 1;
+        }
+        if (scalarRange)
+            scalarField.setRange(scalarLow, scalarHigh);
+    }
+
+    // Simplify a proxy to draw while the view moves. Headless images are always drawn
+    // in full, so they have no use for one.
+    if (!headless)
+        interactionLod.build(vecv, vecn, vecf);
+
+    // Bake ambient occlusion if asked to, unless it is cached. Headless images need
+    // it before their first frame.
+    if (occlusionRays && !vecf.empty())
+    {
+        if (!occlusionCache || !ambientOcclusion.read(occlusionCache, vecv, vecf, occlusionRays))
+            ambientOcclusion.bake(vecv, vecf, occlusionRays);
+        if (headless)
+            ambientOcclusion.wait();
+    }
+
+    // Draw offscreen if asked to. The GLUT teapot needs a window, so a mesh must be given.
+    HeadlessContext headlessContext;
+    if (headless)
+    {
+        if (vecf.empty() && pointCloud.empty() && !progressiveMeshStream)
+        {
+            cerr << "Headless rendering needs a mesh or points on standard input or from --pm." << endl;
+            return 1;
+        }
+
+        // This also loads the OpenGL entry points beyond version 1.1.
+        if (!headlessContext.create(width, height))
+            return 1;
+    }
+    else
+    {
+        glutInit(&argc, argv);
 
-    glutInit(&argc, argv);
+        // We're going to animate it, so double buffer
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 
-    // We're going to animate it, so double buffer
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+        // Initial parameters for window position and size
+        glutInitWindowPosition(60, 60);
+        glutInitWindowSize(width, height);
+        glutCreateWindow("Assignment 0");
 
-    // Initial parameters for window position and size
-    glutInitWindowPosition(60, 60);
-    glutInitWindowSize(360, 360);
-    glutCreateWindow("Assignment 0");
+        // Load the OpenGL entry points beyond version 1.1.
+        loadGLExtensions(glutGetProcAddress);
+    }
 
     // Initialize OpenGL parameters.
     initRendering();
 
-    // Create static object mesh.
-    createStaticList(mesh, renderMesh);
+    // Compile the per-pixel lighting, falling back to fixed-function lighting.
+    if (!lightingShader.create())
+        cout << "Per-pixel shading: Unavailable, using fixed-function lighting" << endl;
+
+    // Shadow the main light when lighting per pixel, if we can.
+    if (lightingShader.valid() && (shadowSize <= 0 || !shadowMap.create(shadowSize)))
+        cout << "Shadows: Unavailable" << endl;
+
+    // Light the mesh with many point lights when asked to and we can.
+    if (clusteredLighting.create())
+        createPointLights(pointLightCount);
+    else if (pointLightCount)
+        cout << "Point lights: Unavailable, lighting with the main light only" << endl;
+
+    // Draw the points as splats when we can.
+    if (!pointCloud.empty() && !pointCloud.create())
+        cout << "Point splats: Unavailable, drawing plain points" << endl;
+
+    // Color the mesh by its values when they were given and we can.
+    if (scalarsPath && (!lightingShader.valid() || !scalarField.create(vecv, vecn, vecf)))
+        cout << "Scalars: Unavailable" << endl;
+
+    // Ripple the mesh every frame when asked to and we can.
+    if (morphAnimate && (vecf.empty() || !morphingMesh.create(vecv, vecn, vecf)))
+    {
+        cout << "Morph: Unavailable" << endl;
+        morphAnimate = false;
+    }
+
+    // Read screenshots and recorded frames back without stalling when we can.
+    pixelReadback.create();
+    videoReadback.create();
+
+    // Scale the resolution to the frame budget when we can. Headless images are
+    // drawn in full unless a fixed scale is asked for.
+    if (!dynamicResolution.create())
+        cout << "Dynamic resolution: Unavailable, drawing at full resolution" << endl;
+    else
+        dynamicResolution.setEnabled(!headless);
+
+    // Anti-alias as asked, if this context can.
+    if (!antiAliasing.create() && antiAliasingMode != ANTIALIAS_OFF)
+        cout << "Anti-aliasing: Unavailable" << endl;
+    else if (!antiAliasing.supported(antiAliasingMode))
+        cout << "Anti-aliasing: " << AntiAliasing::name(antiAliasingMode) << " unavailable" << endl;
+    antiAliasing.setMode(antiAliasingMode);
+    if (antiAliasing.clamped())
+        printAntiAliasing();
+
+    // Draw the depth first when asked or when it pays, if this context can.
+    if (!depthPrepass.create() && depthPrepassMode == DEPTH_PREPASS_ON)
+        cout << "Depth pre-pass: Unavailable" << endl;
+    depthPrepass.setMode(depthPrepassMode);
+
+    // Blend the mesh's layers when asked to and we can, at the default opacity
+    // unless a color gave it one.
+    if (!transparency.create() && transparent)
+    {
+        cout << "Transparency: Unavailable" << endl;
+        transparent = false;
+    }
+    else if (transparent && meshHcyColor.alpha >= 1)
+        meshHcyColor.alpha = TRANSPARENCY_DEFAULT_ALPHA;
+
+    // Time frames on the GPU too when we can.
+    if (!frameTimer.create())
+        cout << "GPU timer queries: Unavailable, timing on the CPU only" << endl;
+
+    if (timingsOutput && !frameTimer.openCsv(timingsOutput))
+    {
+        cerr << "Could not write frame timings " << timingsOutput << "." << endl;
+        return 1;
+    }
+
+    // Create static object mesh. Headless runs have no teapot to fall back on.
+    if (!headless || !vecf.empty())
+        createStaticList(mesh, renderMesh);
 
-    // Create static grid mesh.
-    createStaticList(grid, renderGrid);
+    // Compile the per-pixel grid, falling back to a static grid mesh.
+    if (!gridShader.create())
+        createStaticList(grid, renderGrid);
+
+    // Lay out copies of the mesh if asked to.
+    if (instanceCount)
+        createInstanceLayout(instanceCount);
+
+    // Lay out a scene of many objects if asked to.
+    if (objectCount)
+        createObjectLayout(objectCount, meshFiles);
+
+    // Say so when edges were asked for on geometry that cannot have them.
+    if (wireframeEnabled && !wireframeAvailable())
+    {
+        cout << "Wireframe: Unavailable" << endl;
+        wireframeEnabled = false;
+    }
+
+    // Draw the image and quit when there is no window.
+    if (headless)
+    {
+        int status = renderHeadless(headlessOutput, width, height, headlessFrames);
+        destroyGLObjects();
+        return status;
+    }
 
     // Set up callback functions for key presses
     glutKeyboardFunc(keyboardFunc); // Handles "normal" ASCII symbols